@@ -0,0 +1,719 @@
+/*
+    src/cli.cpp -- Headless command line interface
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <global.h>
+
+#include <colortable.h>
+#include <exrfile.h>
+#include <exrwriter.h>
+#include <image.h>
+#include <rawwriter.h>
+#include <sequence.h>
+#include <simd.h>
+#include <threadpool.h>
+#include <tonemap.h>
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+enum ExposureMode {
+	EManual = 0,
+	EKeyValue,
+	EAuto
+};
+
+static void printUsage(const char *program) {
+	cout << "Usage: " << program << " [options] <input.exr|.hdr|.pfm> <output.png|.jpg|.exr|.pfm|.y4m|-> [more outputs]" << endl
+	     << "       " << program << " [options] <input.####.exr|.hdr|.pfm> <output.####.png|.jpg|.exr|.pfm|-> [more outputs]" << endl
+	     << "       " << program << " [options] --benchmark <runs> <input.exr|.hdr|.pfm>" << endl
+	     << "       " << program << " [options] --benchmark-load <runs> <input.exr|.hdr|.pfm>" << endl
+	     << "       " << program << " [options] --benchmark-export <runs> <input.exr|.hdr|.pfm> <output.png|.jpg|.exr|.y4m>" << endl
+	     << "       " << program << " --layers <input.exr>" << endl
+	     << "       " << program << " [options] --cube <output.cube> <input.exr|.hdr|.pfm> [output.png|output.jpg]" << endl
+	     << endl
+	     << "Options:" << endl
+	     << "  -o, --operator <name>     Tonemapping operator (default: Linear), see --list" << endl
+	     << "  -p, --param <name=value>  Set an operator parameter, may be repeated" << endl
+	     << "  -e, --exposure <alpha>    Manual exposure with scale factor 2^alpha (default: 0)" << endl
+	     << "  -k, --key <value>         Key value exposure (Reinhard et al. 2002)" << endl
+	     << "  -a, --auto                Automatic key value exposure (Krawczyk et al. 2005)" << endl
+	     << "  -t, --threads <count>     Number of worker threads (default: all hardware threads)" << endl
+	     << "  -s, --simd <level>        Instruction set of the CPU kernels: scalar, sse4.2, avx2 or avx512" << endl
+	     << "                            (default: " << getSimdLevelName(getSupportedSimdLevel()) << ")" << endl
+	     << "  -f, --fast-math           Approximate pow/exp/log, stays within one 8 bit code" << endl
+	     << "  -r, --round               Round to the nearest 8 bit code instead of truncating" << endl
+	     << "  -c, --bake                Sample the curve of global luminance operators into a table" << endl
+	     << "  -g, --grid <size>         Sample the operator into a 3D table of <size>^3 entries (e.g. 33 or 65)" << endl
+	     << "                            and interpolate it per pixel, an approximation for luminance based" << endl
+	     << "                            operators (the largest error of the table is reported)" << endl
+	     << "      --cube <file>         Export the operator as .cube file (3D table, default size " << ColorTable::DefaultSize << ")," << endl
+	     << "                            its input is log2 shaped, see the comments in the file" << endl
+	     << "      --half                Keep the pixels of the image in half precision, converted row by row when mapping" << endl
+	     << "      --half-luminance      Keep the cached luminance of the image in half precision to save memory" << endl
+	     << "      --layer <name>        Layer of the EXR file to load (default: channels R, G and B without prefix)" << endl
+	     << "      --layers              List the layers of the EXR file" << endl
+	     << "      --region <x,y,w,h>    Only load a part of the data window of the EXR file" << endl
+	     << "      --subsample <factor>  Load a preview reduced by <factor>, box filtered and decoding only the" << endl
+	     << "                            chunks of the file it needs" << endl
+	     << "      --png-filter <name>   Row filter of PNG files: none, sub, up, average, paeth or adaptive" << endl
+	     << "                            (default: adaptive)" << endl
+	     << "      --png-level <level>   zlib compression level of PNG files, 0 to 9 (default: 6)" << endl
+	     << "      --png-depth <bits>    Bits per sample of PNG files, 8 or 16 (default: 8)" << endl
+	     << "      --jpeg-quality <q>    Quality of JPEG files, 1 to 100 (default: 80)" << endl
+	     << "      --jpeg-subsampling <s>  Chroma subsampling of JPEG files: 444, 422 or 420 (default: 444)" << endl
+	     << "      --jpeg-restart <rows> Rows of MCUs per restart interval of JPEG files, encoded in parallel," << endl
+	     << "                            0 for a single interval encoded on one thread (default: 1)" << endl
+	     << "      --exr-type <type>     Samples of EXR files: half or float (default: half)" << endl
+	     << "      --exr-compression <c> Compression of EXR files: none, zips or zip (default: zip)" << endl
+	     << "      --raw-format <fmt>    Pixels of uncompressed streams to - (standard output), named pipes and" << endl
+	     << "                            .rgb/.raw files: rgb24, rgb48le or y4m (default: rgb24, .y4m files are y4m)" << endl
+	     << "      --fps <rate>          Frame rate in the header of y4m streams, e.g. 24 or 30000/1001 (default: 25)" << endl
+	     << "      --frames <first-last> Frames of a sequence, #### in the file names is replaced by the zero padded" << endl
+	     << "                            frame number (default: all files that match the input)" << endl
+	     << "  -b, --benchmark <runs>    Tonemap the image <runs> times and report the throughput" << endl
+	     << "      --benchmark-load <runs>  Load the image <runs> times on 1, 4, 16 and 32 threads (or --threads)" << endl
+	     << "                            and report the load time" << endl
+	     << "      --benchmark-export <runs>  Save the image <runs> times and report the throughput" << endl
+	     << "  -l, --list                List all operators and their parameters" << endl
+	     << "  -h, --help                Show this message" << endl;
+}
+
+static void printOperators(const std::vector<std::unique_ptr<TonemapOperator>> &operators) {
+	for (size_t i = 0; i < operators.size(); ++i) {
+		cout << "[" << i << "] " << operators[i]->name << endl;
+		const ParameterBlock &parameters = operators[i]->parameters;
+		for (int k = 0; k < parameters.size(); ++k) {
+			const Parameter &p = parameters.info(k);
+			if (p.constant) continue;
+			cout << "      " << p.name << " = " << p.defaultValue
+			     << " [" << p.minValue << ", " << p.maxValue << "]" << endl;
+		}
+	}
+	cout << "Ranges of image dependent parameters (e.g. \"p\" of Clamping) are set once an image is loaded." << endl;
+}
+
+// Lower case alphanumeric characters only, e.g. "Reinhard (Extended)" -> "reinhardextended"
+static std::string normalizeName(const std::string &name) {
+	std::string result;
+	for (char c : name) {
+		if (std::isalnum((unsigned char) c)) {
+			result += (char) std::tolower((unsigned char) c);
+		}
+	}
+	return result;
+}
+
+static TonemapOperator *findOperator(const std::vector<std::unique_ptr<TonemapOperator>> &operators, const std::string &name) {
+	char *end = nullptr;
+	long index = std::strtol(name.c_str(), &end, 10);
+	if (end != name.c_str() && *end == '\0') {
+		if (index >= 0 && index < (long) operators.size()) {
+			return operators[index].get();
+		}
+		return nullptr;
+	}
+
+	std::string key = normalizeName(name);
+	for (const auto &tm : operators) {
+		if (normalizeName(tm->name) == key) {
+			return tm.get();
+		}
+	}
+	// Allow to omit the annotation in parentheses, e.g. "Uncharted" for "Uncharted (Hable)"
+	for (const auto &tm : operators) {
+		std::string base = tm->name.substr(0, tm->name.find('('));
+		if (normalizeName(base) == key) {
+			return tm.get();
+		}
+	}
+	return nullptr;
+}
+
+static void benchmark(const Image &image, const TonemapOperator *tonemap, float exposure,
+					  const TonemapOptions &options, int runs) {
+	std::vector<uint8_t> buffer(3 * (size_t) image.getWidth() * image.getHeight());
+	tonemap->process(&image, buffer.data(), exposure, nullptr, options);
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < runs; ++i) {
+		tonemap->process(&image, buffer.data(), exposure, nullptr, options);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double pixels = (double) image.getWidth() * image.getHeight() * runs;
+	cout << tonemap->name << ": " << image.getWidth() << "x" << image.getHeight() << ", "
+	     << getSimdLevelName(getSimdLevel()) << (options.math == EMathFast ? " (fast math)" : "") << ", " << ThreadPool::global().getThreadCount() << " thread(s): "
+	     << 1000.0 * seconds / runs << " ms per run, " << pixels / seconds * 1e-6 << " MPixel/s" << endl;
+}
+
+// Standard output ("-"), named pipes and .rgb, .raw or .y4m files receive uncompressed frames
+static bool isStream(const std::string &filename, const std::string &ext) {
+	if (filename == "-" || ext == "rgb" || ext == "raw" || ext == "y4m") {
+		return true;
+	}
+#if !defined(_WIN32)
+	struct stat status;
+	return stat(filename.c_str(), &status) == 0 && S_ISFIFO(status.st_mode);
+#else
+	return false;
+#endif
+}
+
+// Writer of the output format given by 'ext', null if it is not written by an ImageWriter
+static ImageWriter *createWriter(const std::string &filename, const std::string &ext, int width, int height,
+								 const PngOptions &pngOptions, const JpegOptions &jpegOptions, const ExrOptions &exrOptions,
+								 const RawOptions &rawOptions) {
+	if (isStream(filename, ext)) {
+		RawOptions options = rawOptions;
+		if (ext == "y4m") {
+			options.format = ERawY4M;
+		}
+		return new RawWriter(filename, width, height, options);
+	} else if (ext == "png") {
+		return new PngWriter(filename, width, height, pngOptions);
+	} else if (ext == "jpg" || ext == "jpeg") {
+		return new JpegWriter(filename, width, height, jpegOptions);
+	} else if (ext == "exr") {
+		return new ExrWriter(filename, width, height, exrOptions);
+	}
+	return nullptr;
+}
+
+static std::string getExtension(const std::string &filename) {
+	std::string ext = filename.substr(filename.find_last_of(".") + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext;
+}
+
+static void benchmarkExport(const Image &image, const TonemapOperator *tonemap, float exposure, const TonemapOptions &options,
+							const std::string &output, const PngOptions &pngOptions, const JpegOptions &jpegOptions,
+							const ExrOptions &exrOptions, const RawOptions &rawOptions, int runs) {
+	const std::string ext = getExtension(output);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < runs; ++i) {
+		std::unique_ptr<ImageWriter> writer(createWriter(output, ext, image.getWidth(), image.getHeight(), pngOptions, jpegOptions, exrOptions, rawOptions));
+		if (!image.save(*writer, tonemap, exposure, nullptr, options)) {
+			cerr << "Error: Could not save \"" << output << "\"" << endl;
+			return;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double pixels = (double) image.getWidth() * image.getHeight() * runs;
+	// Frames written to standard output leave the report to the error stream
+	std::ostream &report = output == "-" ? cerr : cout;
+	report << "Export: " << image.getWidth() << "x" << image.getHeight() << ", ";
+	if (isStream(output, ext)) {
+		report << "raw " << getRawFormatName(ext == "y4m" ? ERawY4M : rawOptions.format);
+	} else if (ext == "png") {
+		report << pngOptions.depth << " bit PNG, filter " << getPngFilterName(pngOptions.filter) << ", level " << pngOptions.level;
+	} else if (ext == "exr") {
+		report << (exrOptions.format == EOutputFloat ? "float" : "half") << " EXR, " << getExrCompressionName(exrOptions.compression);
+	} else {
+		report << "JPEG " << getJpegSubsamplingName(jpegOptions.subsampling) << ", quality " << jpegOptions.quality
+		     << ", restart rows " << jpegOptions.restartRows;
+	}
+	report << ", " << getSimdLevelName(getSimdLevel()) << ", " << ThreadPool::global().getThreadCount() << " thread(s): "
+	       << 1000.0 * seconds / runs << " ms per run, " << pixels / seconds * 1e-6 << " MPixel/s" << endl;
+}
+
+static int listLayers(const std::string &filename) {
+	ExrFile file(filename);
+	if (!file.isValid()) {
+		cerr << "Error: Could not open EXR file: " << file.getError() << endl;
+		return -1;
+	}
+	for (const std::string &layer : file.getLayers()) {
+		cout << (layer.empty() ? "(no prefix)" : layer) << endl;
+	}
+	return 0;
+}
+
+static void benchmarkLoad(const std::string &filename, const ImageOptions &options, int runs, const std::vector<int> &threadCounts) {
+	for (int threads : threadCounts) {
+		ThreadPool::global().setThreadCount(threads);
+		Image image(filename, options);
+		if (image.getWidth() <= 0 || image.getHeight() <= 0) {
+			return;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < runs; ++i) {
+			Image run(filename, options);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		double pixels = (double) image.getWidth() * image.getHeight() * runs;
+		cout << "Load: " << image.getWidth() << "x" << image.getHeight() << ", " << threads << " thread(s): "
+		     << 1000.0 * seconds / runs << " ms per load, " << pixels / seconds * 1e-6 << " MPixel/s" << endl;
+	}
+}
+
+static bool parseFloat(const std::string &str, float &value) {
+	char *end = nullptr;
+	value = std::strtof(str.c_str(), &end);
+	return end != str.c_str() && *end == '\0';
+}
+
+// Parameters of the command line, set after the image dependent ones
+static bool applyParameters(TonemapOperator *tonemap, const std::vector<std::pair<std::string, std::string>> &parameterValues) {
+	bool ok = true;
+	for (auto &pv : parameterValues) {
+		int index = tonemap->parameters.find(pv.first);
+		float value;
+		if (index < 0 || tonemap->parameters.info(index).constant) {
+			cerr << "Error: Operator \"" << tonemap->name << "\" has no parameter \"" << pv.first << "\"" << endl;
+			ok = false;
+		} else if (!parseFloat(pv.second, value)) {
+			cerr << "Error: Invalid value \"" << pv.second << "\" for parameter \"" << pv.first << "\"" << endl;
+			ok = false;
+		} else {
+			tonemap->parameters[index] = value;
+		}
+	}
+	return ok;
+}
+
+static float getExposure(const Image &image, ExposureMode exposureMode, float exposureValue) {
+	if (exposureMode == EKeyValue) {
+		return exposureValue / image.getLogAverageLuminance();
+	} else if (exposureMode == EAuto) {
+		return image.getAutoKeyValue() / image.getLogAverageLuminance();
+	}
+	return std::pow(2.f, exposureValue);
+}
+
+// Outputs of a sequence have a frame number pattern as well, or are streams that receive all frames
+static int exportFrames(const std::string &input, const std::vector<std::string> &outputs, std::vector<int> frames,
+						TonemapOperator *tonemap, const std::vector<std::pair<std::string, std::string>> &parameterValues,
+						ExposureMode exposureMode, float exposureValue, const ImageOptions &imageOptions,
+						const TonemapOptions &options, const PngOptions &pngOptions, const JpegOptions &jpegOptions,
+						const ExrOptions &exrOptions, const RawOptions &rawOptions, std::ostream &info) {
+	// Checked once up front, every frame applies them again after its image dependent ones
+	if (!applyParameters(tonemap, parameterValues)) {
+		return -1;
+	}
+	const FramePattern inputPattern(input);
+	if (frames.empty()) {
+		frames = inputPattern.findFrames();
+		if (frames.empty()) {
+			cerr << "Error: No files match \"" << input << "\"" << endl;
+			return -1;
+		}
+	}
+	std::vector<FramePattern> patterns;
+	std::vector<std::unique_ptr<ImageWriter>> streams(outputs.size());
+	for (const std::string &output : outputs) {
+		patterns.push_back(FramePattern(output));
+	}
+
+	auto load = [&](int number) {
+		const std::string filename = inputPattern.getFilename(number);
+		ImageOptions frameOptions = imageOptions;
+		if (frameOptions.storage == EPlanar && Image::detectFormat(filename) == EPortableFloatMap) {
+			frameOptions.storage = EInterleaved;
+		}
+		return std::unique_ptr<Image>(new Image(filename, frameOptions));
+	};
+
+	auto setup = [&](const Image &image, SequenceFrame &frame) {
+		for (size_t k = 0; k < outputs.size(); ++k) {
+			if (streams[k] && (streams[k]->getWidth() != image.getWidth() || streams[k]->getHeight() != image.getHeight())) {
+				cerr << "Error: Frame " << frame.number << " is " << image.getWidth() << "x" << image.getHeight() << ", the frames of \""
+				     << outputs[k] << "\" are " << streams[k]->getWidth() << "x" << streams[k]->getHeight() << endl;
+				return false;
+			}
+		}
+		tonemap->setParameters(&image);
+		if (!applyParameters(tonemap, parameterValues)) {
+			return false;
+		}
+		frame.exposure = getExposure(image, exposureMode, exposureValue);
+		for (size_t k = 0; k < outputs.size(); ++k) {
+			const std::string ext = getExtension(outputs[k]);
+			if (!patterns[k].isValid()) {
+				// Streams are created with the size of the first frame
+				if (!streams[k]) {
+					streams[k].reset(createWriter(outputs[k], ext, image.getWidth(), image.getHeight(), pngOptions, jpegOptions, exrOptions, rawOptions));
+				}
+				frame.writers.push_back(streams[k].get());
+			} else if (ext == "pfm") {
+				if (!image.saveAsPFM(patterns[k].getFilename(frame.number), frame.exposure)) {
+					return false;
+				}
+			} else {
+				frame.owned.emplace_back(createWriter(patterns[k].getFilename(frame.number), ext, image.getWidth(), image.getHeight(),
+													  pngOptions, jpegOptions, exrOptions, rawOptions));
+				frame.writers.push_back(frame.owned.back().get());
+			}
+		}
+		return true;
+	};
+
+	SequenceStatistics statistics;
+	const bool ok = exportSequence(frames, load, setup, tonemap, options, &statistics);
+	const double frameCount = std::max((int) frames.size(), 1);
+	info << "Sequence: " << statistics.frames << " frame(s)";
+	if (statistics.failed > 0) {
+		info << ", " << statistics.failed << " failed";
+	}
+	info << ", " << getSimdLevelName(getSimdLevel()) << ", " << ThreadPool::global().getThreadCount() << " thread(s): "
+	     << 1000.0 * statistics.seconds / frameCount << " ms per frame (busy: load "
+	     << 1000.0 * statistics.loadSeconds / frameCount << " ms, tonemap "
+	     << 1000.0 * statistics.tonemapSeconds / frameCount << " ms, encode "
+	     << 1000.0 * statistics.encodeSeconds / frameCount << " ms)" << endl;
+	return ok ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<std::unique_ptr<TonemapOperator>> operators = createTonemapOperators();
+
+	std::string operatorName = "Linear";
+	std::vector<std::pair<std::string, std::string>> parameterValues;
+	ExposureMode exposureMode = EManual;
+	float exposureValue = 0.f;
+	int benchmarkRuns = 0;
+	int loadBenchmarkRuns = 0;
+	int exportBenchmarkRuns = 0;
+	bool layers = false;
+	std::vector<int> threadCounts = { 1, 4, 16, 32 };
+	std::string cubeFile;
+	TonemapOptions options;
+	PngOptions pngOptions;
+	JpegOptions jpegOptions;
+	ExrOptions exrOptions;
+	RawOptions rawOptions;
+	ImageOptions imageOptions;
+	imageOptions.storage = EPlanar;
+	std::vector<std::string> files;
+	std::vector<int> frames;
+
+	int ret = 0;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "-h" || arg == "--help") {
+			printUsage(argv[0]);
+			return 0;
+		} else if (arg == "-l" || arg == "--list") {
+			printOperators(operators);
+			return 0;
+		} else if ((arg == "-o" || arg == "--operator") && hasValue) {
+			operatorName = argv[++i];
+		} else if ((arg == "-p" || arg == "--param") && hasValue) {
+			std::string assignment = argv[++i];
+			size_t split = assignment.find('=');
+			if (split == std::string::npos) {
+				cerr << "Error: Expected <name=value> for parameter, got \"" << assignment << "\"" << endl;
+				return -1;
+			}
+			parameterValues.push_back(std::make_pair(assignment.substr(0, split), assignment.substr(split + 1)));
+		} else if ((arg == "-e" || arg == "--exposure") && hasValue) {
+			exposureMode = EManual;
+			if (!parseFloat(argv[++i], exposureValue)) {
+				cerr << "Error: Invalid exposure value \"" << argv[i] << "\"" << endl;
+				return -1;
+			}
+		} else if ((arg == "-k" || arg == "--key") && hasValue) {
+			exposureMode = EKeyValue;
+			if (!parseFloat(argv[++i], exposureValue)) {
+				cerr << "Error: Invalid key value \"" << argv[i] << "\"" << endl;
+				return -1;
+			}
+		} else if ((arg == "-t" || arg == "--threads") && hasValue) {
+			ThreadPool::global().setThreadCount(std::atoi(argv[++i]));
+			threadCounts = { ThreadPool::global().getThreadCount() };
+		} else if ((arg == "-s" || arg == "--simd") && hasValue) {
+			SimdLevel level;
+			if (!parseSimdLevel(argv[++i], level)) {
+				cerr << "Error: Unknown instruction set \"" << argv[i] << "\"" << endl;
+				return -1;
+			}
+			if (level > getSupportedSimdLevel()) {
+				cerr << "Warning: " << getSimdLevelName(level) << " is not available, using "
+				     << getSimdLevelName(getSupportedSimdLevel()) << endl;
+			}
+			setSimdLevel(level);
+		} else if (arg == "-f" || arg == "--fast-math") {
+			options.math = EMathFast;
+		} else if (arg == "-r" || arg == "--round") {
+			options.quantization = ERound;
+		} else if (arg == "--half") {
+			imageOptions.storage = EPlanarHalf;
+		} else if (arg == "--half-luminance") {
+			imageOptions.luminance = ELuminanceHalf;
+		} else if (arg == "--layer" && hasValue) {
+			imageOptions.layer = argv[++i];
+		} else if (arg == "--layers") {
+			layers = true;
+		} else if (arg == "--region" && hasValue) {
+			int x, y, w, h;
+			char end;
+			if (sscanf(argv[++i], "%d,%d,%d,%d%c", &x, &y, &w, &h, &end) != 4 || w <= 0 || h <= 0) {
+				cerr << "Error: Invalid region \"" << argv[i] << "\", expected x,y,width,height" << endl;
+				return -1;
+			}
+			imageOptions.regionOffset = Eigen::Vector2i(x, y);
+			imageOptions.regionSize = Eigen::Vector2i(w, h);
+		} else if (arg == "--subsample" && hasValue) {
+			imageOptions.subsample = std::atoi(argv[++i]);
+			if (imageOptions.subsample < 1) {
+				cerr << "Error: Subsampling factor has to be at least 1" << endl;
+				return -1;
+			}
+		} else if (arg == "-c" || arg == "--bake") {
+			options.bakeLuminance = true;
+		} else if ((arg == "-g" || arg == "--grid") && hasValue) {
+			options.colorTableSize = std::atoi(argv[++i]);
+			if (options.colorTableSize < 2 || options.colorTableSize > ColorTable::MaxSize) {
+				cerr << "Error: Grid size has to be in [2, " << ColorTable::MaxSize << "]" << endl;
+				return -1;
+			}
+		} else if (arg == "--png-filter" && hasValue) {
+			if (!parsePngFilter(argv[++i], pngOptions.filter)) {
+				cerr << "Error: Unknown PNG filter \"" << argv[i] << "\"" << endl;
+				return -1;
+			}
+		} else if (arg == "--png-level" && hasValue) {
+			pngOptions.level = std::atoi(argv[++i]);
+			if (pngOptions.level < 0 || pngOptions.level > 9) {
+				cerr << "Error: PNG compression level has to be in [0, 9]" << endl;
+				return -1;
+			}
+		} else if (arg == "--png-depth" && hasValue) {
+			pngOptions.depth = std::atoi(argv[++i]);
+			if (pngOptions.depth != 8 && pngOptions.depth != 16) {
+				cerr << "Error: PNG depth has to be 8 or 16" << endl;
+				return -1;
+			}
+		} else if (arg == "--exr-type" && hasValue) {
+			std::string type = argv[++i];
+			if (type != "half" && type != "float") {
+				cerr << "Error: Unknown EXR sample type \"" << type << "\", use half or float" << endl;
+				return -1;
+			}
+			exrOptions.format = type == "float" ? EOutputFloat : EOutputHalf;
+		} else if (arg == "--exr-compression" && hasValue) {
+			if (!parseExrCompression(argv[++i], exrOptions.compression)) {
+				cerr << "Error: Unknown EXR compression \"" << argv[i] << "\", use none, zips or zip" << endl;
+				return -1;
+			}
+		} else if (arg == "--raw-format" && hasValue) {
+			if (!parseRawFormat(argv[++i], rawOptions.format)) {
+				cerr << "Error: Unknown raw format \"" << argv[i] << "\", use rgb24, rgb48le or y4m" << endl;
+				return -1;
+			}
+		} else if (arg == "--fps" && hasValue) {
+			int numerator, denominator = 1;
+			char separator, end;
+			const int fields = sscanf(argv[++i], "%d%c%d%c", &numerator, &separator, &denominator, &end);
+			if (!(fields == 1 || (fields == 3 && (separator == '/' || separator == ':'))) || numerator <= 0 || denominator <= 0) {
+				cerr << "Error: Invalid frame rate \"" << argv[i] << "\", expected <n> or <n>/<d>" << endl;
+				return -1;
+			}
+			rawOptions.rateNumerator = numerator;
+			rawOptions.rateDenominator = denominator;
+		} else if (arg == "--frames" && hasValue) {
+			int first, last;
+			char separator, end;
+			const int fields = sscanf(argv[++i], "%d%c%d%c", &first, &separator, &last, &end);
+			if (fields == 1) {
+				last = first;
+			}
+			if (!(fields == 1 || (fields == 3 && separator == '-')) || first < 0 || last < first) {
+				cerr << "Error: Invalid frames \"" << argv[i] << "\", expected <first>-<last>" << endl;
+				return -1;
+			}
+			frames.clear();
+			for (int frame = first; frame <= last; ++frame) {
+				frames.push_back(frame);
+			}
+		} else if (arg == "--jpeg-quality" && hasValue) {
+			jpegOptions.quality = std::atoi(argv[++i]);
+			if (jpegOptions.quality < 1 || jpegOptions.quality > 100) {
+				cerr << "Error: JPEG quality has to be in [1, 100]" << endl;
+				return -1;
+			}
+		} else if (arg == "--jpeg-subsampling" && hasValue) {
+			if (!parseJpegSubsampling(argv[++i], jpegOptions.subsampling)) {
+				cerr << "Error: Unknown JPEG subsampling \"" << argv[i] << "\", use 444, 422 or 420" << endl;
+				return -1;
+			}
+		} else if (arg == "--jpeg-restart" && hasValue) {
+			jpegOptions.restartRows = std::atoi(argv[++i]);
+			if (jpegOptions.restartRows < 0) {
+				cerr << "Error: JPEG restart rows have to be at least 0" << endl;
+				return -1;
+			}
+		} else if (arg == "--cube" && hasValue) {
+			cubeFile = argv[++i];
+		} else if ((arg == "-b" || arg == "--benchmark") && hasValue) {
+			benchmarkRuns = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--benchmark-load" && hasValue) {
+			loadBenchmarkRuns = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--benchmark-export" && hasValue) {
+			exportBenchmarkRuns = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "-a" || arg == "--auto") {
+			exposureMode = EAuto;
+		} else if (arg.size() > 1 && arg[0] == '-') {
+			cerr << "Error: Unknown or incomplete option \"" << arg << "\"" << endl;
+			printUsage(argv[0]);
+			return -1;
+		} else {
+			files.push_back(arg);
+		}
+	}
+
+	if (layers) {
+		if (files.size() != 1) {
+			printUsage(argv[0]);
+			return -1;
+		}
+		return listLayers(files[0]);
+	}
+
+	if (loadBenchmarkRuns > 0) {
+		if (files.size() != 1) {
+			printUsage(argv[0]);
+			return -1;
+		}
+		benchmarkLoad(files[0], imageOptions, loadBenchmarkRuns, threadCounts);
+		return 0;
+	}
+
+	// The image output is optional when exporting a .cube file
+	bool exportOnly = benchmarkRuns == 0 && !cubeFile.empty() && files.size() == 1;
+	if (benchmarkRuns > 0 || exportOnly ? files.size() != 1 : exportBenchmarkRuns > 0 ? files.size() != 2 : files.size() < 2) {
+		printUsage(argv[0]);
+		return -1;
+	}
+
+	const std::string &input = files[0];
+	const std::vector<std::string> outputs(files.begin() + 1, files.end());
+	bool toStdout = false;
+	for (const std::string &output : outputs) {
+		const std::string ext = getExtension(output);
+		if (!isStream(output, ext) && ext != "png" && ext != "jpg" && ext != "jpeg" && ext != "exr" && (ext != "pfm" || exportBenchmarkRuns > 0)) {
+			cerr << "Error: Unsupported output format \"" << ext << "\", use .png, .jpg, .exr, .y4m" << (exportBenchmarkRuns > 0 ? "" : ", .pfm")
+			     << " or - for frames on standard output" << endl;
+			return -1;
+		}
+		if (FramePattern::isPattern(output) && !FramePattern::isPattern(input)) {
+			cerr << "Error: \"" << output << "\" has a frame number, but \"" << input << "\" is a single image" << endl;
+			return -1;
+		} else if (FramePattern::isPattern(input) && !FramePattern::isPattern(output) && !isStream(output, ext)) {
+			cerr << "Error: \"" << output << "\" needs a frame number (####) or has to be a stream to receive a sequence" << endl;
+			return -1;
+		}
+		toStdout |= output == "-";
+	}
+	// Messages go to the error stream when the frames go to standard output
+	std::ostream &info = toStdout ? cerr : cout;
+
+	TonemapOperator *tonemap = findOperator(operators, operatorName);
+	if (!tonemap) {
+		cerr << "Error: Unknown operator \"" << operatorName << "\", see --list" << endl;
+		return -1;
+	}
+
+	if (FramePattern::isPattern(input)) {
+		if (benchmarkRuns > 0 || exportBenchmarkRuns > 0 || !cubeFile.empty()) {
+			cerr << "Error: Benchmarks and --cube take a single image, not a sequence" << endl;
+			ret = -1;
+		} else {
+			ret = exportFrames(input, outputs, frames, tonemap, parameterValues, exposureMode, exposureValue, imageOptions,
+							   options, pngOptions, jpegOptions, exrOptions, rawOptions, info);
+		}
+		return ret;
+	}
+
+	// PFM files are used in place, which needs interleaved pixels
+	if (imageOptions.storage == EPlanar && Image::detectFormat(input) == EPortableFloatMap) {
+		imageOptions.storage = EInterleaved;
+	}
+	Image image(input, imageOptions);
+	if (image.getWidth() <= 0 || image.getHeight() <= 0) {
+		return -1;
+	}
+
+	tonemap->setParameters(&image);
+	if (!applyParameters(tonemap, parameterValues)) {
+		ret = -1;
+	}
+	const float exposure = getExposure(image, exposureMode, exposureValue);
+
+	float bakeError = -1.f;
+	if (options.bakeLuminance) {
+		options.bakeError = &bakeError;
+	}
+
+	if (ret == 0 && !cubeFile.empty()) {
+		int size = options.colorTableSize > 0 ? options.colorTableSize : ColorTable::DefaultSize;
+		std::shared_ptr<const ColorTable> table = tonemap->bakeColorTable(&image, exposure, size);
+		if (table->saveAsCube(cubeFile, tonemap->name)) {
+			info << "Saved " << size << "^3 table to \"" << cubeFile << "\", shaper range 2^" << table->getLogMin()
+			     << " to 2^" << table->getLogMax() << ", max. error " << 255.f * table->getMaxError() << " / 255" << endl;
+		} else {
+			ret = -1;
+		}
+	}
+
+	if (ret == 0 && benchmarkRuns > 0) {
+		benchmark(image, tonemap, exposure, options, benchmarkRuns);
+	} else if (ret == 0 && exportBenchmarkRuns > 0) {
+		benchmarkExport(image, tonemap, exposure, options, outputs[0], pngOptions, jpegOptions, exrOptions, rawOptions, exportBenchmarkRuns);
+	} else if (ret == 0 && !exportOnly) {
+		// All PNG, JPEG and EXR files and streams are written from one tonemapping pass
+		std::vector<std::unique_ptr<ImageWriter>> writers;
+		std::vector<ImageWriter *> pointers;
+		for (const std::string &output : outputs) {
+			const std::string ext = getExtension(output);
+			if (ext == "pfm") {
+				if (!image.saveAsPFM(output, exposure)) {
+					ret = -1;
+				}
+				continue;
+			}
+			writers.emplace_back(createWriter(output, ext, image.getWidth(), image.getHeight(), pngOptions, jpegOptions, exrOptions, rawOptions));
+			pointers.push_back(writers.back().get());
+			if (!writers.back()->isValid()) {
+				cerr << "Error: Could not create \"" << output << "\"" << endl;
+				ret = -1;
+			}
+		}
+		float progress = 0.f;
+		if (ret == 0 && !pointers.empty() && !image.save(pointers, tonemap, exposure, &progress, options)) {
+			cerr << "Error: Could not save the output files" << endl;
+			ret = -1;
+		}
+	}
+
+	if (ret == 0 && options.bakeLuminance) {
+		if (bakeError < 0.f) {
+			cerr << "Warning: \"" << tonemap->name << "\" is not a global luminance operator, --bake has no effect" << endl;
+		} else {
+			info << "Baked luminance curve, max. error " << 255.f * bakeError << " / 255" << endl;
+		}
+	}
+	if (ret == 0 && options.colorTableSize > 0) {
+		// Cached by the operator since the image was mapped
+		std::shared_ptr<const ColorTable> table = tonemap->bakeColorTable(&image, exposure, options.colorTableSize);
+		info << "Sampled the operator into a " << options.colorTableSize << "^3 table, max. error "
+		     << 255.f * table->getMaxError() << " / 255" << endl;
+	}
+
+	return ret;
+}
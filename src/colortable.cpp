@@ -0,0 +1,46 @@
+/*
+    src/colortable.cpp -- Operator and display encoding baked into a 3D table
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <colortable.h>
+
+#include <cstdio>
+
+// Bound to references by std::min() and friends, which needs the definitions
+const int ColorTable::Stops;
+const int ColorTable::DefaultSize;
+const int ColorTable::MaxSize;
+
+bool ColorTable::saveAsCube(const std::string &filename, const std::string &title) const {
+	FILE *file = fopen(filename.c_str(), "w");
+	if (!file) {
+		cerr << "Error: Could not open \"" << filename << "\" for writing" << endl;
+		return false;
+	}
+
+	// The format has no notion of a log shaper, it has to be applied in front of the table
+	fprintf(file, "TITLE \"%s\"\n", title.c_str());
+	fprintf(file, "# Generated by Tone Mapper\n");
+	fprintf(file, "# Input: x' = (log2(x + 2^(%g)) - (%g)) / %g, clamped to [0, 1], for linear x of the source image\n",
+			m_logMin, m_logMin, m_logMax - m_logMin);
+	fprintf(file, "# OpenColorIO: AllocationTransform {allocation: lg2, vars: [%g, %g, %.9g]}\n", m_logMin, m_logMax, m_offset);
+	fprintf(file, "# Output: display encoded values\n");
+	fprintf(file, "LUT_3D_SIZE %d\n", m_size);
+	fprintf(file, "DOMAIN_MIN 0.0 0.0 0.0\n");
+	fprintf(file, "DOMAIN_MAX 1.0 1.0 1.0\n");
+	for (size_t i = 0; i < m_values.size(); i += 3) {
+		fprintf(file, "%.6f %.6f %.6f\n", m_values[i], m_values[i + 1], m_values[i + 2]);
+	}
+
+	bool ok = ferror(file) == 0;
+	ok &= fclose(file) == 0;
+	if (!ok) {
+		cerr << "Error: Could not write \"" << filename << "\"" << endl;
+	}
+	return ok;
+}
@@ -0,0 +1,161 @@
+/*
+    src/colortable.h -- Operator and display encoding baked into a 3D table
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+#include <simd.h>
+#include <simd/fastmath.h>
+#include <threadpool.h>
+
+/* Encoded display color of an arbitrary color operator, sampled on a
+   size^3 grid and interpolated tetrahedrally.
+
+   The grid is spaced logarithmically: every channel first goes through the
+   shaper x' = (log2(x + 2^logMin) - logMin) / (logMax - logMin), clamped
+   to [0, 1], which is the "lg2" allocation of OpenColorIO with an offset.
+   The range spans 'Stops' powers of two below the largest color component
+   of the image, the offset puts zero exactly on the first node and keeps
+   the cells near black small. Negative values are mapped like zero. The
+   shaper is evaluated with fastLog2, which is within 1 ULP of log2.
+
+   Entries are stored as interleaved RGB with red changing fastest, the
+   order of the .cube format. */
+class ColorTable {
+public:
+	// Powers of two covered by the shaper and the usual grid sizes
+	static const int Stops = 16;
+	static const int DefaultSize = 33;
+	static const int MaxSize = 129;
+
+	/* Samples mapColor(float &r, float &g, float &b), which has to replace a
+	   linear color by its encoded display value, for inputs up to 'maximum' */
+	template <typename Func>
+	ColorTable(const Func &mapColor, float maximum, int size) {
+		m_size = std::min(std::max(size, 2), MaxSize);
+		if (!(maximum > 0.f) || !std::isfinite(maximum)) maximum = 1.f;
+		m_logMax = std::ceil(std::log2(maximum));
+		m_logMin = m_logMax - Stops;
+		m_offset = std::exp2(m_logMin);
+		m_scale = (m_size - 1) / (m_logMax - m_logMin);
+		m_last = (float) (m_size - 1);
+
+		std::vector<float> nodes(m_size);
+		for (int i = 0; i < m_size; ++i) {
+			nodes[i] = std::exp2(m_logMin + i / m_scale) - m_offset;
+		}
+		nodes[0] = 0.f;
+
+		m_values.resize(3 * (size_t) m_size * m_size * m_size);
+		ThreadPool::global().parallelFor(m_size, [&](int ib) {
+			float *v = &m_values[3 * (size_t) m_size * m_size * ib];
+			for (int ig = 0; ig < m_size; ++ig) {
+				for (int ir = 0; ir < m_size; ++ir) {
+					float r = nodes[ir], g = nodes[ig], b = nodes[ib];
+					mapColor(r, g, b);
+					// NaNs get the code of zero, as in the EncodeTable
+					v[0] = r == r ? r : 0.f;
+					v[1] = g == g ? g : 0.f;
+					v[2] = b == b ? b : 0.f;
+					v += 3;
+				}
+			}
+		});
+
+		/* Largest error of the clamped display value at the centers of the
+		   cells, where the interpolation is furthest from the samples. Curves
+		   that depend on the luminance bend within the cells and are only
+		   approximated, e.g. Tumblin-Rushmeier or Ferwerda. */
+		std::vector<float> centers(m_size - 1);
+		for (int i = 0; i + 1 < m_size; ++i) {
+			centers[i] = std::exp2(m_logMin + (i + 0.5f) / m_scale) - m_offset;
+		}
+		std::vector<float> errors(m_size - 1, 0.f);
+		ThreadPool::global().parallelFor(m_size - 1, [&](int ib) {
+			for (int ig = 0; ig + 1 < m_size; ++ig) {
+				for (int ir = 0; ir + 1 < m_size; ++ir) {
+					float r = centers[ir], g = centers[ig], b = centers[ib];
+					float tr = r, tg = g, tb = b;
+					mapColor(r, g, b);
+					(*this)(tr, tg, tb);
+					float error = std::max(std::abs(clamp(r, 0.f, 1.f) - clamp(tr, 0.f, 1.f)),
+										   std::max(std::abs(clamp(g, 0.f, 1.f) - clamp(tg, 0.f, 1.f)),
+													std::abs(clamp(b, 0.f, 1.f) - clamp(tb, 0.f, 1.f))));
+					if (std::isfinite(error)) errors[ib] = std::max(errors[ib], error);
+				}
+			}
+		});
+		m_maxError = *std::max_element(errors.begin(), errors.end());
+	}
+
+	// Replaces the linear color by the interpolated display value, T is float or a SIMD pack
+	template <typename T>
+	inline void operator()(T &r, T &g, T &b) const {
+		T x = shape(r), y = shape(g), z = shape(b);
+		T xi = vmin(vfloor(x), T(m_last - 1.f));
+		T yi = vmin(vfloor(y), T(m_last - 1.f));
+		T zi = vmin(vfloor(z), T(m_last - 1.f));
+		T fx = x - xi, fy = y - yi, fz = z - zi;
+
+		/* The cell is split into six tetrahedra along its diagonal, the one
+		   containing the point follows from the order of the fractions. Its
+		   corners are the origin, one step along the axis of the largest
+		   fraction, one more step along the axis of the middle one and the
+		   opposite corner. Ties pick the same axis for both, so corner 1 and
+		   2 always differ. */
+		const float dx = 1.f, dy = (float) m_size, dz = (float) m_size * m_size;
+		T fmax = vmax(fx, vmax(fy, fz));
+		T fmin = vmin(fx, vmin(fy, fz));
+		T fmid = vmax(vmin(fx, fy), vmin(vmax(fx, fy), fz));
+		T first = vselect(fy <= fx, vselect(fz <= fx, T(dx), T(dz)), vselect(fz <= fy, T(dy), T(dz)));
+		T last = vselect(fz <= fy, vselect(fz <= fx, T(dz), T(dx)), vselect(fy <= fx, T(dy), T(dx)));
+
+		T i0 = ((zi * dz + yi * dy) + xi) * 3.f;
+		T i1 = i0 + first * 3.f;
+		T i2 = i0 + (T(dx + dy + dz) - last) * 3.f;
+		T i3 = i0 + (dx + dy + dz) * 3.f;
+		T w0 = 1.f - fmax, w1 = fmax - fmid, w2 = fmid - fmin, w3 = fmin;
+
+		r = interpolate(m_values.data(), i0, i1, i2, i3, w0, w1, w2, w3);
+		g = interpolate(m_values.data() + 1, i0, i1, i2, i3, w0, w1, w2, w3);
+		b = interpolate(m_values.data() + 2, i0, i1, i2, i3, w0, w1, w2, w3);
+	}
+
+	// Writes an Adobe .cube file, the shaper is documented in the comments
+	bool saveAsCube(const std::string &filename, const std::string &title) const;
+
+	int getSize() const { return m_size; }
+	// Largest absolute error of the interpolated display value (1 is white), measured at the centers of all cells
+	float getMaxError() const { return m_maxError; }
+	float getLogMin() const { return m_logMin; }
+	float getLogMax() const { return m_logMax; }
+	const std::vector<float> &getValues() const { return m_values; }
+
+private:
+	// Grid position of a linear value in [0, size - 1]
+	template <typename T>
+	inline T shape(const T &v) const {
+		return vclamp((fastLog2(v + m_offset) - m_logMin) * m_scale, T(0.f), T(m_last));
+	}
+
+	template <typename T>
+	static inline T interpolate(const float *table, const T &i0, const T &i1, const T &i2, const T &i3,
+								const T &w0, const T &w1, const T &w2, const T &w3) {
+		return vgather(table, i0) * w0 + vgather(table, i1) * w1 + vgather(table, i2) * w2 + vgather(table, i3) * w3;
+	}
+
+	std::vector<float> 	m_values;
+	int 				m_size;
+	float 				m_logMin;
+	float 				m_logMax;
+	float 				m_offset;
+	float 				m_scale;
+	float 				m_last;
+	float 				m_maxError;
+};
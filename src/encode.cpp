@@ -0,0 +1,128 @@
+/*
+    src/encode.cpp -- Shared output stage: clamping, display encoding and
+                      8 bit quantization via lookup table
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <encode.h>
+
+#include <mutex>
+
+namespace {
+
+const uint32_t OneBits = 0x3f800000;
+
+static_assert(sizeof(EncodeTable::Entry) == 8, "The SIMD lookups expect 8 byte entries");
+
+// Coarsest bucket size tried first (2^-7 relative width) and upper limit of the table size
+const int MaxShift = 16;
+const size_t MaxEntries = 1 << 14;
+
+const size_t CacheSize = 16;
+
+float fromBits(uint32_t bits) {
+	float x;
+	memcpy(&x, &bits, sizeof(float));
+	return x;
+}
+
+uint8_t quantize(float v, Quantization quantization) {
+	if (!(v > 0.f)) return 0;
+	if (v >= 1.f) return 255;
+	return (uint8_t) (255.f * v + (quantization == ERound ? 0.5f : 0.f));
+}
+
+}
+
+EncodeTable::EncodeTable(const EncodeCurve &curve, Quantization quantization)
+	: m_curve(curve), m_quantization(quantization) {
+	m_nan = evaluate(std::numeric_limits<float>::quiet_NaN());
+
+	// First code change in (0, 1], everything below has the code of zero
+	const uint8_t zero = code(0);
+	uint32_t lo = 0, hi = OneBits;
+	if (code(hi) == zero) {
+		lo = hi;
+	}
+	while (hi - lo > 1) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (code(mid) != zero) hi = mid;
+		else lo = mid;
+	}
+
+	// Refine until every bucket holds at most one code change, or the table gets too large
+	for (int shift = MaxShift; ; --shift) {
+		if (build(hi, shift) || shift == 0 || 2 * m_entries.size() > MaxEntries) break;
+	}
+}
+
+uint8_t EncodeTable::evaluate(float x) const {
+	return quantize(m_curve(x), m_quantization);
+}
+
+uint8_t EncodeTable::code(uint32_t bits) const {
+	return evaluate(fromBits(bits));
+}
+
+bool EncodeTable::build(uint32_t first, int shift) {
+	const uint32_t bucketSize = 1u << shift;
+	m_shift = shift;
+	m_begin = first & ~(bucketSize - 1);
+	m_entries.resize(((OneBits - m_begin) >> shift) + 2);
+
+	Entry &zero = m_entries[0];
+	zero.threshold = std::numeric_limits<float>::infinity();
+	zero.below = zero.above = code(0);
+	zero.evaluate = zero.padding = 0;
+
+	bool exact = true;
+	for (size_t i = 1; i < m_entries.size(); ++i) {
+		uint32_t lo = m_begin + (uint32_t) (i - 1) * bucketSize;
+		uint32_t hi = std::min(lo + (bucketSize - 1), OneBits);
+		Entry &entry = m_entries[i];
+		entry.below = code(lo);
+		entry.padding = 0;
+		uint8_t last = code(hi);
+		if (last == entry.below) {
+			entry.threshold = std::numeric_limits<float>::infinity();
+			entry.above = entry.below;
+			entry.evaluate = 0;
+			continue;
+		}
+
+		// Smallest value in the bucket with a different code
+		while (hi - lo > 1) {
+			uint32_t mid = lo + (hi - lo) / 2;
+			if (code(mid) != entry.below) hi = mid;
+			else lo = mid;
+		}
+		entry.threshold = fromBits(hi);
+		entry.above = code(hi);
+		entry.evaluate = entry.above != last;
+		exact &= !entry.evaluate;
+	}
+	return exact;
+}
+
+std::shared_ptr<const EncodeTable> EncodeTable::get(const EncodeCurve &curve, Quantization quantization) {
+	static std::mutex mutex;
+	static std::vector<std::shared_ptr<const EncodeTable>> cache;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < cache.size(); ++i) {
+		if (cache[i]->getCurve() == curve && cache[i]->getQuantization() == quantization) {
+			return cache[i];
+		}
+	}
+
+	std::shared_ptr<const EncodeTable> table(new EncodeTable(curve, quantization));
+	if (cache.size() == CacheSize) {
+		cache.erase(cache.begin());
+	}
+	cache.push_back(table);
+	return table;
+}
@@ -0,0 +1,150 @@
+/*
+    src/encode.h -- Shared output stage: clamping, display encoding and
+                    8 bit quantization via lookup table
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+#include <simd.h>
+
+// Conversion of the encoded value in [0, 1] to an 8 bit code
+enum Quantization {
+	ETruncate = 0,	// floor(255 * v), the historical behavior
+	ERound			// Nearest code
+};
+
+/* Sample type of the RGB pixels written by TonemapOperator::process(). All
+   formats hold the same display values: the operator output clamped to
+   [0, 1] (NaNs to 0) with the EncodeCurve applied. */
+enum OutputFormat {
+	EOutputUInt8 = 0,	// Quantized with an EncodeTable
+	EOutputUInt16,		// Quantized to 65535 steps, truncated or rounded like the 8 bit codes
+	EOutputHalf,
+	EOutputFloat
+};
+
+// Bytes per sample of the format
+inline int getOutputSampleSize(OutputFormat format) {
+	return format == EOutputUInt8 ? 1 : format == EOutputFloat ? 4 : 2;
+}
+
+// Display encoding applied by the operators after tonemapping
+struct EncodeCurve {
+	enum EType {
+		ELinear = 0,
+		EGamma,				// x^exponent
+		ESegmentedGamma		// slope * x up to 'start', (1.099 x)^exponent - 0.099 above (Drago et al. 2003)
+	};
+
+	EType type;
+	float exponent;
+	float start;
+	float slope;
+
+	EncodeCurve() : type(ELinear), exponent(1.f), start(0.f), slope(0.f) {}
+
+	static EncodeCurve gamma(float exponent) {
+		EncodeCurve curve;
+		curve.type = EGamma;
+		curve.exponent = exponent;
+		return curve;
+	}
+
+	static EncodeCurve segmentedGamma(float exponent, float start, float slope) {
+		EncodeCurve curve;
+		curve.type = ESegmentedGamma;
+		curve.exponent = exponent;
+		curve.start = start;
+		curve.slope = slope;
+		return curve;
+	}
+
+	// Clamps x to [0, 1] and applies the curve, NaNs are passed to the curve
+	float operator()(float x) const {
+		x = vmax(vmin(x, 1.f), 0.f);
+		switch (type) {
+			case EGamma: return std::pow(x, exponent);
+			case ESegmentedGamma: return x <= start ? slope * x : std::pow(1.099f * x, exponent) - 0.099f;
+			default: return x;
+		}
+	}
+
+	bool operator==(const EncodeCurve &other) const {
+		return type == other.type && exponent == other.exponent && start == other.start && slope == other.slope;
+	}
+};
+
+/* Maps linear values to 8 bit codes, gives exactly the same result as
+   quantizing curve(x) but without evaluating the curve per pixel.
+
+   The table is indexed by the upper bits of the float, i.e. its buckets
+   are spaced logarithmically and cover everything between the first code
+   change and 1 with a constant relative precision. Every bucket stores the
+   code at its start and the position of the next code change within it,
+   the resolution is chosen such that no bucket contains more than one
+   change. Typical tables have a few thousand entries of 8 bytes. Buckets
+   that still contain several changes (only possible for discontinuous
+   curves) evaluate the curve above their first change.
+
+   The lookup is branch free, the SIMD versions in kernel_*.cpp gather
+   from the same entries. */
+class EncodeTable {
+public:
+	struct Entry {
+		float threshold;	// First value with the code 'above'
+		uint8_t below;
+		uint8_t above;
+		uint8_t evaluate;	// The bucket contains several code changes
+		uint8_t padding;
+	};
+
+	EncodeTable(const EncodeCurve &curve, Quantization quantization);
+
+	// Shared table for the given curve, recently used tables are cached
+	static std::shared_ptr<const EncodeTable> get(const EncodeCurve &curve, Quantization quantization);
+
+	inline uint8_t operator()(float x) const {
+		// NaNs are handled at the end, zero and everything below the first bucket use entry 0
+		float y = x > 0.f ? std::min(x, 1.f) : 0.f;
+		uint32_t bits;
+		memcpy(&bits, &y, sizeof(float));
+		int index = std::max((int) (bits - m_begin) >> m_shift, -1) + 1;
+
+		const Entry &entry = m_entries[index];
+		uint8_t code = y < entry.threshold ? entry.below : entry.above;
+		if (entry.evaluate && !(y < entry.threshold)) code = evaluate(y);
+		return x == x ? code : m_nan;
+	}
+
+	// Code of x without the table
+	uint8_t evaluate(float x) const;
+
+	const EncodeCurve &getCurve() const { return m_curve; }
+	Quantization getQuantization() const { return m_quantization; }
+
+	// Entry 0 covers all values below getBegin(), the bucket of value y in [0, 1] is
+	// max((int) (bits(y) - getBegin()) >> getShift(), -1) + 1
+	const Entry *getEntries() const { return m_entries.data(); }
+	int getSize() const { return (int) m_entries.size(); }
+	uint32_t getBegin() const { return m_begin; }
+	int getShift() const { return m_shift; }
+	uint8_t getNanCode() const { return m_nan; }
+
+private:
+	uint8_t code(uint32_t bits) const;
+	bool build(uint32_t first, int shift);
+
+	EncodeCurve 		m_curve;
+	Quantization 		m_quantization;
+
+	uint8_t 			m_nan;
+	uint32_t 			m_begin;
+	int 				m_shift;
+	std::vector<Entry> 	m_entries;
+};
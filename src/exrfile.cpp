@@ -0,0 +1,605 @@
+/*
+    src/exrfile.cpp -- OpenEXR files decoded chunk by chunk
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+// tinyexr is compiled here, its inflate and the steps of its PIZ decoder are reused below
+#define TINYEXR_IMPLEMENTATION
+#include <exrfile.h>
+
+namespace {
+
+const uint8_t ExrMagic[4] = { 0x76, 0x2f, 0x31, 0x01 };
+
+// Flags of the version field
+const uint32_t ExrTiled = 0x200;
+const uint32_t ExrNonImage = 0x800;
+const uint32_t ExrMultiPart = 0x1000;
+
+// Scanlines per chunk of every compression
+int linesPerChunk(int compression) {
+	switch (compression) {
+		case EZipCompression:
+		case EPxr24Compression: return 16;
+		case EPizCompression:
+		case EB44Compression:
+		case EB44ACompression:
+		case EDwaaCompression: return 32;
+		case EDwabCompression: return 256;
+		default: return 1;
+	}
+}
+
+// Bounds checked reads from the header, all values are little endian
+class Reader {
+public:
+	Reader(const uint8_t *data, size_t size, size_t pos) : m_data(data), m_size(size), m_pos(pos) {}
+
+	bool ok() const { return m_ok; }
+	size_t pos() const { return m_pos; }
+
+	template <typename T>
+	T read() {
+		T value = T(0);
+		if (m_pos + sizeof(T) > m_size) {
+			m_ok = false;
+			return value;
+		}
+		memcpy(&value, m_data + m_pos, sizeof(T));
+		m_pos += sizeof(T);
+		return value;
+	}
+
+	std::string readString() {
+		const uint8_t *end = (const uint8_t *) memchr(m_data + std::min(m_pos, m_size), 0, m_size - std::min(m_pos, m_size));
+		if (!end) {
+			m_ok = false;
+			return std::string();
+		}
+		std::string str((const char *) m_data + m_pos, end - m_data - m_pos);
+		m_pos = end - m_data + 1;
+		return str;
+	}
+
+	void skip(size_t count) {
+		if (count > m_size - m_pos) m_ok = false;
+		else m_pos += count;
+	}
+
+private:
+	const uint8_t 	*m_data;
+	size_t 			m_size;
+	size_t 			m_pos;
+	bool 			m_ok = true;
+};
+
+/* The ZIP and RLE compressors store the differences of successive bytes
+   with the low and high bytes of all samples in two halves, undone here
+   from 'src' (modified) into 'dst'. From OpenEXR's ImfZip.cpp. */
+void reconstructBytes(uint8_t *src, uint8_t *dst, size_t size) {
+	for (size_t i = 1; i < size; ++i) {
+		src[i] = (uint8_t) (src[i - 1] + src[i] - 128);
+	}
+	const uint8_t *t1 = src;
+	const uint8_t *t2 = src + (size + 1) / 2;
+	for (size_t i = 0; i < size; ++i) {
+		dst[i] = (i & 1) ? *t2++ : *t1++;
+	}
+}
+
+bool decompressRle(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize) {
+	const uint8_t *srcEnd = src + srcSize;
+	uint8_t *dstEnd = dst + dstSize;
+	while (src < srcEnd) {
+		int count = (int8_t) *src++;
+		if (count < 0) {
+			// Literal run
+			count = -count;
+			if (srcEnd - src < count || dstEnd - dst < count) return false;
+			memcpy(dst, src, count);
+			src += count;
+		} else {
+			// Repeated byte
+			count += 1;
+			if (src == srcEnd || dstEnd - dst < count) return false;
+			memset(dst, *src++, count);
+		}
+		dst += count;
+	}
+	return dst == dstEnd;
+}
+
+/* Huffman decoding as in tinyexr's hufUncompress(), but with the results of
+   all steps checked. 'src' needs a few bytes of padding, the decoder reads
+   up to one byte ahead. */
+bool decompressHuffman(const char *src, int size, unsigned short *raw, int count) {
+	if (size < 20) return false;
+	const int im = (int) readUInt(src);
+	const int iM = (int) readUInt(src + 4);
+	const int bits = (int) readUInt(src + 12);
+	if (im < 0 || im >= HUF_ENCSIZE || iM < 0 || iM >= HUF_ENCSIZE || bits < 0) return false;
+
+	std::vector<long long> codes(HUF_ENCSIZE);
+	std::vector<HufDec> table(HUF_DECSIZE);
+	hufClearDecTable(table.data());
+	const char *ptr = src + 20;
+	bool ok = hufUnpackEncTable(&ptr, size - 20, im, iM, codes.data()) && ptr <= src + size &&
+			  bits <= 8 * (size - (int) (ptr - src)) && hufBuildDecTable(codes.data(), im, iM, table.data()) &&
+			  hufDecode(codes.data(), table.data(), ptr, bits, iM, count, raw);
+	hufFreeDecTable(table.data());
+	return ok;
+}
+
+}
+
+ExrFile::ExrFile(const std::string &filename) : m_file(filename) {
+	if (!m_file.isValid()) {
+		m_error = "Could not read \"" + filename + "\"";
+		return;
+	}
+	m_file.adviseSequential();
+	m_valid = parseHeader();
+}
+
+bool ExrFile::parseHeader() {
+	Reader reader(m_file.getData(), m_file.getSize(), 0);
+	uint8_t magic[4];
+	for (int i = 0; i < 4; ++i) {
+		magic[i] = reader.read<uint8_t>();
+	}
+	uint32_t version = reader.read<uint32_t>();
+	if (!reader.ok() || memcmp(magic, ExrMagic, 4) != 0) {
+		m_error = "Not an OpenEXR file";
+		return false;
+	}
+	if ((version & 0xff) != 2) {
+		m_error = "Unsupported OpenEXR version";
+		return false;
+	}
+
+	// Multi part files have a list of headers that ends with an empty one
+	m_multiPart = (version & ExrMultiPart) != 0;
+	size_t pos = reader.pos();
+	while (true) {
+		Part part;
+		bool empty;
+		if (!parsePart(pos, part, empty)) {
+			return false;
+		}
+		if (m_multiPart && empty) {
+			break;
+		}
+		if (!m_multiPart) {
+			part.tiled = (version & ExrTiled) != 0;
+			part.deep = (version & ExrNonImage) != 0;
+		}
+		if (part.channels.empty() || !part.hasDataWindow || (m_multiPart && part.chunkCount < 0)) {
+			m_error = "Incomplete OpenEXR header";
+			return false;
+		}
+		if (part.tiled && (part.tileWidth <= 0 || part.tileHeight <= 0)) {
+			m_error = "Invalid tile size";
+			return false;
+		}
+		for (const Channel &channel : part.channels) {
+			if (channel.pixelType < TINYEXR_PIXELTYPE_UINT || channel.pixelType > TINYEXR_PIXELTYPE_FLOAT) {
+				m_error = "Invalid pixel type of channel \"" + channel.name + "\"";
+				return false;
+			}
+		}
+		m_parts.push_back(part);
+		if (!m_multiPart) {
+			break;
+		}
+	}
+	if (m_parts.empty()) {
+		m_error = "Incomplete OpenEXR header";
+		return false;
+	}
+
+	// The offset tables of all parts follow the headers
+	for (Part &part : m_parts) {
+		part.offsetTable = pos;
+		pos += (size_t) std::max(part.chunkCount, 0) * sizeof(uint64_t);
+	}
+	return selectPart(0);
+}
+
+bool ExrFile::parsePart(size_t &pos, Part &part, bool &empty) {
+	Reader reader(m_file.getData(), m_file.getSize(), pos);
+	empty = true;
+	while (true) {
+		std::string name = reader.readString();
+		if (!reader.ok() || name.empty()) break;
+		empty = false;
+		std::string type = reader.readString();
+		uint32_t size = reader.read<uint32_t>();
+		if (!reader.ok()) break;
+		Reader value(m_file.getData(), std::min(m_file.getSize(), reader.pos() + size), reader.pos());
+		reader.skip(size);
+
+		if (name == "channels" && type == "chlist") {
+			while (true) {
+				Channel channel;
+				channel.name = value.readString();
+				if (channel.name.empty()) break;
+				channel.pixelType = value.read<int32_t>();
+				value.skip(4);
+				channel.xSampling = value.read<int32_t>();
+				channel.ySampling = value.read<int32_t>();
+				channel.offset = 0;
+				if (!value.ok()) break;
+				part.channels.push_back(channel);
+			}
+		} else if (name == "compression" && type == "compression") {
+			part.compression = value.read<uint8_t>();
+		} else if (name == "tiles" && type == "tiledesc") {
+			part.tileWidth = (int) value.read<uint32_t>();
+			part.tileHeight = (int) value.read<uint32_t>();
+		} else if (name == "dataWindow" && type == "box2i") {
+			part.hasDataWindow = true;
+			for (int i = 0; i < 4; ++i) {
+				part.dataWindow[i] = value.read<int32_t>();
+			}
+		} else if (name == "name" && type == "string") {
+			part.name = std::string((const char *) m_file.getData() + value.pos(), std::min((size_t) size, m_file.getSize() - value.pos()));
+		} else if (name == "type" && type == "string") {
+			const std::string partType((const char *) m_file.getData() + value.pos(), std::min((size_t) size, m_file.getSize() - value.pos()));
+			part.tiled = partType == "tiledimage" || partType == "deeptile";
+			part.deep = partType.compare(0, 4, "deep") == 0;
+		} else if (name == "chunkCount" && type == "int") {
+			part.chunkCount = value.read<int32_t>();
+		}
+		if (!value.ok()) {
+			m_error = "Invalid attribute \"" + name + "\"";
+			return false;
+		}
+	}
+	if (!reader.ok()) {
+		m_error = "Incomplete OpenEXR header";
+		return false;
+	}
+	pos = reader.pos();
+	return true;
+}
+
+bool ExrFile::selectPart(int index) {
+	const Part &part = m_parts[index];
+	m_part = index;
+	m_channels = part.channels;
+	m_compression = part.compression;
+	std::copy(part.dataWindow, part.dataWindow + 4, m_dataWindow);
+	m_tiled = part.tiled;
+	m_tileWidth = part.tileWidth;
+	m_tileHeight = part.tileHeight;
+	m_selected.assign(m_channels.size(), true);
+	m_offsets.clear();
+
+	int64_t width = (int64_t) m_dataWindow[2] - m_dataWindow[0] + 1;
+	int64_t height = (int64_t) m_dataWindow[3] - m_dataWindow[1] + 1;
+	if (width <= 0 || height <= 0 || width * height > std::numeric_limits<int>::max()) {
+		m_error = "Invalid data window";
+		return false;
+	}
+	m_width = (int) width;
+	m_height = (int) height;
+
+	m_supported = !part.deep && !IsBigEndian() && m_compression <= EPxr24Compression;
+	m_rowBytes = 0;
+	for (Channel &channel : m_channels) {
+		m_supported &= channel.xSampling == 1 && channel.ySampling == 1;
+		channel.offset = m_rowBytes / m_width;
+		m_rowBytes += (size_t) m_width * getPixelTypeSize(channel.pixelType);
+	}
+	if (!m_supported) {
+		return true;
+	}
+
+	/* Offset table of the chunks, sorted by row. Tiles are sorted by level
+	   first, the full resolution ones come first, lower levels of mipmaps
+	   are never read. */
+	if (m_tiled) {
+		m_linesPerChunk = m_tileHeight;
+		m_tilesX = (m_width + m_tileWidth - 1) / m_tileWidth;
+	} else {
+		m_linesPerChunk = linesPerChunk(m_compression);
+		m_tilesX = 1;
+	}
+	const int chunks = (m_height + m_linesPerChunk - 1) / m_linesPerChunk;
+	m_offsets.resize((size_t) chunks * m_tilesX);
+	if (m_multiPart && m_offsets.size() > (size_t) part.chunkCount) {
+		m_error = "Truncated offset table";
+		return false;
+	}
+	Reader reader(m_file.getData(), m_file.getSize(), part.offsetTable);
+	for (size_t i = 0; i < m_offsets.size(); ++i) {
+		m_offsets[i] = reader.read<uint64_t>();
+		if (m_offsets[i] > m_file.getSize()) {
+			m_error = "Invalid chunk offset";
+			return false;
+		}
+	}
+	if (!reader.ok()) {
+		m_error = "Truncated offset table";
+		return false;
+	}
+	return true;
+}
+
+std::string ExrFile::getLayer(const Part &part, const Channel &channel) const {
+	std::string name = channel.name;
+	if (m_multiPart && !part.name.empty() && name.compare(0, part.name.size() + 1, part.name + ".") != 0) {
+		name = part.name + "." + name;
+	}
+	const size_t dot = name.find_last_of('.');
+	return dot == std::string::npos ? std::string() : name.substr(0, dot);
+}
+
+std::vector<std::string> ExrFile::getLayers() const {
+	std::vector<std::string> layers;
+	for (const Part &part : m_parts) {
+		for (const Channel &channel : part.channels) {
+			const std::string layer = getLayer(part, channel);
+			if (std::find(layers.begin(), layers.end(), layer) == layers.end()) {
+				layers.push_back(layer);
+			}
+		}
+	}
+	return layers;
+}
+
+bool ExrFile::selectLayer(const std::string &layer, int channels[3]) {
+	const std::vector<std::string> layers = getLayers();
+	std::string name = layer;
+	if (name.empty() && std::find(layers.begin(), layers.end(), name) == layers.end()) {
+		name = layers.front();
+	}
+
+	for (size_t p = 0; p < m_parts.size(); ++p) {
+		std::vector<int> members;
+		for (size_t i = 0; i < m_parts[p].channels.size(); ++i) {
+			if (getLayer(m_parts[p], m_parts[p].channels[i]) == name) {
+				members.push_back((int) i);
+			}
+		}
+		if (members.empty()) {
+			continue;
+		}
+		if ((int) p != m_part && !selectPart((int) p)) {
+			return false;
+		}
+
+		// Channels are found by the part of their name behind the last dot
+		const char *suffixes[3] = { "R", "G", "B" };
+		for (int c = 0; c < 3; ++c) {
+			channels[c] = -1;
+			for (int i : members) {
+				const std::string &channel = m_channels[i].name;
+				if (members.size() == 1 || channel.substr(channel.find_last_of('.') + 1) == suffixes[c]) {
+					channels[c] = i;
+				}
+			}
+			if (channels[c] < 0) {
+				m_error = "Layer \"" + name + "\" has no R, G and B channels";
+				return false;
+			}
+		}
+		m_selected.assign(m_channels.size(), false);
+		for (int c = 0; c < 3; ++c) {
+			m_selected[channels[c]] = true;
+		}
+		return true;
+	}
+	m_error = "No layer \"" + name + "\"";
+	return false;
+}
+
+int ExrFile::findChannel(const std::string &name) const {
+	for (size_t i = 0; i < m_channels.size(); ++i) {
+		if (m_channels[i].name == name) return (int) i;
+	}
+	return -1;
+}
+
+const uint8_t *ExrFile::decodeChunk(int index, std::vector<uint8_t> &buffer, int xBegin, int xEnd) const {
+	const int lines = getChunkLines(index);
+	const size_t expected = lines * m_rowBytes;
+
+	if (!m_tiled) {
+		Reader reader(m_file.getData(), m_file.getSize(), (size_t) m_offsets[index]);
+		if (m_multiPart && reader.read<int32_t>() != m_part) {
+			return nullptr;
+		}
+		int32_t y = reader.read<int32_t>();
+		uint32_t size = reader.read<uint32_t>();
+		if (!reader.ok() || y != m_dataWindow[1] + index * m_linesPerChunk || size > m_file.getSize() - reader.pos()) {
+			return nullptr;
+		}
+		const uint8_t *data = m_file.getData() + reader.pos();
+
+		// Chunks that would not get smaller are always stored uncompressed
+		if (size == expected) {
+			return data;
+		}
+		if (buffer.size() < 2 * expected) {
+			buffer.resize(2 * expected);
+		}
+		return decompress(data, size, m_width, lines, buffer.data(), buffer.data() + expected) ? buffer.data() : nullptr;
+	}
+
+	// Tiles of the row within [xBegin, xEnd) are decoded one after the other and copied into their columns
+	const size_t pixelBytes = m_rowBytes / m_width;
+	const size_t tileSize = (size_t) m_tileWidth * lines * pixelBytes;
+	if (buffer.size() < expected + 2 * tileSize) {
+		buffer.resize(expected + 2 * tileSize);
+	}
+	uint8_t *rows = buffer.data();
+	uint8_t *tile = rows + expected;
+	const int txEnd = std::min(m_tilesX, (std::min(xEnd, m_width) + m_tileWidth - 1) / m_tileWidth);
+	for (int tx = std::max(xBegin, 0) / m_tileWidth; tx < txEnd; ++tx) {
+		Reader reader(m_file.getData(), m_file.getSize(), (size_t) m_offsets[(size_t) index * m_tilesX + tx]);
+		if (m_multiPart && reader.read<int32_t>() != m_part) {
+			return nullptr;
+		}
+		int32_t x = reader.read<int32_t>();
+		int32_t y = reader.read<int32_t>();
+		int32_t levelX = reader.read<int32_t>();
+		int32_t levelY = reader.read<int32_t>();
+		uint32_t size = reader.read<uint32_t>();
+		if (!reader.ok() || x != tx || y != index || levelX != 0 || levelY != 0 || size > m_file.getSize() - reader.pos()) {
+			return nullptr;
+		}
+		const uint8_t *data = m_file.getData() + reader.pos();
+
+		const int width = std::min(m_tileWidth, m_width - tx * m_tileWidth);
+		const size_t tileExpected = width * lines * pixelBytes;
+		if (size != tileExpected) {
+			if (!decompress(data, size, width, lines, tile, tile + tileSize)) return nullptr;
+			data = tile;
+		}
+		for (int line = 0; line < lines; ++line) {
+			for (size_t c = 0; c < m_channels.size(); ++c) {
+				const Channel &channel = m_channels[c];
+				const size_t sampleBytes = getPixelTypeSize(channel.pixelType);
+				if (m_selected[c]) {
+					memcpy(rows + line * m_rowBytes + channel.offset * m_width + sampleBytes * tx * m_tileWidth, data, sampleBytes * width);
+				}
+				data += sampleBytes * width;
+			}
+		}
+	}
+	return rows;
+}
+
+bool ExrFile::decompress(const uint8_t *src, size_t size, int width, int lines, uint8_t *dst, uint8_t *tmp) const {
+	const size_t expected = lines * width * (m_rowBytes / m_width);
+	if (size >= expected) {
+		return false;
+	}
+	switch (m_compression) {
+		case ERleCompression:
+			if (!decompressRle(src, size, tmp, expected)) return false;
+			reconstructBytes(tmp, dst, expected);
+			return true;
+		case EZipsCompression:
+		case EZipCompression: {
+			miniz::mz_ulong length = (miniz::mz_ulong) expected;
+			if (miniz::mz_uncompress(tmp, &length, src, size) != miniz::MZ_OK || length != expected) return false;
+			reconstructBytes(tmp, dst, expected);
+			return true;
+		}
+		case EPizCompression:
+			return decompressPiz(src, size, width, lines, dst);
+		case EPxr24Compression: {
+			// Floats lose their lowest 8 bits, so the inflated data is smaller
+			size_t packed = 0;
+			for (const Channel &channel : m_channels) {
+				packed += (size_t) width * lines * (channel.pixelType == TINYEXR_PIXELTYPE_FLOAT ? 3 : getPixelTypeSize(channel.pixelType));
+			}
+			miniz::mz_ulong length = (miniz::mz_ulong) packed;
+			if (miniz::mz_uncompress(tmp, &length, src, size) != miniz::MZ_OK || length != packed) return false;
+			reconstructPxr24(tmp, dst, width, lines);
+			return true;
+		}
+		default:
+			return false;
+	}
+}
+
+bool ExrFile::decompressPiz(const uint8_t *src, size_t size, int width, int lines, uint8_t *dst) const {
+	/* Same steps as tinyexr's DecompressPiz(), which trusts the lengths in
+	   the data and ignores failures of the Huffman decoder. A bitmap of the
+	   16 bit values that occur, the Huffman coded wavelet coefficients of all
+	   channels and the lookup table that maps them back to the values. */
+	Reader reader(src, size, 0);
+	const uint16_t minNonZero = reader.read<uint16_t>();
+	const uint16_t maxNonZero = reader.read<uint16_t>();
+	if (!reader.ok() || maxNonZero >= BITMAP_SIZE) return false;
+
+	std::vector<unsigned char> bitmap(BITMAP_SIZE, 0);
+	if (minNonZero <= maxNonZero) {
+		const size_t count = maxNonZero - minNonZero + 1;
+		reader.skip(count);
+		if (!reader.ok()) return false;
+		memcpy(&bitmap[minNonZero], src + reader.pos() - count, count);
+	}
+	std::vector<unsigned short> lut(USHORT_RANGE);
+	const unsigned short maxValue = reverseLutFromBitmap(bitmap.data(), lut.data());
+
+	const int32_t length = reader.read<int32_t>();
+	if (!reader.ok() || length < 0 || (size_t) length > size - reader.pos()) return false;
+
+	// Copied with room for the decoder to read ahead, the output has one sample in front for runs at its start
+	std::vector<char> compressed(src + reader.pos(), src + reader.pos() + length);
+	compressed.resize(length + 8, 0);
+	const size_t samples = (size_t) lines * width * (m_rowBytes / m_width) / 2;
+	std::vector<unsigned short> buffer(samples + 1, 0);
+	unsigned short *data = buffer.data() + 1;
+	if (samples > (size_t) std::numeric_limits<int>::max() || !decompressHuffman(compressed.data(), length, data, (int) samples)) {
+		return false;
+	}
+
+	// Samples of float and unsigned int channels are two 16 bit words, transformed separately
+	std::vector<const unsigned short *> rows;
+	unsigned short *channel = data;
+	for (const Channel &c : m_channels) {
+		const int words = getPixelTypeSize(c.pixelType) / 2;
+		for (int w = 0; w < words; ++w) {
+			wav2Decode(channel + w, width, words, lines, width * words, maxValue);
+		}
+		rows.push_back(channel);
+		channel += (size_t) width * lines * words;
+	}
+	applyLut(lut.data(), data, (int) samples);
+
+	// The channels are stored one after the other, the chunk has them interleaved per line
+	for (int line = 0; line < lines; ++line) {
+		for (size_t c = 0; c < m_channels.size(); ++c) {
+			const size_t bytes = (size_t) width * getPixelTypeSize(m_channels[c].pixelType);
+			memcpy(dst, rows[c], bytes);
+			rows[c] += bytes / 2;
+			dst += bytes;
+		}
+	}
+	return true;
+}
+
+void ExrFile::reconstructPxr24(const uint8_t *src, uint8_t *dst, int width, int lines) const {
+	/* Every channel of a row is stored as byte planes of the differences
+	   between successive samples, most significant byte first. From
+	   OpenEXR's ImfPxr24Compressor.cpp. */
+	for (int line = 0; line < lines; ++line) {
+		for (size_t c = 0; c < m_channels.size(); ++c) {
+			const Channel &channel = m_channels[c];
+			const int bytes = channel.pixelType == TINYEXR_PIXELTYPE_FLOAT ? 3 : getPixelTypeSize(channel.pixelType);
+			if (!m_selected[c]) {
+				src += (size_t) bytes * width;
+				dst += (size_t) getPixelTypeSize(channel.pixelType) * width;
+				continue;
+			}
+			uint32_t pixel = 0;
+			for (int j = 0; j < width; ++j) {
+				uint32_t diff = 0;
+				for (int b = 0; b < bytes; ++b) {
+					diff = (diff << 8) | src[b * width + j];
+				}
+				if (channel.pixelType == TINYEXR_PIXELTYPE_FLOAT) {
+					diff <<= 8;
+				}
+				pixel += diff;
+				if (channel.pixelType == TINYEXR_PIXELTYPE_HALF) {
+					const uint16_t half = (uint16_t) pixel;
+					memcpy(dst, &half, sizeof(uint16_t));
+				} else {
+					memcpy(dst, &pixel, sizeof(uint32_t));
+				}
+				dst += getPixelTypeSize(channel.pixelType);
+			}
+			src += (size_t) bytes * width;
+		}
+	}
+}
@@ -0,0 +1,149 @@
+/*
+    src/exrfile.h -- OpenEXR files decoded chunk by chunk
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+#include <mappedfile.h>
+
+#include <tinyexr.h>
+
+// Compression of the chunks, the values are the ones of the file format
+enum ExrCompression {
+	ENoCompression = 0,
+	ERleCompression,
+	EZipsCompression,
+	EZipCompression,
+	EPizCompression,
+	EPxr24Compression,
+	EB44Compression,
+	EB44ACompression,
+	EDwaaCompression,
+	EDwabCompression
+};
+
+/* OpenEXR file read from a MappedFile. Chunks are decoded one at a time,
+   uncompressed scanlines are returned straight from the mapped file, so
+   there is no copy of the whole file or of the decoded channels besides
+   the caller's own storage. decodeChunk() can be called concurrently with
+   separate buffers.
+
+   Multi part files are read one part at a time, the first one unless
+   selectLayer() picks another. Tiled files are read as chunks of one row
+   of tiles at full resolution. Decoding supports uncompressed, RLE, ZIPS,
+   ZIP, PIZ and PXR24 data with full resolution channels on little endian
+   machines, isSupported() is false for deep parts and other compressions. */
+class ExrFile {
+public:
+	struct Channel {
+		std::string name;
+		int pixelType;		// TINYEXR_PIXELTYPE_*
+		int xSampling;
+		int ySampling;
+		size_t offset;		// Bytes per pixel of the channels in front of it
+	};
+
+	explicit ExrFile(const std::string &filename);
+
+	// The header could be parsed, otherwise getError() tells why
+	bool isValid() const { return m_valid; }
+	bool isSupported() const { return m_supported; }
+	const std::string &getError() const { return m_error; }
+
+	int getWidth() const { return m_width; }
+	int getHeight() const { return m_height; }
+	int getCompression() const { return m_compression; }
+	const std::vector<Channel> &getChannels() const { return m_channels; }
+	// Index of the channel called 'name', -1 if there is none
+	int findChannel(const std::string &name) const;
+
+	bool isTiled() const { return m_tiled; }
+
+	/* Layers of all parts in the order of their channels, the part of a
+	   channel name in front of its last dot. Channels of named parts in
+	   multi part files are prefixed with the part name ("diffuse" + "R"
+	   is in layer "diffuse"). "" is the layer of channels without a dot. */
+	std::vector<std::string> getLayers() const;
+
+	/* Switches to the part of 'layer' and finds its R, G and B channels, or
+	   its only channel three times. The empty name picks the channels
+	   without a dot, or the first layer if there are none. decodeChunk()
+	   skips the work for other channels where the compression allows it,
+	   their samples are undefined. False if the layer cannot be used. */
+	bool selectLayer(const std::string &layer, int channels[3]);
+
+	// Chunk 'index' holds the rows [index * getLinesPerChunk(), ...) of the data window
+	int getLinesPerChunk() const { return m_linesPerChunk; }
+	int getChunkCount() const { return (int) (m_offsets.size() / m_tilesX); }
+
+	/* Uncompressed data of chunk 'index' as whole rows, pointing either
+	   into the mapped file or into 'buffer'. Null if the chunk is corrupt.
+	   Tiles outside of the columns [xBegin, xEnd) are skipped and leave
+	   their part of the rows undefined. */
+	const uint8_t *decodeChunk(int index, std::vector<uint8_t> &buffer, int xBegin = 0,
+							   int xEnd = std::numeric_limits<int>::max()) const;
+
+	// Samples of 'channel' in row 'line' of a decoded chunk
+	inline const uint8_t *getChannelRow(const uint8_t *chunk, int line, int channel) const {
+		return chunk + line * m_rowBytes + m_channels[channel].offset * m_width;
+	}
+
+	// Bytes per sample of a TINYEXR_PIXELTYPE_*
+	static int getPixelTypeSize(int pixelType) { return pixelType == TINYEXR_PIXELTYPE_HALF ? 2 : 4; }
+
+private:
+	struct Part {
+		std::string 			name;
+		std::vector<Channel> 	channels;
+		int 					compression = 0;
+		int 					dataWindow[4];
+		bool 					hasDataWindow = false;
+		bool 					tiled = false;
+		bool 					deep = false;
+		int 					tileWidth = 0;
+		int 					tileHeight = 0;
+		int 					chunkCount = -1;
+		size_t 					offsetTable = 0;
+	};
+
+	bool parseHeader();
+	// Attributes from 'pos' up to the end of the header, 'empty' if there are none
+	bool parsePart(size_t &pos, Part &part, bool &empty);
+	bool selectPart(int index);
+	std::string getLayer(const Part &part, const Channel &channel) const;
+	// Data of 'lines' rows of 'width' pixels, 'tmp' has room for as many bytes as 'dst'
+	bool decompress(const uint8_t *src, size_t size, int width, int lines, uint8_t *dst, uint8_t *tmp) const;
+	void reconstructPxr24(const uint8_t *src, uint8_t *dst, int width, int lines) const;
+	bool decompressPiz(const uint8_t *src, size_t size, int width, int lines, uint8_t *dst) const;
+	int getChunkLines(int index) const { return std::min(m_linesPerChunk, m_height - index * m_linesPerChunk); }
+
+	MappedFile 				m_file;
+	bool 					m_valid = false;
+	bool 					m_supported = false;
+	std::string 			m_error;
+	std::vector<Part> 		m_parts;
+	bool 					m_multiPart = false;
+
+	// Selected part
+	int 					m_part = -1;
+	std::vector<bool> 		m_selected;
+
+	std::vector<Channel> 	m_channels;
+	int 					m_compression = 0;
+	int 					m_dataWindow[4];
+	int 					m_width = 0;
+	int 					m_height = 0;
+	int 					m_linesPerChunk = 1;
+	bool 					m_tiled = false;
+	int 					m_tileWidth = 0;
+	int 					m_tileHeight = 0;
+	int 					m_tilesX = 1;
+	size_t 					m_rowBytes = 0;
+	std::vector<uint64_t> 	m_offsets;
+};
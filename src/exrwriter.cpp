@@ -0,0 +1,203 @@
+/*
+    src/exrwriter.cpp -- OpenEXR files written band by band
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <exrwriter.h>
+
+#include <threadpool.h>
+
+#include <atomic>
+#include <zlib.h>
+
+namespace {
+
+const uint8_t ExrMagic[4] = { 0x76, 0x2f, 0x31, 0x01 };
+
+// Little endian values of the header
+template <typename T>
+void append(std::vector<uint8_t> &dst, T value) {
+	for (size_t i = 0; i < sizeof(T); ++i) {
+		dst.push_back((uint8_t) (value >> (8 * i)));
+	}
+}
+
+void append(std::vector<uint8_t> &dst, float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(float));
+	append(dst, bits);
+}
+
+void appendString(std::vector<uint8_t> &dst, const char *str) {
+	dst.insert(dst.end(), str, str + strlen(str) + 1);
+}
+
+void appendAttribute(std::vector<uint8_t> &dst, const char *name, const char *type, const std::vector<uint8_t> &value) {
+	appendString(dst, name);
+	appendString(dst, type);
+	append(dst, (int32_t) value.size());
+	dst.insert(dst.end(), value.begin(), value.end());
+}
+
+// The inverse of reconstructBytes() in exrfile.cpp: even bytes, then odd ones, as differences
+void predictBytes(const uint8_t *src, uint8_t *dst, size_t size) {
+	uint8_t *t1 = dst, *t2 = dst + (size + 1) / 2;
+	for (size_t i = 0; i < size; ++i) {
+		*((i & 1) ? t2++ : t1++) = src[i];
+	}
+	for (size_t i = size - 1; i > 0; --i) {
+		dst[i] = (uint8_t) (dst[i] - dst[i - 1] + 128);
+	}
+}
+
+}
+
+const char *getExrCompressionName(ExrCompression compression) {
+	switch (compression) {
+		case ENoCompression: return "none";
+		case EZipsCompression: return "zips";
+		case EZipCompression: return "zip";
+		default: return "unsupported";
+	}
+}
+
+bool parseExrCompression(const std::string &name, ExrCompression &compression) {
+	for (ExrCompression c : { ENoCompression, EZipsCompression, EZipCompression }) {
+		if (name == getExrCompressionName(c)) {
+			compression = c;
+			return true;
+		}
+	}
+	return false;
+}
+
+ExrWriter::ExrWriter(const std::string &filename, int width, int height, const ExrOptions &options)
+	: ImageWriter(filename, width, height), m_options(options) {
+	if (m_options.format != EOutputFloat) {
+		m_options.format = EOutputHalf;
+	}
+	if (m_options.compression != EZipsCompression && m_options.compression != EZipCompression) {
+		m_options.compression = ENoCompression;
+	}
+	m_linesPerChunk = m_options.compression == EZipCompression ? 16 : 1;
+	m_offsets.reserve((height + m_linesPerChunk - 1) / m_linesPerChunk);
+
+	// Channels in alphabetical order, without subsampling
+	std::vector<uint8_t> channels;
+	for (const char *name : { "B", "G", "R" }) {
+		appendString(channels, name);
+		append(channels, (int32_t) (m_options.format == EOutputFloat ? TINYEXR_PIXELTYPE_FLOAT : TINYEXR_PIXELTYPE_HALF));
+		append(channels, (uint32_t) 0);		// pLinear and reserved
+		append(channels, (int32_t) 1);
+		append(channels, (int32_t) 1);
+	}
+	channels.push_back(0);
+	std::vector<uint8_t> window;
+	for (int32_t value : { 0, 0, width - 1, height - 1 }) {
+		append(window, value);
+	}
+	std::vector<uint8_t> compression(1, (uint8_t) m_options.compression), lineOrder(1, 0), aspect, center, screenWidth;
+	append(aspect, 1.f);
+	append(center, 0.f);
+	append(center, 0.f);
+	append(screenWidth, 1.f);
+
+	std::vector<uint8_t> header(ExrMagic, ExrMagic + 4);
+	append(header, (uint32_t) 2);
+	appendAttribute(header, "channels", "chlist", channels);
+	appendAttribute(header, "compression", "compression", compression);
+	appendAttribute(header, "dataWindow", "box2i", window);
+	appendAttribute(header, "displayWindow", "box2i", window);
+	appendAttribute(header, "lineOrder", "lineOrder", lineOrder);
+	appendAttribute(header, "pixelAspectRatio", "float", aspect);
+	appendAttribute(header, "screenWindowCenter", "v2f", center);
+	appendAttribute(header, "screenWindowWidth", "float", screenWidth);
+	header.push_back(0);
+	write(header.data(), header.size());
+
+	// The offset table is written by finish()
+	m_offsetTable = getPosition();
+	const std::vector<uint8_t> offsets(m_offsets.capacity() * sizeof(uint64_t), 0);
+	write(offsets.data(), offsets.size());
+}
+
+bool ExrWriter::writeRows(const uint8_t *rgb, int count) {
+	if (!isValid() || count <= 0 || m_rows + count > m_height) {
+		return false;
+	}
+	const int sampleSize = getOutputSampleSize(m_options.format);
+	const size_t rowSize = 3 * (size_t) m_width * sampleSize;
+	const int chunks = (count + m_linesPerChunk - 1) / m_linesPerChunk;
+
+	// Chunk data: the line number, the size and the lines with one channel after the other
+	std::vector<std::vector<uint8_t>> data(chunks);
+	std::atomic<bool> failed(false);
+	ThreadPool::global().parallelFor(chunks, [&](int chunk) {
+		const int lineBegin = chunk * m_linesPerChunk;
+		const int lines = std::min(count - lineBegin, m_linesPerChunk);
+		const size_t size = lines * rowSize;
+		std::vector<uint8_t> raw(size);
+		uint8_t *dst = raw.data();
+		for (int i = lineBegin; i < lineBegin + lines; ++i) {
+			for (int c = 2; c >= 0; --c) {
+				const uint8_t *src = rgb + i * rowSize + c * sampleSize;
+				for (int j = 0; j < m_width; ++j, src += 3 * sampleSize, dst += sampleSize) {
+					memcpy(dst, src, sampleSize);
+				}
+			}
+		}
+
+		std::vector<uint8_t> &out = data[chunk];
+		append(out, (int32_t) (m_rows + lineBegin));
+		append(out, (int32_t) 0);
+		if (m_options.compression != ENoCompression) {
+			// Kept uncompressed if that is not smaller
+			std::vector<uint8_t> predicted(size);
+			predictBytes(raw.data(), predicted.data(), size);
+			uLongf length = compressBound((uLong) size);
+			out.resize(8 + length);
+			if (compress(out.data() + 8, &length, predicted.data(), (uLong) size) != Z_OK) {
+				failed = true;
+				return;
+			}
+			out.resize(8 + length);
+			if (length >= size) {
+				out.resize(8);
+			}
+		}
+		if (out.size() == 8) {
+			out.insert(out.end(), raw.begin(), raw.end());
+		}
+		const uint32_t dataSize = (uint32_t) (out.size() - 8);
+		for (int i = 0; i < 4; ++i) {
+			out[4 + i] = (uint8_t) (dataSize >> (8 * i));
+		}
+	});
+	if (failed) {
+		return false;
+	}
+
+	for (const std::vector<uint8_t> &chunk : data) {
+		m_offsets.push_back(getPosition());
+		write(chunk.data(), chunk.size());
+	}
+	m_rows += count;
+	return !hasFailed();
+}
+
+bool ExrWriter::finish() {
+	if (!isValid() || m_rows != m_height) {
+		ImageWriter::finish();
+		return false;
+	}
+	std::vector<uint8_t> offsets;
+	for (uint64_t offset : m_offsets) {
+		append(offsets, offset);
+	}
+	writeAt(m_offsetTable, offsets.data(), offsets.size());
+	return ImageWriter::finish();
+}
@@ -0,0 +1,48 @@
+/*
+    src/exrwriter.h -- OpenEXR files written band by band
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <exrfile.h>
+#include <imagewriter.h>
+
+const char *getExrCompressionName(ExrCompression compression);
+// Parses "none", "zips" or "zip", the compressions ExrWriter supports
+bool parseExrCompression(const std::string &name, ExrCompression &compression);
+
+struct ExrOptions {
+	// EOutputHalf or EOutputFloat
+	OutputFormat format;
+	// ENoCompression, EZipsCompression or EZipCompression
+	ExrCompression compression;
+
+	ExrOptions() : format(EOutputHalf), compression(EZipCompression) {}
+};
+
+/* Single part OpenEXR scanline file with R, G and B channels of half or
+   float samples, for little endian machines. The chunks of every call
+   (one row each, 16 with ZIP) are compressed in parallel on
+   ThreadPool::global() and written right away, finish() fills in the
+   offset table in front of them. */
+class ExrWriter : public ImageWriter {
+public:
+	ExrWriter(const std::string &filename, int width, int height, const ExrOptions &options = ExrOptions());
+
+	OutputFormat getFormat() const override { return m_options.format; }
+	int getRowAlignment() const override { return m_linesPerChunk; }
+	bool writeRows(const uint8_t *rgb, int count) override;
+	bool finish() override;
+
+private:
+	ExrOptions 				m_options;
+	int 					m_linesPerChunk;
+	int 					m_rows = 0;
+	uint64_t 				m_offsetTable = 0;
+	std::vector<uint64_t> 	m_offsets;
+};
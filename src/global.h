@@ -16,12 +16,22 @@
 #endif
 
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <limits>
 #include <algorithm>
 #include <vector>
 #include <map>
 #include <cassert>
 #include <memory>
 #include <cmath>
+#include <cstdlib>
+
+#ifdef _MSC_VER
+	#include <malloc.h>
+#endif
 
 using std::cout;
 using std::cerr;
@@ -37,4 +47,27 @@ inline float inverseLerp(float v, float min, float max) {
 
 inline float clamp(float v, float min, float max) {
 	return std::min(max, std::max(min, v));
-}
\ No newline at end of file
+}
+
+// Memory aligned to 'alignment' bytes (a power of two), released with alignedFree()
+inline void *alignedMalloc(size_t size, size_t alignment) {
+#ifdef _MSC_VER
+	return _aligned_malloc(size, alignment);
+#else
+	void *ptr = nullptr;
+	return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+#endif
+}
+
+inline void alignedFree(void *ptr) {
+#ifdef _MSC_VER
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+// Deleter of std::unique_ptr for memory from alignedMalloc()
+struct AlignedDeleter {
+	void operator()(void *ptr) const { alignedFree(ptr); }
+};
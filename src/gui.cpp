@@ -12,54 +12,25 @@
 #include <image.h>
 #include <tonemap.h>
 
-#include <operators/clamping.h>
-#include <operators/drago.h>
-#include <operators/exponential.h>
-#include <operators/exponentiation.h>
-#include <operators/ferwerda.h>
-#include <operators/filmic1.h>
-#include <operators/filmic2.h>
-#include <operators/insomniac.h>
-#include <operators/uncharted.h>
-#include <operators/aces.h>
-#include <operators/linear.h>
-#include <operators/logarithmic.h>
-#include <operators/maxdivision.h>
-#include <operators/meanvalue.h>
-#include <operators/reinhard.h>
-#include <operators/reinhard_devlin.h>
-#include <operators/reinhard_extended.h>
-#include <operators/schlick.h>
-#include <operators/srgb.h>
-#include <operators/tumblin_rushmeier.h>
-#include <operators/ward.h>
-
 TonemapperScreen::TonemapperScreen() : nanogui::Screen(Eigen::Vector2i(800, 600), "Tone Mapper", true, false) {
 	using namespace nanogui;
 
 	m_tonemapIndex = 0;
-	m_tonemapOperators = std::vector<TonemapOperator *>();
-	m_tonemapOperators.push_back(new LinearOperator());
-	m_tonemapOperators.push_back(new SRGBOperator());
-	m_tonemapOperators.push_back(new ReinhardOperator());
-	m_tonemapOperators.push_back(new ExtendedReinhardOperator());
-	m_tonemapOperators.push_back(new WardOperator());
-	m_tonemapOperators.push_back(new FerwerdaOperator());
-	m_tonemapOperators.push_back(new SchlickOperator());
-	m_tonemapOperators.push_back(new TumblinRushmeierOperator());
-	m_tonemapOperators.push_back(new DragoOperator());
-	m_tonemapOperators.push_back(new ReinhardDevlinOperator());
-	m_tonemapOperators.push_back(new Filmic1Operator());
-	m_tonemapOperators.push_back(new Filmic2Operator());
-	m_tonemapOperators.push_back(new UnchartedOperator());
-	m_tonemapOperators.push_back(new ACESOperator());
-	m_tonemapOperators.push_back(new InsomniacOperator());
-	m_tonemapOperators.push_back(new MaximumDivisionOperator());
-	m_tonemapOperators.push_back(new MeanValueOperator());
-	m_tonemapOperators.push_back(new ClampingOperator());
-	m_tonemapOperators.push_back(new LogarithmicOperator());
-	m_tonemapOperators.push_back(new ExponentialOperator());
-	m_tonemapOperators.push_back(new ExponentiationOperator());
+	m_tonemapOperators = createTonemapOperators();
+	for (const auto &tm : m_tonemapOperators) {
+		auto shader = new GLShader();
+		shader->init(tm->shaderName, tm->vertexShader, tm->fragmentShader);
+		m_shaders.push_back(shader);
+
+		// Look up uniform locations once, drawContents() only uploads values
+		ShaderUniforms uniforms;
+		uniforms.source = shader->uniform("source", false);
+		uniforms.exposure = shader->uniform("exposure", false);
+		for (int i = 0; i < tm->parameters.size(); ++i) {
+			uniforms.parameters.push_back(shader->uniform(tm->parameters.info(i).uniform, false));
+		}
+		m_uniforms.push_back(uniforms);
+	}
 
 	m_exposureIndex = 0;
 
@@ -100,9 +71,9 @@ TonemapperScreen::TonemapperScreen() : nanogui::Screen(Eigen::Vector2i(800, 600)
 	auto *openButton = new Button(m_window, "Open HDR image");
 	openButton->setBackgroundColor(nanogui::Color(0, 255, 0, 25));
 	openButton->setIcon(ENTYPO_ICON_FOLDER);
-	openButton->setTooltip("Open .exr HDR image");
+	openButton->setTooltip("Open .exr, .hdr or .pfm HDR image");
 	openButton->setCallback([&] {
-		std::string filename = file_dialog({ {"exr", "OpenEXR"} }, false);
+		std::string filename = file_dialog({ {"exr", "OpenEXR"}, {"hdr", "Radiance HDR"}, {"pfm", "Portable Float Map"} }, false);
 		if (filename != "") {
 			cout << filename << endl;
 			setImage(filename);
@@ -137,9 +108,9 @@ TonemapperScreen::TonemapperScreen() : nanogui::Screen(Eigen::Vector2i(800, 600)
 				std::string ext = filename.substr(found+1);
 
 				if (ext == "png") {
-					m_image->saveAsPNG(filename, m_tonemapOperators[m_tonemapIndex], m_exposure, &m_progress);
+					m_image->saveAsPNG(filename, m_tonemapOperators[m_tonemapIndex].get(), m_exposure, &m_progress);
 				} else if (ext == "jpg") {
-					m_image->saveAsJPEG(filename, m_tonemapOperators[m_tonemapIndex], m_exposure, &m_progress);
+					m_image->saveAsJPEG(filename, m_tonemapOperators[m_tonemapIndex].get(), m_exposure, &m_progress);
 				}
 
 			});
@@ -162,8 +133,8 @@ TonemapperScreen::TonemapperScreen() : nanogui::Screen(Eigen::Vector2i(800, 600)
 
 TonemapperScreen::~TonemapperScreen() {
 	glDeleteTextures(1, &m_texture);
-	for (size_t i = 0; i < m_tonemapOperators.size(); ++i) {
-		delete m_tonemapOperators[i];
+	for (size_t i = 0; i < m_shaders.size(); ++i) {
+		delete m_shaders[i];
 	}
 }
 
@@ -189,7 +160,7 @@ void TonemapperScreen::setImage(const std::string &filename) {
 		return;
 	}
 
-	for (auto tm : m_tonemapOperators) {
+	for (const auto &tm : m_tonemapOperators) {
 		tm->setParameters(m_image);
 	}
 
@@ -228,9 +199,9 @@ void TonemapperScreen::setTonemapMode(int index) {
 	positions.col(2) << 1, 1;
 	positions.col(3) << 0, 1;
 
-	m_tonemapOperators[m_tonemapIndex]->shader->bind();
-	m_tonemapOperators[m_tonemapIndex]->shader->uploadIndices(indices);
-	m_tonemapOperators[m_tonemapIndex]->shader->uploadAttrib("position", positions);
+	m_shaders[m_tonemapIndex]->bind();
+	m_shaders[m_tonemapIndex]->uploadIndices(indices);
+	m_shaders[m_tonemapIndex]->uploadAttrib("position", positions);
 
 	if (m_tonemapLabel) {
 		m_window->removeChild(m_tonemapLabel);
@@ -252,7 +223,7 @@ void TonemapperScreen::setTonemapMode(int index) {
 
 	popopPanel->setLayout(new BoxLayout(Orientation::Vertical, Alignment::Fill, 10, 10));
 	int newIndex = 0;
-	for (auto tm: m_tonemapOperators) {
+	for (const auto &tm : m_tonemapOperators) {
 		auto button = new Button(popopPanel, tm->name);
 		button->setTooltip(tm->description);
 		button->setFlags(Button::RadioButton);
@@ -271,44 +242,46 @@ void TonemapperScreen::setTonemapMode(int index) {
 	m_tonemapWidget = new Widget(m_window);
 	m_tonemapWidget->setLayout(new BoxLayout(Orientation::Vertical, Alignment::Minimum, 0, 8));
 
-	for (auto &parameter : m_tonemapOperators[m_tonemapIndex]->parameters) {
-		auto &p = parameter.second;
+	ParameterBlock &parameters = m_tonemapOperators[m_tonemapIndex]->parameters;
+	for (int i = 0; i < parameters.size(); ++i) {
+		const Parameter &p = parameters.info(i);
+		float &value = parameters[i];
 		if (p.constant) continue;
 
 		auto *windowPanel = new Widget(m_tonemapWidget);
 		windowPanel->setLayout(new BoxLayout(Orientation::Horizontal, Alignment::Middle, 0, 20));
 
-		auto button = new Button(windowPanel, parameter.first);
+		auto button = new Button(windowPanel, p.name);
 		button->setFixedSize(Vector2i(50, 22));
 		button->setFontSize(15);
 		button->setTooltip(p.description);
 
 		auto *slider = new Slider(windowPanel);
-		slider->setValue(inverseLerp(p.value, p.minValue, p.maxValue));
+		slider->setValue(inverseLerp(value, p.minValue, p.maxValue));
 
 		auto textBox = new FloatBox<float>(windowPanel);
 		textBox->setFixedSize(Vector2i(50, 22));
 		textBox->numberFormat("%.2f");
 		textBox->setFontSize(15);
-		textBox->setValue(p.value);
+		textBox->setValue(value);
 		textBox->setAlignment(TextBox::Alignment::Right);
 		textBox->setEditable(true);
 
 		textBox->setCallback([&, slider, textBox](float v) {
-			p.value = v;
-			textBox->setValue(p.value);
+			value = v;
+			textBox->setValue(value);
 			refreshGraph();
 		});
 
 		slider->setCallback([&, textBox](float t) {
-			p.value = lerp(t, p.minValue, p.maxValue);
-			textBox->setValue(p.value);
+			value = lerp(t, p.minValue, p.maxValue);
+			textBox->setValue(value);
 			refreshGraph();
 		});
 
 		button->setCallback([&, slider, textBox] {
-			p.value = p.defaultValue;
-			slider->setValue(inverseLerp(p.value, p.minValue, p.maxValue));
+			value = p.defaultValue;
+			slider->setValue(inverseLerp(value, p.minValue, p.maxValue));
 			textBox->setValue(p.defaultValue);
 			refreshGraph();
 		});
@@ -504,8 +477,16 @@ void TonemapperScreen::drawContents() {
 
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, m_texture);
-		glPixelStorei(GL_UNPACK_ROW_LENGTH, m_image->getWidth());
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, imageSize.x(), imageSize.y(), 0, GL_RGB, GL_FLOAT, (uint8_t *)m_image->getData());
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint) std::abs(m_image->getRowStride()));
+		if (m_image->getRowStride() > 0) {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, imageSize.x(), imageSize.y(), 0, GL_RGB, GL_FLOAT, (uint8_t *)m_image->getData());
+		} else {
+			// Bottom up rows of PFM files used in place are uploaded one by one
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, imageSize.x(), imageSize.y(), 0, GL_RGB, GL_FLOAT, nullptr);
+			for (int i = 0; i < imageSize.y(); ++i) {
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i, imageSize.x(), 1, GL_RGB, GL_FLOAT, &m_image->ref(i, 0));
+			}
+		}
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
 		GLint x = (GLint) mPixelRatio * (mFBSize[0] - m_scaledImageSize[0]) / 2;
@@ -514,16 +495,17 @@ void TonemapperScreen::drawContents() {
 		GLsizei height = (GLsizei) mPixelRatio*m_scaledImageSize[1];
 		glViewport(x, y, width, height);
 
-		m_tonemapOperators[m_tonemapIndex]->shader->bind();
-		m_tonemapOperators[m_tonemapIndex]->shader->setUniform("source", 0);
-		m_tonemapOperators[m_tonemapIndex]->shader->setUniform("exposure", m_exposure);
+		const ShaderUniforms &uniforms = m_uniforms[m_tonemapIndex];
+		const ParameterBlock &parameters = m_tonemapOperators[m_tonemapIndex]->parameters;
+		m_shaders[m_tonemapIndex]->bind();
+		glUniform1i(uniforms.source, 0);
+		glUniform1f(uniforms.exposure, m_exposure);
 
-		for (auto &parameter : m_tonemapOperators[m_tonemapIndex]->parameters) {
-			Parameter &p = parameter.second;
-			m_tonemapOperators[m_tonemapIndex]->shader->setUniform(p.uniform, p.value);
+		for (int i = 0; i < parameters.size(); ++i) {
+			glUniform1f(uniforms.parameters[i], parameters[i]);
 		}
 
-		m_tonemapOperators[m_tonemapIndex]->shader->drawIndexed(GL_TRIANGLES, 0, 2);
+		m_shaders[m_tonemapIndex]->drawIndexed(GL_TRIANGLES, 0, 2);
 
 		x = (GLint) 0;
 		y = (GLint) 0;
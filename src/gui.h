@@ -38,7 +38,15 @@ public:
 private:
 	void setEnabledRecursive(nanogui::Widget *widget, bool enabled);
 
-	std::vector<TonemapOperator *> m_tonemapOperators;
+	std::vector<std::unique_ptr<TonemapOperator>> m_tonemapOperators;
+	std::vector<nanogui::GLShader *> m_shaders;
+
+	struct ShaderUniforms {
+		GLint source;
+		GLint exposure;
+		std::vector<GLint> parameters;
+	};
+	std::vector<ShaderUniforms> m_uniforms;
 	int m_tonemapIndex;
 	int m_exposureIndex;
 
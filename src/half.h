@@ -0,0 +1,69 @@
+/*
+    src/half.h -- Conversion between single and half precision floats
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+
+// Smallest normal half precision value, 2^-14
+const float HalfMinNormal = 6.103515625e-5f;
+
+// IEEE 754 binary16, rounded to nearest even. NaNs stay NaNs, overflows become infinity.
+inline uint16_t floatToHalf(float value) {
+	uint32_t f;
+	memcpy(&f, &value, sizeof(float));
+	const uint32_t sign = f & 0x80000000u;
+	f ^= sign;
+
+	uint16_t h;
+	if (f >= 0x47800000u) {
+		// Too large for half, infinity or NaN
+		h = f > 0x7f800000u ? 0x7e00 : 0x7c00;
+	} else if (f < 0x38800000u) {
+		// Denormal or zero, the addition does the rounding
+		const uint32_t magicBits = 0x3f000000u;
+		float magic, sum = 0.f;
+		memcpy(&magic, &magicBits, sizeof(float));
+		memcpy(&sum, &f, sizeof(float));
+		sum += magic;
+		memcpy(&f, &sum, sizeof(float));
+		h = (uint16_t) (f - magicBits);
+	} else {
+		// Rebias the exponent and round the mantissa
+		const uint32_t odd = (f >> 13) & 1;
+		f += 0xc8000fffu + odd;
+		h = (uint16_t) (f >> 13);
+	}
+	return (uint16_t) (h | (sign >> 16));
+}
+
+inline float halfToFloat(uint16_t h) {
+	const uint32_t exponentMask = 0x7c00u << 13;
+	uint32_t f = (uint32_t) (h & 0x7fff) << 13;
+	const uint32_t exponent = f & exponentMask;
+	f += (127 - 15) << 23;
+	if (exponent == exponentMask) {
+		// Infinity or NaN
+		f += (128 - 16) << 23;
+	} else if (exponent == 0) {
+		// Denormal, renormalized by a subtraction
+		const uint32_t magicBits = 113u << 23;
+		float value, magic;
+		f += 1 << 23;
+		memcpy(&value, &f, sizeof(float));
+		memcpy(&magic, &magicBits, sizeof(float));
+		value -= magic;
+		memcpy(&f, &value, sizeof(float));
+	}
+	f |= (uint32_t) (h & 0x8000) << 16;
+
+	float result;
+	memcpy(&result, &f, sizeof(float));
+	return result;
+}
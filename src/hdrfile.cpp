@@ -0,0 +1,155 @@
+/*
+    src/hdrfile.cpp -- Radiance RGBE files decoded scanline by scanline
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <hdrfile.h>
+
+#include <cstdio>
+
+namespace {
+
+/* Reads one scanline of 'width' pixels from 'src', the RGBE pixels are
+   only written to 'dst' if 'Decode'. Returns the end of the scanline, null
+   if it is corrupt. After freadcolrs() of Radiance's color.c. */
+template <bool Decode>
+const uint8_t *readScanline(const uint8_t *src, const uint8_t *end, int width, uint8_t *dst) {
+	// Run length encoded scanlines start with 2, 2 and the width, followed by runs of the four bytes one after the other
+	if (width >= 8 && width < 0x8000 && end - src >= 4 && src[0] == 2 && src[1] == 2 && (src[2] & 0x80) == 0) {
+		if (((src[2] << 8) | src[3]) != width) return nullptr;
+		src += 4;
+		for (int c = 0; c < 4; ++c) {
+			for (int j = 0; j < width;) {
+				if (src == end) return nullptr;
+				int count = *src++;
+				if (count > 128) {
+					// Repeated byte
+					count -= 128;
+					if (count > width - j || src == end) return nullptr;
+					if (Decode) {
+						for (int k = 0; k < count; ++k) {
+							dst[4 * (j + k) + c] = *src;
+						}
+					}
+					++src;
+				} else {
+					// Literal run
+					if (count == 0 || count > width - j || end - src < count) return nullptr;
+					if (Decode) {
+						for (int k = 0; k < count; ++k) {
+							dst[4 * (j + k) + c] = src[k];
+						}
+					}
+					src += count;
+				}
+				j += count;
+			}
+		}
+		return src;
+	}
+
+	// Flat pixels, 1, 1, 1, n repeats the previous pixel n times (shifted by 8 more bits for every repeat in a row)
+	int shift = 0;
+	for (int j = 0; j < width; src += 4) {
+		if (end - src < 4) return nullptr;
+		if (src[0] == 1 && src[1] == 1 && src[2] == 1) {
+			if (j == 0 || shift > 16) return nullptr;
+			const int count = src[3] << shift;
+			if (count > width - j) return nullptr;
+			if (Decode) {
+				for (int k = 0; k < count; ++k) {
+					memcpy(dst + 4 * (j + k), dst + 4 * (j - 1), 4);
+				}
+			}
+			j += count;
+			shift += 8;
+		} else {
+			if (Decode) {
+				memcpy(dst + 4 * j, src, 4);
+			}
+			++j;
+			shift = 0;
+		}
+	}
+	return src;
+}
+
+}
+
+HdrFile::HdrFile(const std::string &filename) : m_file(filename) {
+	if (!m_file.isValid()) {
+		m_error = "Could not read \"" + filename + "\"";
+		return;
+	}
+	m_file.adviseSequential();
+	m_valid = parseHeader();
+}
+
+bool HdrFile::parseHeader() {
+	const char *data = (const char *) m_file.getData();
+	const size_t size = m_file.getSize();
+	size_t pos = 0;
+	auto readLine = [&](std::string &line) {
+		const char *newline = pos < size ? (const char *) memchr(data + pos, '\n', size - pos) : nullptr;
+		if (!newline) return false;
+		line.assign(data + pos, newline);
+		pos = newline - data + 1;
+		return true;
+	};
+
+	// Lines of variables up to an empty one, then the resolution
+	std::string line;
+	if (!readLine(line) || line.compare(0, 2, "#?") != 0) {
+		m_error = "Not a Radiance HDR file";
+		return false;
+	}
+	while (true) {
+		if (!readLine(line)) {
+			m_error = "Incomplete Radiance HDR header";
+			return false;
+		}
+		if (line.empty()) break;
+		if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+			m_error = "Unsupported format \"" + line.substr(7) + "\"";
+			return false;
+		}
+	}
+
+	char ySign, xSign;
+	int width, height;
+	if (!readLine(line) || sscanf(line.c_str(), "%cY %d %cX %d", &ySign, &height, &xSign, &width) != 4 ||
+		(ySign != '-' && ySign != '+') || xSign != '+' || width <= 0 || height <= 0 ||
+		(int64_t) width * height > std::numeric_limits<int>::max()) {
+		m_error = "Unsupported resolution \"" + line + "\"";
+		return false;
+	}
+	m_width = width;
+	m_height = height;
+	m_bottomUp = ySign == '+';
+
+	// Scanlines have no fixed size, their starts are found by walking the runs
+	const uint8_t *begin = m_file.getData();
+	const uint8_t *src = begin + pos;
+	m_scanlines.resize((size_t) m_height + 1);
+	for (int i = 0; i < m_height; ++i) {
+		m_scanlines[i] = src - begin;
+		src = readScanline<false>(src, begin + size, m_width, nullptr);
+		if (!src) {
+			m_error = "Corrupt or truncated scanline " + std::to_string(i);
+			return false;
+		}
+	}
+	m_scanlines[m_height] = src - begin;
+	return true;
+}
+
+bool HdrFile::decodeRow(int y, uint8_t *dst) const {
+	const int scanline = m_bottomUp ? m_height - 1 - y : y;
+	const uint8_t *begin = m_file.getData() + m_scanlines[scanline];
+	const uint8_t *end = m_file.getData() + m_scanlines[scanline + 1];
+	return readScanline<true>(begin, end, m_width, dst) == end;
+}
@@ -0,0 +1,46 @@
+/*
+    src/hdrfile.h -- Radiance RGBE files decoded scanline by scanline
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+#include <mappedfile.h>
+
+/* Radiance RGBE (.hdr) file read from a MappedFile. The start of every
+   scanline is found while parsing the header, so decodeRow() can be called
+   concurrently afterwards. Flat, run length encoded and old style run
+   length encoded scanlines are supported, with the standard "-Y h +X w"
+   orientation or bottom up ("+Y h +X w"). */
+class HdrFile {
+public:
+	explicit HdrFile(const std::string &filename);
+
+	// The header could be parsed, otherwise getError() tells why
+	bool isValid() const { return m_valid; }
+	const std::string &getError() const { return m_error; }
+
+	int getWidth() const { return m_width; }
+	int getHeight() const { return m_height; }
+
+	// RGBE pixels of row 'y' (from the top) into 'dst', false if the scanline is corrupt
+	bool decodeRow(int y, uint8_t *dst) const;
+
+private:
+	bool parseHeader();
+
+	MappedFile 				m_file;
+	bool 					m_valid = false;
+	std::string 			m_error;
+
+	int 					m_width = 0;
+	int 					m_height = 0;
+	bool 					m_bottomUp = false;
+	// Offsets of the scanlines in the file, followed by the end of the last one
+	std::vector<size_t> 	m_scanlines;
+};
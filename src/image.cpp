@@ -9,109 +9,555 @@
 
 #include <image.h>
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb_image_write.h>
-#define TINYEXR_IMPLEMENTATION
+#include <exrfile.h>
+#include <half.h>
+#include <hdrfile.h>
+#include <kernel.h>
+#include <pfmfile.h>
+#include <threadpool.h>
+
+#include <jpegwriter.h>
+#include <pngwriter.h>
 #include <tinyexr.h>
 
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
 #include <iostream>
+#include <thread>
 
-float convert(void *p, int offset, int type) {
-	switch(type) {
-	case TINYEXR_PIXELTYPE_UINT: {
-		int32_t *pix = (int32_t *)p;
-		return (float)pix[offset];
-	}
-	case TINYEXR_PIXELTYPE_HALF:
-	case TINYEXR_PIXELTYPE_FLOAT: {
-		float *pix = (float *)p;
-		return pix[offset];
+namespace {
+
+// Rows per work item while loading, the statistics are combined in this order
+const int LoadBlockHeight = 16;
+
+// Bands of 8 bit pixels in flight while saving, one is tonemapped while the others wait for the encoder
+const int ExportBufferCount = 3;
+
+/* Converts 'count' samples of type TINYEXR_PIXELTYPE_*, the type is only
+   checked once. Decoded chunks are not necessarily aligned. */
+void convertRow(const void *src, int type, int count, float *dst, HalfToFloatKernel halfToFloatRow) {
+	switch (type) {
+	case TINYEXR_PIXELTYPE_UINT:
+		for (int j = 0; j < count; ++j) {
+			uint32_t value;
+			memcpy(&value, (const uint8_t *) src + j * sizeof(uint32_t), sizeof(uint32_t));
+			dst[j] = (float) value;
+		}
+		break;
+	case TINYEXR_PIXELTYPE_HALF: {
+		// The kernel works on whole packs, the tail is converted separately
+		const int packed = count / MaxPackWidth * MaxPackWidth;
+		halfToFloatRow((const uint16_t *) src, dst, packed);
+		for (int j = packed; j < count; ++j) {
+			uint16_t value;
+			memcpy(&value, (const uint8_t *) src + j * sizeof(uint16_t), sizeof(uint16_t));
+			dst[j] = halfToFloat(value);
+		}
+		break;
 	}
+	case TINYEXR_PIXELTYPE_FLOAT:
+		memcpy(dst, src, count * sizeof(float));
+		break;
 	default:
-		return 0.f;
+		memset(dst, 0, count * sizeof(float));
+	}
+}
+
+/* Part of the data window and box filter factor of a load, rows of the
+   loaded image are numbered from zero */
+struct LoadRegion {
+	int x, y, width, height;
+	int factor;
+
+	int getWidth() const { return (width + factor - 1) / factor; }
+	int getHeight() const { return (height + factor - 1) / factor; }
+	// Data window rows [getRow(i), getRowEnd(i)) make up the boxes of row 'i'
+	int getRow(int i) const { return y + i * factor; }
+	int getRowEnd(int i) const { return std::min(getRow(i) + factor, y + height); }
+};
+
+// Region of 'options' clamped to a 'width' x 'height' data window, false if nothing is left
+bool makeRegion(const ImageOptions &options, int width, int height, LoadRegion &region) {
+	Eigen::Vector2i begin(0, 0), end(width, height);
+	if (options.regionSize.x() > 0 && options.regionSize.y() > 0) {
+		begin = options.regionOffset.cwiseMax(0);
+		end = (options.regionOffset + options.regionSize).cwiseMin(Eigen::Vector2i(width, height));
+	}
+	if (end.x() <= begin.x() || end.y() <= begin.y()) {
+		cerr << "Error: Region is outside of the " << width << "x" << height << " data window" << endl;
+		return false;
+	}
+	region.x = begin.x();
+	region.y = begin.y();
+	region.width = end.x() - begin.x();
+	region.height = end.y() - begin.y();
+	region.factor = std::max(1, options.subsample);
+	return true;
+}
+
+/* Samples of the row of 'region' whose boxes cover the data window rows
+   [yBegin, yEnd), 'sourceRow(c, y)' returns channel 'c' of row 'y'. With
+   factor one the samples are passed through, otherwise the box averages
+   end up in 'filtered' as floats. */
+template <typename SourceRow>
+void regionRow(const LoadRegion &region, int yBegin, int yEnd, const SourceRow &sourceRow, const int types[3],
+			   HalfToFloatKernel halfToFloatRow, std::vector<float> &filtered, const void *rows[3], int rowTypes[3]) {
+	if (region.factor == 1) {
+		for (int c = 0; c < 3; ++c) {
+			rows[c] = (const uint8_t *) sourceRow(c, yBegin) + (size_t) region.x * ExrFile::getPixelTypeSize(types[c]);
+			rowTypes[c] = types[c];
+		}
+		return;
+	}
+
+	// Three filtered rows, followed by one converted source row
+	const int width = region.getWidth();
+	filtered.resize(3 * (size_t) width + region.width);
+	float *converted = &filtered[3 * (size_t) width];
+	for (int c = 0; c < 3; ++c) {
+		float *dst = &filtered[c * (size_t) width];
+		std::fill(dst, dst + width, 0.f);
+		for (int y = yBegin; y < yEnd; ++y) {
+			const uint8_t *src = (const uint8_t *) sourceRow(c, y) + (size_t) region.x * ExrFile::getPixelTypeSize(types[c]);
+			convertRow(src, types[c], region.width, converted, halfToFloatRow);
+			for (int j = 0; j < width; ++j) {
+				const int end = std::min((j + 1) * region.factor, region.width);
+				float sum = 0.f;
+				for (int k = j * region.factor; k < end; ++k) {
+					sum += converted[k];
+				}
+				dst[j] += sum;
+			}
+		}
+		for (int j = 0; j < width; ++j) {
+			const int columns = std::min(region.factor, region.width - j * region.factor);
+			dst[j] /= (float) (columns * (yEnd - yBegin));
+		}
+		rows[c] = dst;
+		rowTypes[c] = TINYEXR_PIXELTYPE_FLOAT;
+	}
+}
+
+/* Compensated (Kahan) summation, the error stays in the order of one
+   rounding no matter how many values are added. A float accumulator alone
+   stops growing once the sum is 2^24 times larger than the values. */
+struct KahanSum {
+	float sum;
+	float compensation;
+
+	KahanSum() : sum(0.f), compensation(0.f) {}
+
+	void add(float value) {
+		float y = value - compensation;
+		float t = sum + y;
+		compensation = (t - sum) - y;
+		sum = t;
+	}
+
+	void add(const KahanSum &other) {
+		add(other.sum);
+		add(-other.compensation);
+	}
+
+	float value() const { return sum - compensation; }
+};
+
+// Partial statistics of a block of rows
+struct ImageStatistics {
+	KahanSum intensity[3];
+	KahanSum luminance;
+	KahanSum logLuminance;
+	float minimumLuminance;
+	float maximumLuminance;
+	float maximumValue;
+
+	ImageStatistics()
+		: minimumLuminance(std::numeric_limits<float>::max()), maximumLuminance(std::numeric_limits<float>::min()),
+		  maximumValue(0.f) {}
+
+	void add(const ImageStatistics &other) {
+		for (int c = 0; c < 3; ++c) {
+			intensity[c].add(other.intensity[c]);
+		}
+		luminance.add(other.luminance);
+		logLuminance.add(other.logLuminance);
+		minimumLuminance = std::min(minimumLuminance, other.minimumLuminance);
+		maximumLuminance = std::max(maximumLuminance, other.maximumLuminance);
+		maximumValue = std::max(maximumValue, other.maximumValue);
 	}
+};
+
 }
 
-const Color3f &Image::ref(int i, int j) const {
-	return m_pixels[m_size.x() * i + j];
+Image::Image(const std::string &filename, const ImageOptions &options)
+	: m_storage(options.storage), m_rows(nullptr), m_rowStride(0), m_stride(0), m_size(0, 0) {
+	bool loaded = false;
+	switch (detectFormat(filename)) {
+		case EOpenEXR: loaded = loadExr(filename, options); break;
+		case ERadianceHDR: loaded = loadHdr(filename, options); break;
+		case EPortableFloatMap: loaded = loadPfm(filename, options); break;
+		default: cerr << "Error: Could not read \"" << filename << "\" as OpenEXR, Radiance HDR or PFM file" << endl;
+	}
+	if (!loaded) {
+		m_size = Eigen::Vector2i(0, 0);
+	}
+}
+
+Image::~Image() {}
+
+ImageFormat Image::detectFormat(const std::string &filename) {
+	uint8_t magic[4] = { 0, 0, 0, 0 };
+	FILE *file = fopen(filename.c_str(), "rb");
+	if (!file) {
+		return EUnknownFormat;
+	}
+	const size_t count = fread(magic, 1, sizeof(magic), file);
+	fclose(file);
+	if (count < sizeof(magic)) {
+		return EUnknownFormat;
+	}
+	if (magic[0] == 0x76 && magic[1] == 0x2f && magic[2] == 0x31 && magic[3] == 0x01) {
+		return EOpenEXR;
+	}
+	if (magic[0] == '#' && magic[1] == '?') {
+		return ERadianceHDR;
+	}
+	if (magic[0] == 'P' && (magic[1] == 'F' || magic[1] == 'f') && isspace(magic[2])) {
+		return EPortableFloatMap;
+	}
+	return EUnknownFormat;
 }
 
-Color3f &Image::ref(int i, int j) {
-	return m_pixels[m_size.x() * i + j];
+bool Image::loadExr(const std::string &filename, const ImageOptions &options) {
+	ExrFile file(filename);
+	if (!file.isValid()) {
+		cerr << "Error: Could not open EXR file: " << file.getError() << endl;
+		return false;
+	}
+
+	int channels[3];
+	if (!file.selectLayer(options.layer, channels)) {
+		cerr << "Error: " << file.getError() << endl;
+		return false;
+	}
+
+	return file.isSupported() ? loadChunks(file, channels, options) : loadTinyEXR(filename, file, channels, options);
 }
 
-Image::Image(const std::string &filename) {
+bool Image::loadChunks(const ExrFile &file, const int channels[3], const ImageOptions &options) {
+	int types[3];
+	for (int c = 0; c < 3; ++c) {
+		types[c] = file.getChannels()[channels[c]].pixelType;
+	}
+
+	LoadRegion region;
+	if (!makeRegion(options, file.getWidth(), file.getHeight(), region)) {
+		return false;
+	}
+
+	/* Blocks cover whole chunks, so no chunk is decoded twice unless the
+	   region starts within one, and whole blocks of statistics (the least
+	   common multiple of both) */
+	const int lines = file.getLinesPerChunk();
+	const int rowsPerChunk = std::max(1, lines / region.factor);
+	int blockHeight = rowsPerChunk;
+	while (blockHeight % LoadBlockHeight != 0) {
+		blockHeight += rowsPerChunk;
+	}
+
+	// Every row is read from the chunk with the first row of its boxes, only tiles within the region are decoded
+	const HalfToFloatKernel halfToFloatRow = halfToFloatKernel(getSimdLevel());
+	return load(region.getWidth(), region.getHeight(), blockHeight, options,
+				[&](int rowBegin, int rowEnd, std::vector<uint8_t> &buffer, const RowCallback &row) {
+		std::vector<float> filtered;
+		const uint8_t *data = nullptr;
+		int decoded = -1;
+		for (int i = rowBegin; i < rowEnd; ++i) {
+			const int y = region.getRow(i);
+			const int chunk = y / lines;
+			if (chunk != decoded) {
+				data = file.decodeChunk(chunk, buffer, region.x, region.x + region.width);
+				if (!data) {
+					cerr << "Error: Could not decode chunk " << chunk << " of EXR file" << endl;
+					return false;
+				}
+				decoded = chunk;
+			}
+			const int first = chunk * lines;
+			const void *rows[3];
+			int rowTypes[3];
+			regionRow(region, y, std::min(region.getRowEnd(i), first + lines), [&](int c, int line) {
+				return file.getChannelRow(data, line - first, channels[c]);
+			}, types, halfToFloatRow, filtered, rows, rowTypes);
+			row(i, rows, rowTypes);
+		}
+		return true;
+	});
+}
+
+bool Image::loadTinyEXR(const std::string &filename, const ExrFile &file, const int layerChannels[3], const ImageOptions &options) {
 	EXRImage img;
 	InitEXRImage(&img);
 
 	const char *err = nullptr;
 	if (ParseMultiChannelEXRHeaderFromFile(&img, filename.c_str(), &err) != 0) {
 		std::cerr << "Error: Could not parse EXR file: " << err << std::endl;
-		return;
+		return false;
 	}
 
-	for (int i = 0; i < img.num_channels; ++i) {
-        if (img.requested_pixel_types[i] == TINYEXR_PIXELTYPE_HALF)
-            img.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
-    }
-
-    if (LoadMultiChannelEXRFromFile(&img, filename.c_str(), &err) != 0) {
-        std::cerr << "Error: Could not open EXR file: " << err << std::endl;
-        return;
-    }
-
-	m_size = Eigen::Vector2i(img.width, img.height);
-
-	m_pixels = std::unique_ptr<Color3f[]>(new Color3f[m_size.x() * m_size.y()]);
+	// Channels keep their type, half samples are widened by the load pass
+	if (LoadMultiChannelEXRFromFile(&img, filename.c_str(), &err) != 0) {
+		std::cerr << "Error: Could not open EXR file: " << err << std::endl;
+		return false;
+	}
 
-	int idxR = -1, idxG = -1, idxB = -1;
-	for (int c = 0; c < img.num_channels; ++c) {
-		if (strcmp(img.channel_names[c], "R") == 0) {
-			idxR = c;
+	// Channels of the layer, found by name
+	int channels[3], types[3];
+	for (int c = 0; c < 3; ++c) {
+		channels[c] = -1;
+		for (int i = 0; i < img.num_channels; ++i) {
+			if (file.getChannels()[layerChannels[c]].name == img.channel_names[i]) {
+				channels[c] = i;
+			}
 		}
-		if (strcmp(img.channel_names[c], "G") == 0) {
-			idxG = c;
+		if (channels[c] < 0) {
+			cerr << "Error: EXR file has no R, G and B channels" << endl;
+			FreeEXRImage(&img);
+			return false;
 		}
-		if (strcmp(img.channel_names[c], "B") == 0) {
-			idxB = c;
+		types[c] = img.pixel_types[channels[c]];
+	}
+
+	LoadRegion region;
+	if (!makeRegion(options, img.width, img.height, region)) {
+		FreeEXRImage(&img);
+		return false;
+	}
+
+	// The whole file is decoded already, boxes still end with the chunk of their first row as in loadChunks()
+	const HalfToFloatKernel halfToFloatRow = halfToFloatKernel(getSimdLevel());
+	const int lines = file.getLinesPerChunk();
+	bool loaded = load(region.getWidth(), region.getHeight(), LoadBlockHeight, options,
+					   [&](int rowBegin, int rowEnd, std::vector<uint8_t> &, const RowCallback &row) {
+		std::vector<float> filtered;
+		for (int i = rowBegin; i < rowEnd; ++i) {
+			const int first = region.getRow(i) / lines * lines;
+			const void *rows[3];
+			int rowTypes[3];
+			regionRow(region, region.getRow(i), std::min(region.getRowEnd(i), first + lines), [&](int c, int y) {
+				return img.images[channels[c]] + (size_t) img.width * y * ExrFile::getPixelTypeSize(types[c]);
+			}, types, halfToFloatRow, filtered, rows, rowTypes);
+			row(i, rows, rowTypes);
 		}
+		return true;
+	});
+
+	FreeEXRImage(&img);
+	return loaded;
+}
+
+bool Image::loadHdr(const std::string &filename, const ImageOptions &options) {
+	HdrFile file(filename);
+	if (!file.isValid()) {
+		cerr << "Error: Could not open HDR file: " << file.getError() << endl;
+		return false;
+	}
+	if (!options.layer.empty()) {
+		cerr << "Error: Radiance HDR files have no layers" << endl;
+		return false;
 	}
 
-	float rgb[3];
-	for (int i = 0; i < m_size.y(); ++i) {
-		for (int j = 0; j < m_size.x(); ++j) {
-			int index = m_size.x() * i + j;
+	LoadRegion region;
+	if (!makeRegion(options, file.getWidth(), file.getHeight(), region)) {
+		return false;
+	}
 
-			if (img.num_channels == 1) {
-				rgb[0] = convert(img.images[0], index, img.pixel_types[0]);
-				ref(i, j) = Color3f(rgb[0]);
-			}
-			else {
-				rgb[0] = convert(img.images[idxR], index, img.pixel_types[idxR]);
-				rgb[1] = convert(img.images[idxG], index, img.pixel_types[idxG]);
-				rgb[2] = convert(img.images[idxB], index, img.pixel_types[idxB]);
-				ref(i, j) = Color3f(rgb[0], rgb[1], rgb[2]);
+	// Every scanline is a chunk of its own, previews only decode the first row of their boxes
+	const RgbeToFloatKernel rgbeToFloatRow = rgbeToFloatKernel(getSimdLevel());
+	const HalfToFloatKernel halfToFloatRow = halfToFloatKernel(getSimdLevel());
+	const int types[3] = { TINYEXR_PIXELTYPE_FLOAT, TINYEXR_PIXELTYPE_FLOAT, TINYEXR_PIXELTYPE_FLOAT };
+	const int width = (file.getWidth() + MaxPackWidth - 1) / MaxPackWidth * MaxPackWidth;
+	return load(region.getWidth(), region.getHeight(), LoadBlockHeight, options,
+				[&](int rowBegin, int rowEnd, std::vector<uint8_t> &buffer, const RowCallback &row) {
+		buffer.resize(4 * (size_t) width);
+		std::vector<float> rgb(3 * (size_t) width), filtered;
+		float *const dst[3] = { &rgb[0], &rgb[width], &rgb[2 * (size_t) width] };
+		for (int i = rowBegin; i < rowEnd; ++i) {
+			const int y = region.getRow(i);
+			if (!file.decodeRow(y, buffer.data())) {
+				cerr << "Error: Could not decode scanline " << y << " of HDR file" << endl;
+				return false;
 			}
+			rgbeToFloatRow(buffer.data(), dst, width);
+			const void *rows[3];
+			int rowTypes[3];
+			regionRow(region, y, y + 1, [&](int c, int) { return dst[c]; }, types, halfToFloatRow, filtered, rows, rowTypes);
+			row(i, rows, rowTypes);
 		}
+		return true;
+	});
+}
+
+bool Image::loadPfm(const std::string &filename, const ImageOptions &options) {
+	std::unique_ptr<PfmFile> file(new PfmFile(filename));
+	if (!file->isValid()) {
+		cerr << "Error: Could not open PFM file: " << file->getError() << endl;
+		return false;
+	}
+	if (!options.layer.empty()) {
+		cerr << "Error: PFM files have no layers" << endl;
+		return false;
 	}
 
-	float delta = 1e-4f;
-	m_averageLuminance = 0.f;
-	m_logAverageLuminance = 0.f;
-	m_minimumLuminance = std::numeric_limits<float>::max();
-	m_maximumLuminance = std::numeric_limits<float>::min();
-	m_averageIntensity = Color3f(0.f);
+	LoadRegion region;
+	if (!makeRegion(options, file->getWidth(), file->getHeight(), region)) {
+		return false;
+	}
+
+	// The rows of the file (or of a region of it) become a view with a negative stride
+	const PfmFile *pfm = file.get();
+	if (m_storage == EInterleaved && region.factor == 1 && pfm->isInPlace()) {
+		m_rows = (Color3f *) pfm->getRow(region.y) + region.x;
+		m_rowStride = -(ptrdiff_t) pfm->getWidth();
+		m_pfm = std::move(file);
+	}
 
-	for (int i = 0; i < m_size.y(); ++i) {
-		for (int j = 0; j < m_size.x(); ++j) {
-			m_averageIntensity += ref(i, j);
-			float lum = ref(i, j).getLuminance();
-			m_averageLuminance += lum;
-			m_logAverageLuminance += std::log(delta + lum);
-			if (lum > m_maximumLuminance) m_maximumLuminance = lum;
-			if (lum < m_minimumLuminance) m_minimumLuminance = lum;
+	// The whole file is mapped, so boxes always cover all of their rows
+	const HalfToFloatKernel halfToFloatRow = halfToFloatKernel(getSimdLevel());
+	const int types[3] = { TINYEXR_PIXELTYPE_FLOAT, TINYEXR_PIXELTYPE_FLOAT, TINYEXR_PIXELTYPE_FLOAT };
+	return load(region.getWidth(), region.getHeight(), LoadBlockHeight, options,
+				[&](int rowBegin, int rowEnd, std::vector<uint8_t> &, const RowCallback &row) {
+		std::vector<float> rgb(3 * (size_t) pfm->getWidth()), filtered;
+		for (int i = rowBegin; i < rowEnd; ++i) {
+			const void *rows[3];
+			int rowTypes[3];
+			regionRow(region, region.getRow(i), region.getRowEnd(i), [&](int c, int y) {
+				float *dst = &rgb[c * (size_t) pfm->getWidth()];
+				pfm->readChannel(y, c, dst);
+				return dst;
+			}, types, halfToFloatRow, filtered, rows, rowTypes);
+			row(i, rows, rowTypes);
 		}
+		return true;
+	});
+}
+
+bool Image::load(int width, int height, int blockHeight, const ImageOptions &options, const BlockReader &readBlock) {
+	m_size = Eigen::Vector2i(width, height);
+
+	// Rows of all planes are padded to whole cache lines
+	const int floatsPerAlignment = PlaneAlignment / (int) sizeof(float);
+	m_stride = (m_size.x() + floatsPerAlignment - 1) / floatsPerAlignment * floatsPerAlignment;
+	const size_t planeSize = (size_t) m_stride * m_size.y();
+
+	// Pixels used in place are already there
+	const bool inPlace = m_rows != nullptr;
+	bool allocated = true;
+	if (m_storage == EInterleaved && !inPlace) {
+		m_pixels = std::unique_ptr<Color3f[]>(new Color3f[m_size.x() * m_size.y()]);
+		m_rows = m_pixels.get();
+		m_rowStride = m_size.x();
+	} else if (m_storage == EPlanar) {
+		m_planes = std::unique_ptr<float[], AlignedDeleter>((float *) alignedMalloc(3 * planeSize * sizeof(float), PlaneAlignment));
+		allocated &= m_planes != nullptr;
+	} else if (m_storage == EPlanarHalf) {
+		m_halfPlanes = std::unique_ptr<uint16_t[], AlignedDeleter>((uint16_t *) alignedMalloc(3 * planeSize * sizeof(uint16_t), PlaneAlignment));
+		allocated &= m_halfPlanes != nullptr;
 	}
+	if (options.luminance == ELuminanceFloat) {
+		m_luminance = std::unique_ptr<float[], AlignedDeleter>((float *) alignedMalloc(planeSize * sizeof(float), PlaneAlignment));
+		allocated &= m_luminance != nullptr;
+	} else {
+		m_luminanceHalf = std::unique_ptr<uint16_t[], AlignedDeleter>((uint16_t *) alignedMalloc(planeSize * sizeof(uint16_t), PlaneAlignment));
+		allocated &= m_luminanceHalf != nullptr;
+	}
+	if (!allocated) {
+		cerr << "Error: Could not allocate memory for a " << m_size.x() << "x" << m_size.y() << " image" << endl;
+		return false;
+	}
+
+	/* Conversion, luminance and statistics in a single pass over blocks of
+	   rows. Every LoadBlockHeight rows have their own partial statistics,
+	   they are combined in order afterwards, so the result depends neither
+	   on the number of threads nor on the chunk size of the file. Planar rows are converted in place, everything else goes
+	   through a zero padded buffer. */
+	const float delta = 1e-4f;
+	const LuminanceKernel luminanceRow = luminanceKernel(getSimdLevel());
+	const HalfToFloatKernel halfToFloatRow = halfToFloatKernel(getSimdLevel());
+	const FloatToHalfKernel floatToHalfRow = floatToHalfKernel(getSimdLevel());
+	const int blocks = (m_size.y() + blockHeight - 1) / blockHeight;
+	std::vector<ImageStatistics> partial((m_size.y() + LoadBlockHeight - 1) / LoadBlockHeight);
+	std::atomic<bool> failed(false);
+
+	ThreadPool::global().parallelFor(blocks, [&](int block) {
+		std::vector<float> buffer(4 * (size_t) m_stride, 0.f);
+		std::vector<uint8_t> decodeBuffer;
+		const int rowBegin = block * blockHeight;
+		const int rowEnd = std::min(m_size.y(), rowBegin + blockHeight);
+		bool ok = readBlock(rowBegin, rowEnd, decodeBuffer, [&](int i, const void *const src[3], const int types[3]) {
+			ImageStatistics &stats = partial[i / LoadBlockHeight];
+			float *rows[3] = { &buffer[0], &buffer[m_stride], &buffer[2 * m_stride] };
+			float *lum = m_luminance ? m_luminance.get() + (size_t) i * m_stride : &buffer[3 * m_stride];
+			if (m_storage == EPlanar) {
+				for (int c = 0; c < 3; ++c) {
+					rows[c] = getPlaneRow(c, i);
+					memset(rows[c] + m_size.x(), 0, (m_stride - m_size.x()) * sizeof(float));
+				}
+			}
+
+			for (int c = 0; c < 3; ++c) {
+				const int type = types[c];
+				convertRow(src[c], type, m_size.x(), rows[c], halfToFloatRow);
+
+				// Other channel types are rounded, the statistics see the stored values
+				if (m_storage == EPlanarHalf) {
+					uint16_t *half = getHalfPlaneRow(c, i);
+					floatToHalfRow(rows[c], half, m_stride);
+					if (type != TINYEXR_PIXELTYPE_HALF) {
+						halfToFloatRow(half, rows[c], m_stride);
+					}
+				}
+			}
+
+			luminanceRow(rows, lum, m_stride);
+			if (m_luminanceHalf) {
+				floatToHalfRow(lum, m_luminanceHalf.get() + (size_t) i * m_stride, m_stride);
+			}
+
+			for (int j = 0; j < m_size.x(); ++j) {
+				const Color3f pixel(rows[0][j], rows[1][j], rows[2][j]);
+				if (m_storage == EInterleaved && !inPlace) {
+					ref(i, j) = pixel;
+				}
+
+				for (int c = 0; c < 3; ++c) {
+					stats.intensity[c].add(pixel[c]);
+				}
+				stats.luminance.add(lum[j]);
+				stats.logLuminance.add(std::log(delta + lum[j]));
+				if (lum[j] > stats.maximumLuminance) stats.maximumLuminance = lum[j];
+				if (lum[j] < stats.minimumLuminance) stats.minimumLuminance = lum[j];
+				stats.maximumValue = std::max(stats.maximumValue, pixel.maxCoeff());
+			}
+		});
+		if (!ok) failed = true;
+	});
+	if (failed) {
+		return false;
+	}
+
+	ImageStatistics stats;
+	for (const ImageStatistics &block : partial) {
+		stats.add(block);
+	}
+	m_averageIntensity = Color3f(stats.intensity[0].value(), stats.intensity[1].value(), stats.intensity[2].value());
+	m_averageLuminance = stats.luminance.value();
+	m_logAverageLuminance = stats.logLuminance.value();
+	m_minimumLuminance = stats.minimumLuminance;
+	m_maximumLuminance = stats.maximumLuminance;
+	m_maximumValue = stats.maximumValue;
 
 	m_averageIntensity = m_averageIntensity / (m_size.x() * m_size.y());
 	m_averageLuminance = m_averageLuminance / (m_size.x() * m_size.y());
@@ -119,38 +565,186 @@ Image::Image(const std::string &filename) {
 
 	// Formula taken from "Perceptual Effects in Real-time Tone Mapping" by Krawczyk et al.
 	m_autoKeyValue = 1.03f - 2.f / (2.f + std::log10(m_logAverageLuminance + 1.f));
+	return true;
+}
 
-	FreeEXRImage(&img);
+Color3f Image::getPixel(int i, int j) const {
+	switch (m_storage) {
+		case EPlanar: return Color3f(getPlaneRow(0, i)[j], getPlaneRow(1, i)[j], getPlaneRow(2, i)[j]);
+		case EPlanarHalf: return Color3f(halfToFloat(getHalfPlaneRow(0, i)[j]), halfToFloat(getHalfPlaneRow(1, i)[j]),
+										 halfToFloat(getHalfPlaneRow(2, i)[j]));
+		default: return ref(i, j);
+	}
 }
 
-void Image::saveAsPNG(const std::string &filename, TonemapOperator *tonemap, float exposure, float *progress) const {
-	uint8_t *rgb8 = new uint8_t[3 * m_size.x() * m_size.y()];
-	uint8_t *dst = rgb8;
+float Image::getLuminance(int i, int j) const {
+	if (m_luminance) return getLuminanceRow(i)[j];
+	return halfToFloat(getLuminanceRowHalf(i)[j]);
+}
 
-	tonemap->process(this, dst, exposure, progress);
+bool Image::saveAsPFM(const std::string &filename, float exposure) const {
+	FILE *file = fopen(filename.c_str(), "wb");
+	if (!file) {
+		cerr << "Error: Could not save PFM file" << endl;
+		return false;
+	}
 
-	int ret = stbi_write_png(filename.c_str(), m_size.x(), m_size.y(), 3, rgb8, 3 * m_size.x());
-	if (ret == 0) {
-		cerr << "Error: Could not save PNG file" << endl;
+	/* Rows go bottom up, in the byte order of this machine. The scale is
+	   padded with zeros so the samples are aligned for loading in place. */
+	const uint16_t one = 1;
+	uint8_t first;
+	memcpy(&first, &one, 1);
+	std::string header = "PF\n" + std::to_string(m_size.x()) + " " + std::to_string(m_size.y()) + "\n" + (first == 1 ? "-1." : "1.");
+	while ((header.size() + 1) % sizeof(float) != 0) {
+		header += '0';
 	}
+	header += '\n';
+	fputs(header.c_str(), file);
 
-	*progress = -1.f;
+	bool ok = true;
+	std::vector<float> buffer(3 * (size_t) m_size.x());
+	for (int i = m_size.y() - 1; i >= 0 && ok; --i) {
+		const float *row = buffer.data();
+		if (m_storage == EInterleaved && exposure == 1.f) {
+			row = (const float *) &ref(i, 0);
+		} else {
+			for (int j = 0; j < m_size.x(); ++j) {
+				const Color3f pixel = getPixel(i, j) * exposure;
+				for (int c = 0; c < 3; ++c) {
+					buffer[3 * j + c] = pixel[c];
+				}
+			}
+		}
+		ok = fwrite(row, sizeof(float), 3 * (size_t) m_size.x(), file) == 3 * (size_t) m_size.x();
+	}
+	ok &= fclose(file) == 0;
+	if (!ok) {
+		cerr << "Error: Could not save PFM file" << endl;
+	}
+	return ok;
+}
 
-	delete[] rgb8;
+bool Image::save(ImageWriter &writer, const TonemapOperator *tonemap, float exposure, float *progress,
+				 const TonemapOptions &options) const {
+	return save(std::vector<ImageWriter *>(1, &writer), tonemap, exposure, progress, options);
 }
 
-void Image::saveAsJPEG(const std::string &filename, TonemapOperator *tonemap, float exposure, float *progress) const {
-	uint8_t *rgb8 = new uint8_t[3 * m_size.x() * m_size.y()];
-	uint8_t *dst = rgb8;
+int Image::getBandHeight(const std::vector<ImageWriter *> &writers) {
+	int alignment = 1;
+	for (ImageWriter *writer : writers) {
+		// Least common multiple of the alignments
+		int a = alignment, b = writer->getRowAlignment();
+		while (b != 0) {
+			const int r = a % b;
+			a = b;
+			b = r;
+		}
+		alignment = alignment / a * writer->getRowAlignment();
+	}
+	// Enough rows per band to keep all threads busy, in whole stripes of the encoders
+	const int bandHeight = 2 * TonemapOperator::BandHeight * ThreadPool::global().getThreadCount();
+	return (bandHeight + alignment - 1) / alignment * alignment;
+}
 
-	tonemap->process(this, dst, exposure, progress);
+bool Image::save(const std::vector<ImageWriter *> &writers, const TonemapOperator *tonemap, float exposure, float *progress,
+				 const TonemapOptions &options) const {
+	bool valid = !writers.empty();
+	for (ImageWriter *writer : writers) {
+		valid &= writer->isValid();
+	}
+	if (!valid) {
+		for (ImageWriter *writer : writers) {
+			writer->finish();
+		}
+		if (progress) *progress = -1.f;
+		return false;
+	}
 
-	int ret = stbi_write_jpg(filename.c_str(), m_size.x(), m_size.y(), 3, rgb8, 80);
-	if (ret == 0) {
-		cerr << "Error: Could not save JPEG file" << endl;
+	const int bandHeight = getBandHeight(writers);
+	const int bands = (m_size.y() + bandHeight - 1) / bandHeight;
+	const size_t count = writers.size();
+	std::vector<std::unique_ptr<uint8_t[]>> buffers(ExportBufferCount * count);
+	std::vector<OutputBuffer> outputs;
+	for (size_t i = 0; i < buffers.size(); ++i) {
+		const OutputFormat format = writers[i % count]->getFormat();
+		buffers[i].reset(new uint8_t[3 * (size_t) m_size.x() * bandHeight * getOutputSampleSize(format)]);
+		outputs.push_back(OutputBuffer(format, buffers[i].get()));
 	}
 
-	*progress = -1.f;
+	/* Band i uses the buffers (i % ExportBufferCount) * count + k of writer k,
+	   all of them are tonemapped here in one pass and encoded by the writer
+	   thread */
+	std::mutex mutex;
+	std::condition_variable condition;
+	int tonemapped = 0, encoded = 0;
+	bool failed = false;
+	if (progress) *progress = 0.f;
 
-	delete[] rgb8;
+	std::thread encoder([&]() {
+		for (int band = 0; band < bands; ++band) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&]() { return tonemapped > band || failed; });
+				if (failed) return;
+			}
+			const int rows = std::min(bandHeight, m_size.y() - band * bandHeight);
+			bool ok = true;
+			for (size_t k = 0; k < count && ok; ++k) {
+				ok = writers[k]->writeRows(buffers[(band % ExportBufferCount) * count + k].get(), rows);
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				encoded = band + 1;
+				failed |= !ok;
+			}
+			condition.notify_all();
+			if (!ok) return;
+			if (progress) *progress = (float) (band + 1) / bands;
+		}
+	});
+
+	TonemapOptions bandOptions = options;
+	for (int band = 0; band < bands; ++band) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&]() { return band - encoded < ExportBufferCount || failed; });
+			if (failed) break;
+		}
+		bandOptions.rowBegin = band * bandHeight;
+		bandOptions.rowEnd = std::min(bandOptions.rowBegin + bandHeight, m_size.y());
+		tonemap->process(this, &outputs[(band % ExportBufferCount) * count], (int) count, exposure, nullptr, bandOptions);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tonemapped = band + 1;
+		}
+		condition.notify_all();
+	}
+	encoder.join();
+
+	bool ok = !failed;
+	for (ImageWriter *writer : writers) {
+		ok &= writer->finish();
+	}
+	if (progress) *progress = -1.f;
+	return ok;
+}
+
+bool Image::saveAsPNG(const std::string &filename, TonemapOperator *tonemap, float exposure, float *progress,
+						const TonemapOptions &options, const PngOptions &pngOptions) const {
+	PngWriter writer(filename, m_size.x(), m_size.y(), pngOptions);
+	if (!save(writer, tonemap, exposure, progress, options)) {
+		cerr << "Error: Could not save PNG file" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool Image::saveAsJPEG(const std::string &filename, TonemapOperator *tonemap, float exposure, float *progress,
+						const TonemapOptions &options, const JpegOptions &jpegOptions) const {
+	JpegWriter writer(filename, m_size.x(), m_size.y(), jpegOptions);
+	if (!save(writer, tonemap, exposure, progress, options)) {
+		cerr << "Error: Could not save JPEG file" << endl;
+		return false;
+	}
+	return true;
 }
\ No newline at end of file
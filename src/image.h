@@ -12,21 +12,119 @@
 #include <global.h>
 
 #include <color.h>
+#include <jpegwriter.h>
+#include <pngwriter.h>
 #include <tonemap.h>
 
+#include <functional>
+
+class ExrFile;
+class HdrFile;
+class ImageWriter;
+class PfmFile;
+
+// File formats that can be loaded, told apart by their first bytes
+enum ImageFormat {
+    EUnknownFormat = 0,
+    EOpenEXR,
+    ERadianceHDR,
+    EPortableFloatMap
+};
+
+// Memory layout of the pixels
+enum PixelStorage {
+    EInterleaved = 0,   // RGB triplets, as uploaded to OpenGL by the GUI
+    EPlanar,            // Separate red, green and blue planes, read by the CPU kernels without copies
+    EPlanarHalf         // Same with 16 bit half floats, converted by the kernels on the fly
+};
+
+// Precision of the cached luminance plane
+enum LuminanceStorage {
+    ELuminanceFloat = 0,    // Read directly by the kernels of the luminance operators
+    ELuminanceHalf          // Half the memory, the kernels widen it row by row
+};
+
+struct ImageOptions {
+    PixelStorage storage;
+    LuminanceStorage luminance;
+    /* Part of the data window to load, from 'regionOffset' with
+       'regionSize' pixels. A zero size loads everything. */
+    Eigen::Vector2i regionOffset;
+    Eigen::Vector2i regionSize;
+    /* Loads a preview reduced by this factor. Pixels are box filtered over
+       their columns and over the rows of the first chunk of the file they
+       meet, chunks with no first row of a box are not decoded at all. The
+       same rows are used for EXR files of any compression, HDR files only
+       filter horizontally (every scanline is a chunk), PFM files use the
+       whole box. */
+    int subsample;
+    /* Layer of the red, green and blue channels ("diffuse" for
+       "diffuse.R", ...), see ExrFile::selectLayer(). Only its channels are
+       decoded and stored. */
+    std::string layer;
+
+    ImageOptions() : storage(EInterleaved), luminance(ELuminanceFloat), regionOffset(0, 0), regionSize(0, 0), subsample(1) {}
+};
+
 class Image {
 public:
-    explicit Image(const std::string &filename);
-    ~Image() {}
+    // Rows of the planes start at multiples of 'PlaneAlignment' bytes and are padded with zeros
+    static const int PlaneAlignment = 64;
+
+    explicit Image(const std::string &filename, const ImageOptions &options = ImageOptions());
+    ~Image();
 
-    float *getData() { return (float *)m_pixels.get(); }
+    static ImageFormat detectFormat(const std::string &filename);
 
-    const Color3f &ref(int i, int j) const;
-    Color3f &ref(int i, int j);
+    PixelStorage getStorage() const { return m_storage; }
+    bool isPlanar() const { return m_storage == EPlanar; }
+    bool isPlanarHalf() const { return m_storage == EPlanarHalf; }
+
+    /* Interleaved RGB data from the top row on, only available with
+       EInterleaved. Rows are getRowStride() pixels apart, which is negative
+       for PFM files used in place (bottom up). */
+    float *getData() { return (float *)m_rows; }
+    inline ptrdiff_t getRowStride() const { return m_rowStride; }
+
+    inline const Color3f &ref(int i, int j) const { return m_rows[m_rowStride * i + j]; }
+    inline Color3f &ref(int i, int j) { return m_rows[m_rowStride * i + j]; }
+
+    /* Row 'i' of plane 'channel' (0: red, 1: green, 2: blue), only available
+       with EPlanar. Rows hold getStride() floats, a multiple of 16. */
+    inline const float *getPlaneRow(int channel, int i) const {
+        return m_planes.get() + ((size_t) channel * m_size.y() + i) * m_stride;
+    }
+    inline float *getPlaneRow(int channel, int i) {
+        return m_planes.get() + ((size_t) channel * m_size.y() + i) * m_stride;
+    }
+    // Same for EPlanarHalf
+    inline const uint16_t *getHalfPlaneRow(int channel, int i) const {
+        return m_halfPlanes.get() + ((size_t) channel * m_size.y() + i) * m_stride;
+    }
+    inline uint16_t *getHalfPlaneRow(int channel, int i) {
+        return m_halfPlanes.get() + ((size_t) channel * m_size.y() + i) * m_stride;
+    }
+    inline int getStride() const { return m_stride; }
+
+    /* Luminance of row 'i', computed once at load time and shared by the
+       statistics and the operators. Padded like the planes, null with
+       ELuminanceHalf. */
+    inline const float *getLuminanceRow(int i) const {
+        return m_luminance ? m_luminance.get() + (size_t) i * m_stride : nullptr;
+    }
+    // Same in half precision, null with ELuminanceFloat
+    inline const uint16_t *getLuminanceRowHalf(int i) const {
+        return m_luminanceHalf ? m_luminanceHalf.get() + (size_t) i * m_stride : nullptr;
+    }
+    float getLuminance(int i, int j) const;
+
+    // Pixel in any storage
+    Color3f getPixel(int i, int j) const;
 
     inline Color3f getAverageIntensity() const { return m_averageIntensity; }
     inline float getMinimumLuminance() const { return m_minimumLuminance; }
     inline float getMaximumLuminance() const { return m_maximumLuminance; }
+    inline float getMaximumValue() const { return m_maximumValue; }
     inline float getAverageLuminance() const { return m_averageLuminance; }
     inline float getLogAverageLuminance() const { return m_logAverageLuminance; }
 	inline float getAutoKeyValue() const { return m_autoKeyValue; }
@@ -35,16 +133,60 @@ public:
     inline int getWidth() const { return m_size.x(); }
     inline int getHeight() const { return m_size.y(); }
 
-    void saveAsPNG(const std::string &filename, TonemapOperator *tonemap, float exposure = 1.f, float *progress = nullptr) const;
-    void saveAsJPEG(const std::string &filename, TonemapOperator *tonemap, float exposure = 1.f, float *progress = nullptr) const;
+    /* Tonemaps the image band by band and encodes the bands with 'writer'
+       on a thread of its own, so compression overlaps with tonemapping and
+       only a few bands of 8 bit pixels exist at a time */
+    bool save(ImageWriter &writer, const TonemapOperator *tonemap, float exposure = 1.f, float *progress = nullptr,
+              const TonemapOptions &options = TonemapOptions()) const;
+    // Same for several files at once, every band is tonemapped once into the formats of all writers
+    bool save(const std::vector<ImageWriter *> &writers, const TonemapOperator *tonemap, float exposure = 1.f,
+              float *progress = nullptr, const TonemapOptions &options = TonemapOptions()) const;
+    // Rows per band of save() with 'writers', a multiple of all their row alignments
+    static int getBandHeight(const std::vector<ImageWriter *> &writers);
+    bool saveAsPNG(const std::string &filename, TonemapOperator *tonemap, float exposure = 1.f, float *progress = nullptr,
+                   const TonemapOptions &options = TonemapOptions(), const PngOptions &pngOptions = PngOptions()) const;
+    bool saveAsJPEG(const std::string &filename, TonemapOperator *tonemap, float exposure = 1.f, float *progress = nullptr,
+                    const TonemapOptions &options = TonemapOptions(), const JpegOptions &jpegOptions = JpegOptions()) const;
+    // Linear pixels times 'exposure' as little endian portable float map, interleaved rows are written as they are
+    bool saveAsPFM(const std::string &filename, float exposure = 1.f) const;
 private:
+    /* Source of the rows: calls row(i, samples, types) for all rows i in
+       [rowBegin, rowEnd) in order, with the red, green and blue samples of
+       the row and their TINYEXR_PIXELTYPE_*. 'buffer' belongs to the
+       calling thread. */
+    typedef std::function<void(int, const void *const *, const int *)> RowCallback;
+    typedef std::function<bool(int rowBegin, int rowEnd, std::vector<uint8_t> &buffer, const RowCallback &row)> BlockReader;
+
+    bool loadExr(const std::string &filename, const ImageOptions &options);
+    // Supported files, 'channels' of the red, green and blue samples decoded chunk by chunk straight into the final storage
+    bool loadChunks(const ExrFile &file, const int channels[3], const ImageOptions &options);
+    // Everything else, all channels decoded completely by tinyexr first
+    bool loadTinyEXR(const std::string &filename, const ExrFile &file, const int channels[3], const ImageOptions &options);
+    // Radiance files, scanlines are decoded in parallel and converted with the RGBE kernel
+    bool loadHdr(const std::string &filename, const ImageOptions &options);
+    // Portable float maps, used in place by EInterleaved images when the layout allows it
+    bool loadPfm(const std::string &filename, const ImageOptions &options);
+    // Allocation, conversion and statistics in parallel blocks of 'blockHeight' rows, a multiple of 16
+    bool load(int width, int height, int blockHeight, const ImageOptions &options, const BlockReader &readBlock);
+
+    PixelStorage m_storage;
     std::unique_ptr<Color3f[]> m_pixels;
+    // Owns the pixels of PFM files used in place
+    std::unique_ptr<PfmFile> m_pfm;
+    Color3f *m_rows;
+    ptrdiff_t m_rowStride;
+    std::unique_ptr<float[], AlignedDeleter> m_planes;
+    std::unique_ptr<uint16_t[], AlignedDeleter> m_halfPlanes;
+    std::unique_ptr<float[], AlignedDeleter> m_luminance;
+    std::unique_ptr<uint16_t[], AlignedDeleter> m_luminanceHalf;
+    int m_stride;
 
     Eigen::Vector2i m_size;
 
     Color3f m_averageIntensity;
     float m_minimumLuminance;
     float m_maximumLuminance;
+    float m_maximumValue;
     float m_averageLuminance;
     float m_logAverageLuminance;
 	float m_autoKeyValue;
@@ -0,0 +1,78 @@
+/*
+    src/imagewriter.cpp -- Encoders that write images band by band
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <imagewriter.h>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+ImageWriter::ImageWriter(const std::string &filename, int width, int height)
+	: m_width(width), m_height(height), m_buffer(new uint8_t[BufferSize]) {
+	if (filename == "-") {
+#if defined(_WIN32)
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		m_file = stdout;
+	} else {
+		m_file = fopen(filename.c_str(), "wb");
+	}
+}
+
+ImageWriter::~ImageWriter() {
+	if (m_file && m_file != stdout) {
+		fclose(m_file);
+	}
+}
+
+bool ImageWriter::write(const void *data, size_t size) {
+	if (m_used + size > BufferSize) {
+		flush();
+		if (size > BufferSize) {
+			m_failed |= fwrite(data, 1, size, m_file) != size;
+			m_position += size;
+			return !m_failed;
+		}
+	}
+	memcpy(m_buffer.get() + m_used, data, size);
+	m_used += size;
+	return !m_failed;
+}
+
+void ImageWriter::flush() {
+	m_failed |= fwrite(m_buffer.get(), 1, m_used, m_file) != m_used;
+	m_position += m_used;
+	m_used = 0;
+}
+
+bool ImageWriter::writeAt(uint64_t offset, const void *data, size_t size) {
+	flush();
+#if defined(_WIN32)
+	m_failed |= _fseeki64(m_file, (__int64) offset, SEEK_SET) != 0;
+	m_failed |= fwrite(data, 1, size, m_file) != size;
+	m_failed |= _fseeki64(m_file, 0, SEEK_END) != 0;
+#else
+	m_failed |= fseeko(m_file, (off_t) offset, SEEK_SET) != 0;
+	m_failed |= fwrite(data, 1, size, m_file) != size;
+	m_failed |= fseeko(m_file, 0, SEEK_END) != 0;
+#endif
+	return !m_failed;
+}
+
+bool ImageWriter::finish() {
+	if (!m_file) {
+		return false;
+	}
+	flush();
+	// Standard output stays open for whatever follows
+	m_failed |= (m_file == stdout ? fflush(m_file) : fclose(m_file)) != 0;
+	m_file = nullptr;
+	return !m_failed;
+}
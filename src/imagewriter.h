@@ -0,0 +1,75 @@
+/*
+    src/imagewriter.h -- Encoders that write images band by band
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+#include <encode.h>
+
+#include <cstdio>
+
+/* Encoder that receives the RGB rows of an image from the top, a few at a
+   time, and writes them to a file as they arrive. Only the rows of the
+   current call and what the format needs to carry over are kept. */
+class ImageWriter {
+public:
+	// "-" writes to standard output
+	ImageWriter(const std::string &filename, int width, int height);
+	virtual ~ImageWriter();
+
+	ImageWriter(const ImageWriter &) = delete;
+	ImageWriter &operator=(const ImageWriter &) = delete;
+
+	// The file could be created
+	bool isValid() const { return m_file != nullptr; }
+
+	int getWidth() const { return m_width; }
+	int getHeight() const { return m_height; }
+
+	// The rows of every writeRows() call but the last have to be a multiple of this
+	virtual int getRowAlignment() const { return 1; }
+
+	// Sample type of the rows it receives
+	virtual OutputFormat getFormat() const { return EOutputUInt8; }
+
+	// Appends 'count' rows of getFormat() samples (tightly packed), false if writing failed
+	virtual bool writeRows(const uint8_t *rgb, int count) = 0;
+
+	// Writes the end of the file after the last row and closes it (standard output is only flushed)
+	virtual bool finish();
+
+protected:
+	// Output is buffered, false (from now on) if writing to the file failed
+	bool write(const void *data, size_t size);
+	bool hasFailed() const { return m_failed; }
+	// The file, for writers that bypass the buffer
+	FILE *getFile() const { return m_file; }
+	// Bytes written so far
+	uint64_t getPosition() const { return m_position + m_used; }
+	// Replaces bytes that have been written before, e.g. a table in front of the data
+	bool writeAt(uint64_t offset, const void *data, size_t size);
+	inline void put(uint8_t byte) {
+		if (m_used == BufferSize) flush();
+		m_buffer[m_used++] = byte;
+	}
+
+	int 					m_width;
+	int 					m_height;
+
+private:
+	void flush();
+
+	static const size_t BufferSize = 1 << 16;
+
+	FILE 					*m_file;
+	bool 					m_failed = false;
+	std::unique_ptr<uint8_t[]> m_buffer;
+	size_t 					m_used = 0;
+	uint64_t 				m_position = 0;
+};
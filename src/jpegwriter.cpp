@@ -0,0 +1,356 @@
+/*
+    src/jpegwriter.cpp -- Baseline JPEG files written band by band
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <jpegwriter.h>
+
+#include <kernel.h>
+#include <threadpool.h>
+
+namespace {
+
+const uint8_t ZigZag[64] = {
+	0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42, 3, 8, 12, 17, 25, 30, 41, 43, 9, 11, 18, 24, 31, 40, 44, 53,
+	10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60, 21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63
+};
+
+// Quantization tables of Annex K of the standard, in row order
+const int LuminanceQuantization[64] = {
+	16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55, 14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92, 49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+};
+const int ChrominanceQuantization[64] = {
+	17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99
+};
+
+// Huffman tables of Annex K, the number of codes of every length from 1 to 16 followed by the symbols
+const uint8_t LuminanceDcCounts[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const uint8_t LuminanceDcSymbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const uint8_t ChrominanceDcCounts[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const uint8_t ChrominanceDcSymbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const uint8_t LuminanceAcCounts[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+const uint8_t LuminanceAcSymbols[162] = {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+	0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+	0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+	0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa
+};
+const uint8_t ChrominanceAcCounts[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const uint8_t ChrominanceAcSymbols[162] = {
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+	0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+	0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+	0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+	0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+	0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa
+};
+
+// Canonical codes of a table given as above, indexed by symbol
+struct HuffmanTable {
+	JpegWriter::Code codes[256];
+
+	HuffmanTable(const uint8_t counts[16], const uint8_t *symbols) {
+		memset(codes, 0, sizeof(codes));
+		int code = 0;
+		for (int length = 1; length <= 16; ++length) {
+			for (int i = 0; i < counts[length - 1]; ++i) {
+				codes[*symbols][0] = (uint16_t) code++;
+				codes[*symbols][1] = (uint16_t) length;
+				++symbols;
+			}
+			code <<= 1;
+		}
+	}
+};
+
+const HuffmanTable LuminanceDc(LuminanceDcCounts, LuminanceDcSymbols);
+const HuffmanTable LuminanceAc(LuminanceAcCounts, LuminanceAcSymbols);
+const HuffmanTable ChrominanceDc(ChrominanceDcCounts, ChrominanceDcSymbols);
+const HuffmanTable ChrominanceAc(ChrominanceAcCounts, ChrominanceAcSymbols);
+
+// Magnitude category and the bits of a coefficient
+inline void magnitude(int value, JpegWriter::Code &bits) {
+	int absolute = value < 0 ? -value : value;
+	value = value < 0 ? value - 1 : value;
+	bits[1] = 1;
+	while (absolute >>= 1) {
+		++bits[1];
+	}
+	bits[0] = (uint16_t) (value & ((1 << bits[1]) - 1));
+}
+
+// Entropy coding of the quantized coefficients of a block (row by row), 'dc' is the one of the previous block
+void encodeBlock(const int *quantized, int &dc, const JpegWriter::Code *dcCodes, const JpegWriter::Code *acCodes,
+				 JpegWriter::Stream &stream) {
+	int coefficients[64];
+	for (int i = 0; i < 64; ++i) {
+		coefficients[ZigZag[i]] = quantized[i];
+	}
+
+	// DC as the difference to the previous block
+	const int diff = coefficients[0] - dc;
+	dc = coefficients[0];
+	if (diff == 0) {
+		stream.writeBits(dcCodes[0]);
+	} else {
+		JpegWriter::Code bits;
+		magnitude(diff, bits);
+		stream.writeBits(dcCodes[bits[1]]);
+		stream.writeBits(bits);
+	}
+
+	// AC as runs of zeros followed by a coefficient, up to the last non-zero one
+	int last = 63;
+	while (last > 0 && coefficients[last] == 0) {
+		--last;
+	}
+	for (int i = 1; i <= last; ++i) {
+		int zeros = 0;
+		while (coefficients[i] == 0) {
+			++zeros;
+			++i;
+		}
+		for (; zeros >= 16; zeros -= 16) {
+			stream.writeBits(acCodes[0xF0]);
+		}
+		JpegWriter::Code bits;
+		magnitude(coefficients[i], bits);
+		stream.writeBits(acCodes[(zeros << 4) + bits[1]]);
+		stream.writeBits(bits);
+	}
+	if (last != 63) {
+		stream.writeBits(acCodes[0x00]);
+	}
+}
+
+}
+
+const char *getJpegSubsamplingName(JpegSubsampling subsampling) {
+	switch (subsampling) {
+		case EJpegSubsampling444: return "444";
+		case EJpegSubsampling422: return "422";
+		case EJpegSubsampling420: return "420";
+		default: return "unknown";
+	}
+}
+
+bool parseJpegSubsampling(const std::string &name, JpegSubsampling &subsampling) {
+	for (int s = EJpegSubsampling444; s <= EJpegSubsampling420; ++s) {
+		if (name == getJpegSubsamplingName((JpegSubsampling) s)) {
+			subsampling = (JpegSubsampling) s;
+			return true;
+		}
+	}
+	return false;
+}
+
+JpegWriter::JpegWriter(const std::string &filename, int width, int height, const JpegOptions &options)
+	: ImageWriter(filename, width, height), m_options(options) {
+	m_mcuWidth = options.subsampling == EJpegSubsampling444 ? 8 : 16;
+	m_mcuHeight = options.subsampling == EJpegSubsampling420 ? 16 : 8;
+	// The restart interval is stored in 16 bits
+	const int mcus = (width + m_mcuWidth - 1) / m_mcuWidth;
+	if (m_options.restartRows > 0) {
+		m_options.restartRows = std::max(1, std::min(m_options.restartRows, 0xFFFF / std::max(mcus, 1)));
+	}
+
+	int quality = std::min(std::max(options.quality, 1), 100);
+	quality = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+	uint8_t tableY[64], tableUV[64];
+	for (int i = 0; i < 64; ++i) {
+		tableY[ZigZag[i]] = (uint8_t) std::min(std::max((LuminanceQuantization[i] * quality + 50) / 100, 1), 255);
+		tableUV[ZigZag[i]] = (uint8_t) std::min(std::max((ChrominanceQuantization[i] * quality + 50) / 100, 1), 255);
+	}
+
+	// The DCT leaves its outputs scaled by these factors (times the square root of 8)
+	static const float aanScale[8] = {
+		1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
+		1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f
+	};
+	for (int row = 0, k = 0; row < 8; ++row) {
+		for (int col = 0; col < 8; ++col, ++k) {
+			m_scaleY[k] = 1 / (tableY[ZigZag[k]] * aanScale[row] * aanScale[col]);
+			m_scaleUV[k] = 1 / (tableUV[ZigZag[k]] * aanScale[row] * aanScale[col]);
+		}
+	}
+
+	/* JFIF marker, quantization tables, frame header (three components,
+	   luma sampled as often as the subsampling says), Huffman tables,
+	   restart interval and scan header */
+	const uint8_t sampling = options.subsampling == EJpegSubsampling420 ? 0x22 : options.subsampling == EJpegSubsampling422 ? 0x21 : 0x11;
+	const uint8_t jfif[] = { 0xFF, 0xD8, 0xFF, 0xE0, 0, 0x10, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0,
+							 0xFF, 0xDB, 0, 0x84, 0 };
+	const uint8_t frame[] = { 0xFF, 0xC0, 0, 0x11, 8, (uint8_t) (height >> 8), (uint8_t) height, (uint8_t) (width >> 8), (uint8_t) width,
+							  3, 1, sampling, 0, 2, 0x11, 1, 3, 0x11, 1, 0xFF, 0xC4, 0x01, 0xA2, 0 };
+	const int interval = mcus * m_options.restartRows;
+	const uint8_t restart[] = { 0xFF, 0xDD, 0, 4, (uint8_t) (interval >> 8), (uint8_t) interval };
+	const uint8_t scan[] = { 0xFF, 0xDA, 0, 0xC, 3, 1, 0, 2, 0x11, 3, 0x11, 0, 0x3F, 0 };
+	write(jfif, sizeof(jfif));
+	write(tableY, sizeof(tableY));
+	put(1);
+	write(tableUV, sizeof(tableUV));
+	write(frame, sizeof(frame));
+	write(LuminanceDcCounts, sizeof(LuminanceDcCounts));
+	write(LuminanceDcSymbols, sizeof(LuminanceDcSymbols));
+	put(0x10);
+	write(LuminanceAcCounts, sizeof(LuminanceAcCounts));
+	write(LuminanceAcSymbols, sizeof(LuminanceAcSymbols));
+	put(1);
+	write(ChrominanceDcCounts, sizeof(ChrominanceDcCounts));
+	write(ChrominanceDcSymbols, sizeof(ChrominanceDcSymbols));
+	put(0x11);
+	write(ChrominanceAcCounts, sizeof(ChrominanceAcCounts));
+	write(ChrominanceAcSymbols, sizeof(ChrominanceAcSymbols));
+	if (m_options.restartRows > 0) {
+		write(restart, sizeof(restart));
+	}
+	write(scan, sizeof(scan));
+}
+
+int JpegWriter::getRowAlignment() const {
+	return m_options.restartRows > 0 ? m_mcuHeight * m_options.restartRows : m_mcuHeight;
+}
+
+bool JpegWriter::writeRows(const uint8_t *rgb, int count) {
+	if (!isValid()) {
+		return false;
+	}
+	const int rows = (count + m_mcuHeight - 1) / m_mcuHeight;
+	if (m_options.restartRows <= 0) {
+		encodeRows(rgb, count, 0, rows, m_stream);
+		if (!m_stream.data.empty()) {
+			write(m_stream.data.data(), m_stream.data.size());
+			m_stream.data.clear();
+		}
+		return !hasFailed();
+	}
+
+	// Every call holds whole restart intervals (but the last), they are independent of each other
+	const int intervals = (rows + m_options.restartRows - 1) / m_options.restartRows;
+	std::vector<Stream> streams(intervals);
+	ThreadPool::global().parallelFor(intervals, [&](int i) {
+		encodeRows(rgb, count, i * m_options.restartRows, std::min(rows, (i + 1) * m_options.restartRows), streams[i]);
+		streams[i].flushBits();
+	});
+	for (const Stream &stream : streams) {
+		if (m_interval > 0) {
+			put(0xFF);
+			put((uint8_t) (0xD0 + (m_interval - 1) % 8));
+		}
+		write(stream.data.data(), stream.data.size());
+		++m_interval;
+	}
+	return !hasFailed();
+}
+
+void JpegWriter::encodeRows(const uint8_t *rgb, int count, int begin, int end, Stream &stream) const {
+	const YCbCrKernel yCbCrRow = yCbCrKernel(getSimdLevel());
+	const DctKernel dct = dctKernel(getSimdLevel());
+	const int mcus = (m_width + m_mcuWidth - 1) / m_mcuWidth;
+	const int paddedWidth = (mcus * m_mcuWidth + MaxPackWidth - 1) / MaxPackWidth * MaxPackWidth;
+	const size_t rowSize = 3 * (size_t) m_width;
+	const bool halfWidth = m_mcuWidth == 16, halfHeight = m_mcuHeight == 16;
+
+	// Y, Cb and Cr of a row of MCUs, the chroma planes are downsampled in place
+	std::vector<uint8_t> line(3 * paddedWidth);
+	std::vector<float> planes(3 * (size_t) m_mcuHeight * paddedWidth);
+	float *const y = planes.data();
+	float *const cb = y + m_mcuHeight * paddedWidth;
+	float *const cr = cb + m_mcuHeight * paddedWidth;
+	int quantized[64];
+
+	for (int mcuRow = begin; mcuRow < end; ++mcuRow) {
+		// Pixels past the right or the bottom edge repeat the last column or row
+		for (int i = 0; i < m_mcuHeight; ++i) {
+			const uint8_t *src = rgb + std::min(mcuRow * m_mcuHeight + i, count - 1) * rowSize;
+			memcpy(line.data(), src, rowSize);
+			for (int j = m_width; j < paddedWidth; ++j) {
+				memcpy(&line[3 * j], src + rowSize - 3, 3);
+			}
+			float *const dst[3] = { y + i * paddedWidth, cb + i * paddedWidth, cr + i * paddedWidth };
+			yCbCrRow(line.data(), dst, paddedWidth);
+		}
+
+		if (halfWidth) {
+			const int chromaWidth = paddedWidth / 2, chromaHeight = halfHeight ? 8 : m_mcuHeight;
+			for (float *plane : { cb, cr }) {
+				for (int i = 0; i < chromaHeight; ++i) {
+					float *dst = plane + i * paddedWidth;
+					if (halfHeight) {
+						const float *top = plane + 2 * i * paddedWidth, *bottom = top + paddedWidth;
+						for (int j = 0; j < chromaWidth; ++j) {
+							dst[j] = (top[2 * j] + top[2 * j + 1] + bottom[2 * j] + bottom[2 * j + 1]) * 0.25f;
+						}
+					} else {
+						for (int j = 0; j < chromaWidth; ++j) {
+							dst[j] = (dst[2 * j] + dst[2 * j + 1]) * 0.5f;
+						}
+					}
+				}
+			}
+		}
+
+		// Luma blocks of the MCU from left to right and top to bottom, then one block of Cb and Cr
+		for (int mcu = 0; mcu < mcus; ++mcu) {
+			for (int by = 0; by < m_mcuHeight; by += 8) {
+				for (int bx = 0; bx < m_mcuWidth; bx += 8) {
+					dct(y + by * paddedWidth + mcu * m_mcuWidth + bx, paddedWidth, m_scaleY, quantized);
+					encodeBlock(quantized, stream.dc[0], LuminanceDc.codes, LuminanceAc.codes, stream);
+				}
+			}
+			dct(cb + 8 * mcu, paddedWidth, m_scaleUV, quantized);
+			encodeBlock(quantized, stream.dc[1], ChrominanceDc.codes, ChrominanceAc.codes, stream);
+			dct(cr + 8 * mcu, paddedWidth, m_scaleUV, quantized);
+			encodeBlock(quantized, stream.dc[2], ChrominanceDc.codes, ChrominanceAc.codes, stream);
+		}
+	}
+}
+
+void JpegWriter::Stream::writeBits(const Code &code) {
+	bitCount += code[1];
+	bitBuffer |= code[0] << (24 - bitCount);
+	while (bitCount >= 8) {
+		const uint8_t byte = (uint8_t) (bitBuffer >> 16);
+		data.push_back(byte);
+		// Stuffed zero, so the data contains no markers
+		if (byte == 0xFF) {
+			data.push_back(0);
+		}
+		bitBuffer <<= 8;
+		bitCount -= 8;
+	}
+}
+
+void JpegWriter::Stream::flushBits() {
+	static const Code fill = { 0x7F, 7 };
+	writeBits(fill);
+	bitBuffer = 0;
+	bitCount = 0;
+}
+
+bool JpegWriter::finish() {
+	if (!isValid()) {
+		return false;
+	}
+	// The last byte without restart markers, then the end of image marker
+	if (m_options.restartRows <= 0) {
+		m_stream.flushBits();
+		if (!m_stream.data.empty()) {
+			write(m_stream.data.data(), m_stream.data.size());
+		}
+	}
+	put(0xFF);
+	put(0xD9);
+	return ImageWriter::finish();
+}
@@ -0,0 +1,78 @@
+/*
+    src/jpegwriter.h -- Baseline JPEG files written band by band
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <imagewriter.h>
+
+// Resolution of the chroma components relative to the luma
+enum JpegSubsampling {
+	EJpegSubsampling444 = 0,	// Full resolution
+	EJpegSubsampling422,		// Half horizontal resolution
+	EJpegSubsampling420			// Half horizontal and vertical resolution
+};
+
+const char *getJpegSubsamplingName(JpegSubsampling subsampling);
+bool parseJpegSubsampling(const std::string &name, JpegSubsampling &subsampling);
+
+struct JpegOptions {
+	// From 1 to 100, scales the standard quantization tables
+	int quality;
+	JpegSubsampling subsampling;
+	/* Rows of MCUs between restart markers, the intervals are encoded in
+	   parallel. 0 writes no markers and encodes on a single thread. */
+	int restartRows;
+
+	JpegOptions() : quality(80), subsampling(EJpegSubsampling444), restartRows(1) {}
+};
+
+/* Baseline JPEG with YCbCr and the standard Huffman tables. The color
+   conversion and the DCT use the SIMD kernels of kernel.h, which give the
+   same coefficients on all instruction sets. Every call encodes whole rows
+   of MCUs (8 rows, 16 with 4:2:0). With restart markers, the restart
+   intervals of a call are encoded on ThreadPool::global() into buffers of
+   their own, the entropy coders start over at every marker. Without
+   markers and subsampling the file is the same as the one of
+   stb_image_write's encoder (Jon Olick's jo_jpeg). */
+class JpegWriter : public ImageWriter {
+public:
+	JpegWriter(const std::string &filename, int width, int height, const JpegOptions &options = JpegOptions());
+
+	// Whole rows of MCUs, or whole restart intervals
+	int getRowAlignment() const override;
+	bool writeRows(const uint8_t *rgb, int count) override;
+	bool finish() override;
+
+	// Huffman code of a symbol, bits and length
+	typedef uint16_t Code[2];
+
+	// Entropy coded data of a restart interval, or of the whole image without markers
+	struct Stream {
+		std::vector<uint8_t> data;
+		int dc[3] = { 0, 0, 0 };
+		int bitBuffer = 0;
+		int bitCount = 0;
+
+		void writeBits(const Code &code);
+		// Pads the last byte with ones
+		void flushBits();
+	};
+
+private:
+	// Encodes the rows of MCUs [begin, end) of the 'count' rows in 'rgb' into 'stream'
+	void encodeRows(const uint8_t *rgb, int count, int begin, int end, Stream &stream) const;
+
+	JpegOptions 			m_options;
+	int 					m_mcuWidth;
+	int 					m_mcuHeight;
+	float 					m_scaleY[64];
+	float 					m_scaleUV[64];
+	Stream 					m_stream;
+	int 					m_interval = 0;
+};
@@ -0,0 +1,715 @@
+/*
+    src/kernel.h -- Two-phase CPU implementation shared by all operators
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+
+#include <color.h>
+#include <colortable.h>
+#include <encode.h>
+#include <half.h>
+#include <image.h>
+#include <luminancetable.h>
+#include <simd.h>
+#include <tonemap.h>
+
+#include <mutex>
+#include <type_traits>
+
+/* Maps 'count' pixels stored as separate red, green and blue arrays from
+   'src' to 'dst', which may be the same. src[3] is the luminance of the
+   input for kernels with LuminanceInput (see TonemapKernelOperator) and
+   unused otherwise. 'constants' points to the Constants of the operator.
+   The SIMD versions process whole packs, the arrays have to be padded
+   accordingly. */
+typedef void (*RowKernel)(const void *constants, const float *const src[4], float *const dst[3], int count);
+
+// Largest number of pixels processed at once by any of the row kernels
+static const int MaxPackWidth = 16;
+
+/* Looks up the codes of 'count' values in an EncodeTable, shared by all
+   operators. 'count' has to be a multiple of MaxPackWidth. */
+typedef void (*EncodeKernel)(const EncodeTable &table, const float *values, uint8_t *codes, int count);
+
+/* Computes the luminance of 'count' pixels, used for the luminance plane of
+   Image. 'count' has to be a multiple of MaxPackWidth. */
+typedef void (*LuminanceKernel)(const float *const src[3], float *dst, int count);
+
+// Building blocks of the operator kernels, T is either float or a SIMD pack
+template <typename T>
+inline T luminance(const T &r, const T &g, const T &b) {
+	return r * 0.212671f + g * 0.715160f + b * 0.072169f;
+}
+
+// Scales the color by Ld / Lw
+template <typename T>
+inline void scaleColor(T &r, T &g, T &b, const T &Ld, const T &Lw) {
+	r = Ld * r / Lw;
+	g = Ld * g / Lw;
+	b = Ld * b / Lw;
+}
+
+// Calls the map() of 'Derived', with the luminance 'L' of the input if it takes one
+template <typename Derived, typename T>
+inline void mapPixel(const typename Derived::Constants &k, T &r, T &g, T &b, const T &L, std::true_type) {
+	Derived::map(k, r, g, b, L);
+}
+
+template <typename Derived, typename T>
+inline void mapPixel(const typename Derived::Constants &k, T &r, T &g, T &b, const T &, std::false_type) {
+	Derived::map(k, r, g, b);
+}
+
+// Same for a single color without a luminance plane
+template <typename Derived, typename T>
+inline void mapPixel(const typename Derived::Constants &k, T &r, T &g, T &b) {
+	mapPixel<Derived>(k, r, g, b, luminance(r, g, b), std::integral_constant<bool, Derived::LuminanceInput>());
+}
+
+template <typename Derived, typename Pack>
+void mapRowPacked(const void *constants, const float *const src[4], float *const dst[3], int count) {
+	const typename Derived::Constants &k = *static_cast<const typename Derived::Constants *>(constants);
+	const std::integral_constant<bool, Derived::LuminanceInput> luminanceInput;
+	for (int j = 0; j < count; j += Pack::Width) {
+		Pack R = Pack::load(src[0] + j);
+		Pack G = Pack::load(src[1] + j);
+		Pack B = Pack::load(src[2] + j);
+		Pack L = luminanceInput ? Pack::load(src[3] + j) : Pack(0.f);
+		mapPixel<Derived>(k, R, G, B, L, luminanceInput);
+		R.store(dst[0] + j);
+		G.store(dst[1] + j);
+		B.store(dst[2] + j);
+	}
+}
+
+template <typename Derived>
+void mapRowScalar(const void *constants, const float *const src[4], float *const dst[3], int count) {
+	const typename Derived::Constants &k = *static_cast<const typename Derived::Constants *>(constants);
+	const std::integral_constant<bool, Derived::LuminanceInput> luminanceInput;
+	for (int j = 0; j < count; ++j) {
+		float r = src[0][j], g = src[1][j], b = src[2][j];
+		float L = luminanceInput ? src[3][j] : 0.f;
+		mapPixel<Derived>(k, r, g, b, L, luminanceInput);
+		dst[0][j] = r;
+		dst[1][j] = g;
+		dst[2][j] = b;
+	}
+}
+
+/* Instantiated for every operator and MathMode in kernel_sse42.cpp,
+   kernel_avx2.cpp and kernel_avx512.cpp, which are compiled for the
+   respective instruction set. */
+template <typename Derived, int Mode> void mapRowSSE42(const void *constants, const float *const src[4], float *const dst[3], int count);
+template <typename Derived, int Mode> void mapRowAVX2(const void *constants, const float *const src[4], float *const dst[3], int count);
+template <typename Derived, int Mode> void mapRowAVX512(const void *constants, const float *const src[4], float *const dst[3], int count);
+
+void encodeRowSSE42(const EncodeTable &table, const float *values, uint8_t *codes, int count);
+void encodeRowAVX2(const EncodeTable &table, const float *values, uint8_t *codes, int count);
+void encodeRowAVX512(const EncodeTable &table, const float *values, uint8_t *codes, int count);
+
+inline void encodeRowScalar(const EncodeTable &table, const float *values, uint8_t *codes, int count) {
+	for (int j = 0; j < count; ++j) {
+		codes[j] = table(values[j]);
+	}
+}
+
+inline EncodeKernel encodeKernel(SimdLevel level) {
+	switch (level) {
+#if defined(TONEMAPPER_SIMD_X86)
+		case ESimdAVX512: return &encodeRowAVX512;
+		case ESimdAVX2: return &encodeRowAVX2;
+		case ESimdSSE42: return &encodeRowSSE42;
+#endif
+		default: return &encodeRowScalar;
+	}
+}
+
+/* Clamps 'count' values to [0, 1] (NaNs to 0) and applies the display
+   encoding, the values that are stored in all outputs but the 8 bit codes.
+   'count' has to be a multiple of MaxPackWidth. */
+typedef void (*CurveKernel)(const EncodeCurve &curve, const float *src, float *dst, int count);
+
+// Same as EncodeCurve::operator(), with the treatment of NaNs of the EncodeTable
+template <typename T>
+inline T displayValue(const EncodeCurve &curve, T x) {
+	x = vselect(T(0.f) < x, vmin(x, T(1.f)), T(0.f));
+	switch (curve.type) {
+		case EncodeCurve::EGamma: return vpow(x, T(curve.exponent));
+		case EncodeCurve::ESegmentedGamma: return vselect(x <= T(curve.start), x * curve.slope, vpow(x * 1.099f, T(curve.exponent)) - 0.099f);
+		default: return x;
+	}
+}
+
+template <typename Pack>
+void curveRowPacked(const EncodeCurve &curve, const float *src, float *dst, int count) {
+	for (int j = 0; j < count; j += Pack::Width) {
+		displayValue(curve, Pack::load(src + j)).store(dst + j);
+	}
+}
+
+template <int Mode> void curveRowSSE42(const EncodeCurve &curve, const float *src, float *dst, int count);
+template <int Mode> void curveRowAVX2(const EncodeCurve &curve, const float *src, float *dst, int count);
+template <int Mode> void curveRowAVX512(const EncodeCurve &curve, const float *src, float *dst, int count);
+
+inline void curveRowScalar(const EncodeCurve &curve, const float *src, float *dst, int count) {
+	for (int j = 0; j < count; ++j) {
+		dst[j] = displayValue(curve, src[j]);
+	}
+}
+
+template <int Mode>
+CurveKernel curveKernel(SimdLevel level) {
+	switch (level) {
+#if defined(TONEMAPPER_SIMD_X86)
+		case ESimdAVX512: return &curveRowAVX512<Mode>;
+		case ESimdAVX2: return &curveRowAVX2<Mode>;
+		case ESimdSSE42: return &curveRowSSE42<Mode>;
+#endif
+		default: return &curveRowScalar;
+	}
+}
+
+template <typename Pack>
+void luminanceRowPacked(const float *const src[3], float *dst, int count) {
+	for (int j = 0; j < count; j += Pack::Width) {
+		luminance(Pack::load(src[0] + j), Pack::load(src[1] + j), Pack::load(src[2] + j)).store(dst + j);
+	}
+}
+
+void luminanceRowSSE42(const float *const src[3], float *dst, int count);
+void luminanceRowAVX2(const float *const src[3], float *dst, int count);
+void luminanceRowAVX512(const float *const src[3], float *dst, int count);
+
+inline void luminanceRowScalar(const float *const src[3], float *dst, int count) {
+	for (int j = 0; j < count; ++j) {
+		dst[j] = luminance(src[0][j], src[1][j], src[2][j]);
+	}
+}
+
+inline LuminanceKernel luminanceKernel(SimdLevel level) {
+	switch (level) {
+#if defined(TONEMAPPER_SIMD_X86)
+		case ESimdAVX512: return &luminanceRowAVX512;
+		case ESimdAVX2: return &luminanceRowAVX2;
+		case ESimdSSE42: return &luminanceRowSSE42;
+#endif
+		default: return &luminanceRowScalar;
+	}
+}
+
+/* Conversion of 'count' values from half to single precision and back
+   (rounded to nearest even), used for EPlanarHalf images. 'count' has to
+   be a multiple of MaxPackWidth. The AVX2 and AVX-512 versions use F16C. */
+typedef void (*HalfToFloatKernel)(const uint16_t *src, float *dst, int count);
+typedef void (*FloatToHalfKernel)(const float *src, uint16_t *dst, int count);
+
+void halfToFloatRowSSE42(const uint16_t *src, float *dst, int count);
+void halfToFloatRowAVX2(const uint16_t *src, float *dst, int count);
+void halfToFloatRowAVX512(const uint16_t *src, float *dst, int count);
+void floatToHalfRowAVX2(const float *src, uint16_t *dst, int count);
+void floatToHalfRowAVX512(const float *src, uint16_t *dst, int count);
+
+inline void halfToFloatRowScalar(const uint16_t *src, float *dst, int count) {
+	for (int j = 0; j < count; ++j) {
+		dst[j] = halfToFloat(src[j]);
+	}
+}
+
+inline void floatToHalfRowScalar(const float *src, uint16_t *dst, int count) {
+	for (int j = 0; j < count; ++j) {
+		dst[j] = floatToHalf(src[j]);
+	}
+}
+
+inline HalfToFloatKernel halfToFloatKernel(SimdLevel level) {
+	switch (level) {
+#if defined(TONEMAPPER_SIMD_X86)
+		case ESimdAVX512: return &halfToFloatRowAVX512;
+		case ESimdAVX2: return &halfToFloatRowAVX2;
+		case ESimdSSE42: return &halfToFloatRowSSE42;
+#endif
+		default: return &halfToFloatRowScalar;
+	}
+}
+
+// Only needed while loading, SSE 4.2 uses the scalar version
+inline FloatToHalfKernel floatToHalfKernel(SimdLevel level) {
+	switch (level) {
+#if defined(TONEMAPPER_SIMD_X86)
+		case ESimdAVX512: return &floatToHalfRowAVX512;
+		case ESimdAVX2: return &floatToHalfRowAVX2;
+#endif
+		default: return &floatToHalfRowScalar;
+	}
+}
+
+// Rows of one pixel row that are passed to the output stages, the three channels are 'stride' apart
+struct OutputRow {
+	const uint8_t *codes;		// 8 bit codes
+	const float *values;		// Display values, only computed if an output needs them
+	uint16_t *samples;			// Room for the 16 bit samples
+	int stride;
+	int width;
+	Quantization quantization;
+	FloatToHalfKernel floatToHalf;
+};
+
+/* Last stage of process() for one output format, quantizes the row and
+   interleaves its 'width' pixels into 'dst'. Instantiated per format, the
+   stage of every output is picked once per call. */
+typedef void (*OutputStage)(const OutputRow &row, void *dst);
+
+template <typename T>
+inline void interleaveRow(const T *src, int stride, T *dst, int width) {
+	for (int j = 0; j < width; ++j) {
+		dst[0] = src[j];
+		dst[1] = src[j + stride];
+		dst[2] = src[j + 2 * stride];
+		dst += 3;
+	}
+}
+
+template <int Format>
+void storeRow(const OutputRow &row, void *dst);
+
+template <>
+inline void storeRow<EOutputUInt8>(const OutputRow &row, void *dst) {
+	interleaveRow(row.codes, row.stride, (uint8_t *) dst, row.width);
+}
+
+template <>
+inline void storeRow<EOutputUInt16>(const OutputRow &row, void *dst) {
+	const float offset = row.quantization == ERound ? 0.5f : 0.f;
+	for (int j = 0; j < 3 * row.stride; ++j) {
+		row.samples[j] = (uint16_t) (65535.f * row.values[j] + offset);
+	}
+	interleaveRow<uint16_t>(row.samples, row.stride, (uint16_t *) dst, row.width);
+}
+
+template <>
+inline void storeRow<EOutputHalf>(const OutputRow &row, void *dst) {
+	row.floatToHalf(row.values, row.samples, 3 * row.stride);
+	interleaveRow<uint16_t>(row.samples, row.stride, (uint16_t *) dst, row.width);
+}
+
+template <>
+inline void storeRow<EOutputFloat>(const OutputRow &row, void *dst) {
+	interleaveRow(row.values, row.stride, (float *) dst, row.width);
+}
+
+inline OutputStage outputStage(OutputFormat format) {
+	switch (format) {
+		case EOutputUInt16: return &storeRow<EOutputUInt16>;
+		case EOutputHalf: return &storeRow<EOutputHalf>;
+		case EOutputFloat: return &storeRow<EOutputFloat>;
+		default: return &storeRow<EOutputUInt8>;
+	}
+}
+
+/* Conversion of 'count' Radiance RGBE pixels to three rows of floats,
+   (m + 0.5) / 256 * 2^(e - 128) like Radiance's colr_color(). The power
+   of two is built from the bits of e, so exponents 0 and 1 give zero.
+   'count' has to be a multiple of MaxPackWidth. */
+typedef void (*RgbeToFloatKernel)(const uint8_t *src, float *const dst[3], int count);
+
+void rgbeToFloatRowSSE42(const uint8_t *src, float *const dst[3], int count);
+void rgbeToFloatRowAVX2(const uint8_t *src, float *const dst[3], int count);
+void rgbeToFloatRowAVX512(const uint8_t *src, float *const dst[3], int count);
+
+inline void rgbeToFloatRowScalar(const uint8_t *src, float *const dst[3], int count) {
+	for (int j = 0; j < count; ++j) {
+		const uint8_t *pixel = src + 4 * j;
+		const uint32_t bits = pixel[3] != 0 ? (uint32_t) (pixel[3] - 1) << 23 : 0;
+		float scale;
+		memcpy(&scale, &bits, sizeof(float));
+		for (int c = 0; c < 3; ++c) {
+			dst[c][j] = (pixel[c] + 0.5f) * (1.f / 256.f) * scale;
+		}
+	}
+}
+
+inline RgbeToFloatKernel rgbeToFloatKernel(SimdLevel level) {
+	switch (level) {
+#if defined(TONEMAPPER_SIMD_X86)
+		case ESimdAVX512: return &rgbeToFloatRowAVX512;
+		case ESimdAVX2: return &rgbeToFloatRowAVX2;
+		case ESimdSSE42: return &rgbeToFloatRowSSE42;
+#endif
+		default: return &rgbeToFloatRowScalar;
+	}
+}
+
+/* Conversion of 'count' RGB pixels to the Y (shifted by -128), Cb and Cr
+   rows of the JPEG encoder. 'count' has to be a multiple of MaxPackWidth. */
+typedef void (*YCbCrKernel)(const uint8_t *src, float *const dst[3], int count);
+
+/* Forward DCT of the JPEG encoder on the 8x8 block at 'src', whose rows are
+   'stride' floats apart, and quantization with 'scale'. The coefficients
+   are rounded to 'dst' row by row. The SIMD versions transpose the block
+   in registers and run the same operations as the scalar one on whole
+   rows, so the coefficients are identical. */
+typedef void (*DctKernel)(const float *src, int stride, const float *scale, int *dst);
+
+template <typename T>
+inline void rgbToYCbCr(const T &r, const T &g, const T &b, T &y, T &cb, T &cr) {
+	y = r * 0.29900f + g * 0.58700f + b * 0.11400f - 128.f;
+	cb = r * -0.16874f - g * 0.33126f + b * 0.50000f;
+	cr = r * 0.50000f - g * 0.41869f - b * 0.08131f;
+}
+
+// Scaled 1D DCT of Arai, Agui and Nakajima, the scale factors are folded into the quantization
+template <typename T>
+inline void aanDct(T d[8]) {
+	T tmp0 = d[0] + d[7];
+	T tmp7 = d[0] - d[7];
+	T tmp1 = d[1] + d[6];
+	T tmp6 = d[1] - d[6];
+	T tmp2 = d[2] + d[5];
+	T tmp5 = d[2] - d[5];
+	T tmp3 = d[3] + d[4];
+	T tmp4 = d[3] - d[4];
+
+	// Even part
+	T tmp10 = tmp0 + tmp3;
+	T tmp13 = tmp0 - tmp3;
+	T tmp11 = tmp1 + tmp2;
+	T tmp12 = tmp1 - tmp2;
+
+	d[0] = tmp10 + tmp11;
+	d[4] = tmp10 - tmp11;
+
+	T z1 = (tmp12 + tmp13) * 0.707106781f;
+	d[2] = tmp13 + z1;
+	d[6] = tmp13 - z1;
+
+	// Odd part
+	tmp10 = tmp4 + tmp5;
+	tmp11 = tmp5 + tmp6;
+	tmp12 = tmp6 + tmp7;
+
+	T z5 = (tmp10 - tmp12) * 0.382683433f;
+	T z2 = tmp10 * 0.541196100f + z5;
+	T z4 = tmp12 * 1.306562965f + z5;
+	T z3 = tmp11 * 0.707106781f;
+
+	T z11 = tmp7 + z3;
+	T z13 = tmp7 - z3;
+
+	d[5] = z13 + z2;
+	d[3] = z13 - z2;
+	d[1] = z11 + z4;
+	d[7] = z11 - z4;
+}
+
+void yCbCrRowSSE42(const uint8_t *src, float *const dst[3], int count);
+void yCbCrRowAVX2(const uint8_t *src, float *const dst[3], int count);
+void dctBlockSSE42(const float *src, int stride, const float *scale, int *dst);
+void dctBlockAVX2(const float *src, int stride, const float *scale, int *dst);
+
+inline void yCbCrRowScalar(const uint8_t *src, float *const dst[3], int count) {
+	for (int j = 0; j < count; ++j, src += 3) {
+		rgbToYCbCr<float>(src[0], src[1], src[2], dst[0][j], dst[1][j], dst[2][j]);
+	}
+}
+
+// The rows of the block, then its columns
+inline void dctBlockScalar(const float *src, int stride, const float *scale, int *dst) {
+	float block[64];
+	for (int i = 0; i < 8; ++i) {
+		memcpy(block + 8 * i, src + i * stride, 8 * sizeof(float));
+		aanDct(block + 8 * i);
+	}
+	for (int j = 0; j < 8; ++j) {
+		float column[8];
+		for (int i = 0; i < 8; ++i) column[i] = block[8 * i + j];
+		aanDct(column);
+		for (int i = 0; i < 8; ++i) block[8 * i + j] = column[i];
+	}
+	for (int k = 0; k < 64; ++k) {
+		const float v = block[k] * scale[k];
+		dst[k] = (int) (v < 0 ? v - 0.5f : v + 0.5f);
+	}
+}
+
+// AVX-512 uses the AVX2 versions, eight pixels fill the rows of a block
+inline YCbCrKernel yCbCrKernel(SimdLevel level) {
+	switch (level) {
+#if defined(TONEMAPPER_SIMD_X86)
+		case ESimdAVX512:
+		case ESimdAVX2: return &yCbCrRowAVX2;
+		case ESimdSSE42: return &yCbCrRowSSE42;
+#endif
+		default: return &yCbCrRowScalar;
+	}
+}
+
+inline DctKernel dctKernel(SimdLevel level) {
+	switch (level) {
+#if defined(TONEMAPPER_SIMD_X86)
+		case ESimdAVX512:
+		case ESimdAVX2: return &dctBlockAVX2;
+		case ESimdSSE42: return &dctBlockSSE42;
+#endif
+		default: return &dctBlockScalar;
+	}
+}
+
+// Row kernel of 'Derived' for the given instruction set
+template <typename Derived, int Mode>
+RowKernel rowKernel(SimdLevel level) {
+	switch (level) {
+#if defined(TONEMAPPER_SIMD_X86)
+		case ESimdAVX512: return &mapRowAVX512<Derived, Mode>;
+		case ESimdAVX2: return &mapRowAVX2<Derived, Mode>;
+		case ESimdSSE42: return &mapRowSSE42<Derived, Mode>;
+#endif
+		default: return &mapRowScalar<Derived>;
+	}
+}
+
+// Kernel of TonemapKernelOperator with TonemapOptions::colorTableSize, the constants are a ColorTable
+struct BakedColor {
+	typedef ColorTable Constants;
+	static const bool LuminanceInput = false;
+
+	template <typename T>
+	static inline void map(const Constants &table, T &r, T &g, T &b) {
+		table(r, g, b);
+	}
+};
+
+/* Base class of operators that split their CPU path into two phases.
+   'Derived' has to provide
+
+       struct Constants;
+       Constants prepare(float exposure) const;
+       static const bool LuminanceInput = false;
+       template <typename T> static void map(const Constants &k, T &r, T &g, T &b);
+
+   or, with LuminanceInput = true, a map() that also receives the luminance
+   of the input color, which is read from the luminance plane of the image
+
+       template <typename T> static void map(const Constants &k, T &r, T &g, T &b, const T &L);
+
+   and may provide
+
+       EncodeCurve encodeCurve() const;
+
+   prepare() folds the parameters, the exposure and the image statistics
+   into a small block of constants once per image. map() is the per-pixel
+   kernel, it replaces the color with the tonemapped value and is
+   instantiated for float and all SIMD packs. Clamping to [0, 1], the
+   display encoding (usually gamma correction) and the quantization are
+   shared by all operators and done with an EncodeTable.
+
+   With TonemapOptions::colorTableSize, map() and the encoding are instead
+   sampled into a ColorTable once per call, which is interpolated per pixel. */
+template <typename Derived>
+class TonemapKernelOperator : public TonemapOperator {
+public:
+	using TonemapOperator::process;
+
+	void process(const Image *image, const OutputBuffer *outputs, int count, float exposure, float *progress,
+				 const TonemapOptions &options = TonemapOptions()) const override {
+		const Derived *derived = static_cast<const Derived *>(this);
+		if (options.colorTableSize > 0) {
+			// The table already contains the display encoding
+			const std::shared_ptr<const ColorTable> table = bakeColorTable(image, exposure, options.colorTableSize);
+			processRows<BakedColor>(image, outputs, count, progress, options, table.get(), EncodeCurve());
+			return;
+		}
+
+		const typename Derived::Constants k = derived->prepare(exposure);
+		processRows<Derived>(image, outputs, count, progress, options, &k, derived->encodeCurve());
+	}
+
+	// The last table is kept and reused as long as parameters, exposure and value range stay the same
+	std::shared_ptr<const ColorTable> bakeColorTable(const Image *image, float exposure, int size) const override {
+		std::vector<float> key(parameters.values(), parameters.values() + parameters.size());
+		key.push_back(exposure);
+		key.push_back(image->getMaximumValue());
+		key.push_back((float) size);
+
+		std::lock_guard<std::mutex> lock(m_colorTableMutex);
+		if (m_colorTable && key == m_colorTableKey) {
+			return m_colorTable;
+		}
+
+		const Derived *derived = static_cast<const Derived *>(this);
+		const typename Derived::Constants k = derived->prepare(exposure);
+		const EncodeCurve curve = derived->encodeCurve();
+		m_colorTable = std::make_shared<const ColorTable>([&k, &curve](float &r, float &g, float &b) {
+			mapPixel<Derived>(k, r, g, b);
+			r = curve(r);
+			g = curve(g);
+			b = curve(b);
+		}, image->getMaximumValue(), size);
+		m_colorTableKey = key;
+		return m_colorTable;
+	}
+
+	// No encoding by default, the operator output is only clamped and quantized
+	EncodeCurve encodeCurve() const { return EncodeCurve(); }
+
+	static const bool LuminanceInput = false;
+
+protected:
+	/* Maps the rows of the image given in 'options' with the row kernel of 'Kernel' (an operator
+	   or one of the baked kernels), applies 'curve' and quantizes the result
+	   into all outputs */
+	template <typename Kernel>
+	void processRows(const Image *image, const OutputBuffer *outputs, int outputCount, float *progress,
+					 const TonemapOptions &options, const void *constants, const EncodeCurve &curve) const {
+		const RowKernel kernel = options.math == EMathFast ? rowKernel<Kernel, EMathFast>(getSimdLevel()) : rowKernel<Kernel, EMathPrecise>(getSimdLevel());
+		const LuminanceKernel luminanceRow = luminanceKernel(getSimdLevel());
+		const EncodeKernel encode = encodeKernel(getSimdLevel());
+		const HalfToFloatKernel halfToFloatRow = halfToFloatKernel(getSimdLevel());
+		const CurveKernel curveRow = options.math == EMathFast ? curveKernel<EMathFast>(getSimdLevel()) : curveKernel<EMathPrecise>(getSimdLevel());
+		const FloatToHalfKernel floatToHalfRow = floatToHalfKernel(getSimdLevel());
+		const std::shared_ptr<const EncodeTable> table = EncodeTable::get(curve, options.quantization);
+		std::vector<OutputStage> stages(outputCount);
+		bool codes8 = false, values = false;
+		for (int o = 0; o < outputCount; ++o) {
+			stages[o] = outputStage(outputs[o].format);
+			codes8 |= outputs[o].format == EOutputUInt8;
+			values |= outputs[o].format != EOutputUInt8;
+		}
+		const int width = image->getWidth();
+		const int paddedWidth = (width + MaxPackWidth - 1) / MaxPackWidth * MaxPackWidth;
+		const int firstRow = options.rowBegin;
+		const int lastRow = options.rowEnd < 0 ? image->getHeight() : options.rowEnd;
+
+		forEachBand(lastRow - firstRow, progress, [&](int rowBegin, int rowEnd) {
+			rowBegin += firstRow;
+			rowEnd += firstRow;
+			std::vector<float> buffer(4 * paddedWidth, 0.f);
+			float *r = buffer.data();
+			float *g = r + paddedWidth;
+			float *b = g + paddedWidth;
+			float *L = b + paddedWidth;
+			std::vector<uint8_t> codes(codes8 ? 3 * paddedWidth : 0);
+			std::vector<float> display(values ? 3 * paddedWidth : 0);
+			std::vector<uint16_t> samples(values ? 3 * paddedWidth : 0);
+			const OutputRow row = { codes.data(), display.data(), samples.data(), paddedWidth, width, options.quantization, floatToHalfRow };
+
+			float *const rows[3] = { r, g, b };
+
+			for (int i = rowBegin; i < rowEnd; ++i) {
+				/* Planar images are read in place, half rows are widened and
+				   interleaved ones are split into the buffer first */
+				const float *src[4] = { r, g, b, L };
+				if (image->isPlanar()) {
+					for (int c = 0; c < 3; ++c) {
+						src[c] = image->getPlaneRow(c, i);
+					}
+				} else if (image->isPlanarHalf()) {
+					for (int c = 0; c < 3; ++c) {
+						halfToFloatRow(image->getHalfPlaneRow(c, i), rows[c], paddedWidth);
+					}
+				} else {
+					const Color3f *row = &image->ref(i, 0);
+					for (int j = 0; j < width; ++j) {
+						r[j] = row[j].r();
+						g[j] = row[j].g();
+						b[j] = row[j].b();
+					}
+				}
+
+				// The cached plane is read in place or widened from half precision
+				if (Kernel::LuminanceInput) {
+					if (image->getLuminanceRow(i)) {
+						src[3] = image->getLuminanceRow(i);
+					} else if (image->getLuminanceRowHalf(i)) {
+						// Below the normal range of half precision too few bits are left, it is recomputed from the color
+						halfToFloatRow(image->getLuminanceRowHalf(i), L, paddedWidth);
+						for (int j = 0; j < width; ++j) {
+							if (L[j] < HalfMinNormal) {
+								L[j] = luminance(src[0][j], src[1][j], src[2][j]);
+							}
+						}
+					} else {
+						luminanceRow(src, L, width);
+					}
+				}
+
+				kernel(constants, src, rows, width);
+				if (codes8) {
+					encode(*table, r, codes.data(), 3 * paddedWidth);
+				}
+				if (values) {
+					curveRow(curve, r, display.data(), 3 * paddedWidth);
+				}
+
+				const size_t pixel = 3 * ((size_t) width * (i - firstRow));
+				for (int o = 0; o < outputCount; ++o) {
+					stages[o](row, (uint8_t *) outputs[o].data + pixel * getOutputSampleSize(outputs[o].format));
+				}
+			}
+		});
+	}
+
+private:
+	mutable std::mutex 							m_colorTableMutex;
+	mutable std::vector<float> 					m_colorTableKey;
+	mutable std::shared_ptr<const ColorTable> 	m_colorTable;
+};
+
+// Kernel of LuminanceKernelOperator with a baked curve, the constants are a LuminanceTable
+struct BakedLuminance {
+	typedef LuminanceTable Constants;
+	static const bool LuminanceInput = true;
+
+	template <typename T>
+	static inline void map(const Constants &table, T &r, T &g, T &b, const T &L) {
+		T scale = table(L);
+		r = r * scale;
+		g = g * scale;
+		b = b * scale;
+	}
+};
+
+/* Base class of global luminance operators. 'Derived' provides
+
+       template <typename T> static T mapLuminance(const Constants &k, T Lw);
+
+   instead of map(), the color is scaled by Ld / Lw. Lw comes from the
+   luminance plane of the image. With
+   TonemapOptions::bakeLuminance the curve is sampled into a LuminanceTable
+   over the luminance range of the image once per call. */
+template <typename Derived>
+class LuminanceKernelOperator : public TonemapKernelOperator<Derived> {
+public:
+	using TonemapKernelOperator<Derived>::process;
+
+	void process(const Image *image, const OutputBuffer *outputs, int count, float exposure, float *progress,
+				 const TonemapOptions &options = TonemapOptions()) const override {
+		if (!options.bakeLuminance || options.colorTableSize > 0) {
+			TonemapKernelOperator<Derived>::process(image, outputs, count, exposure, progress, options);
+			return;
+		}
+
+		const typename Derived::Constants k = static_cast<const Derived *>(this)->prepare(exposure);
+		const LuminanceTable table([&k](float Lw) { return Derived::mapLuminance(k, Lw); },
+								   image->getMinimumLuminance(), image->getMaximumLuminance());
+		if (options.bakeError) {
+			*options.bakeError = table.getMaxError();
+		}
+		this->template processRows<BakedLuminance>(image, outputs, count, progress, options, &table,
+												   static_cast<const Derived *>(this)->encodeCurve());
+	}
+
+	static const bool LuminanceInput = true;
+
+	template <typename Constants, typename T>
+	static inline void map(const Constants &k, T &r, T &g, T &b, const T &Lw) {
+		T Ld = Derived::mapLuminance(k, Lw);
+		scaleColor(r, g, b, Ld, Lw);
+	}
+};
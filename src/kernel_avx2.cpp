@@ -0,0 +1,186 @@
+/*
+    src/kernel_avx2.cpp -- AVX2 versions of all operator kernels
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+/* Nothing but the kernels may be compiled for the instruction set of this
+   file: keep Eigen's code and object layout identical to the other files. */
+#define EIGEN_DONT_VECTORIZE
+#define EIGEN_MAX_ALIGN_BYTES 16
+
+#include <simd/avx2.h>
+
+#include <kernel.h>
+#include <operators/all.h>
+
+/* This file is compiled with AVX2 enabled. Only the kernels of the
+   operators, the luminance plane and the encode stage live here, they are
+   selected at runtime. */
+template <typename Derived, int Mode>
+void mapRowAVX2(const void *constants, const float *const src[4], float *const dst[3], int count) {
+	mapRowPacked<Derived, avx2::BasicFloat<Mode> >(constants, src, dst, count);
+}
+
+template <int Mode>
+void curveRowAVX2(const EncodeCurve &curve, const float *src, float *dst, int count) {
+	curveRowPacked<avx2::BasicFloat<Mode> >(curve, src, dst, count);
+}
+
+template void curveRowAVX2<EMathPrecise>(const EncodeCurve &curve, const float *src, float *dst, int count);
+template void curveRowAVX2<EMathFast>(const EncodeCurve &curve, const float *src, float *dst, int count);
+
+void luminanceRowAVX2(const float *const src[3], float *dst, int count) {
+	luminanceRowPacked<avx2::BasicFloat<EMathPrecise> >(src, dst, count);
+}
+
+void halfToFloatRowAVX2(const uint16_t *src, float *dst, int count) {
+	for (int j = 0; j < count; j += 8) {
+		_mm256_storeu_ps(dst + j, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (src + j))));
+	}
+}
+
+void floatToHalfRowAVX2(const float *src, uint16_t *dst, int count) {
+	for (int j = 0; j < count; j += 8) {
+		_mm_storeu_si128((__m128i *) (dst + j), _mm256_cvtps_ph(_mm256_loadu_ps(src + j), _MM_FROUND_TO_NEAREST_INT));
+	}
+}
+
+// 8 pixels at a time, the power of two is put together in the exponent bits of a float
+void rgbeToFloatRowAVX2(const uint8_t *src, float *const dst[3], int count) {
+	for (int j = 0; j < count; j += 8) {
+		__m256i pixels = _mm256_loadu_si256((const __m256i *) (src + 4 * j));
+		__m256i exponent = _mm256_srli_epi32(pixels, 24);
+		__m256i scale = _mm256_slli_epi32(_mm256_sub_epi32(exponent, _mm256_set1_epi32(1)), 23);
+		scale = _mm256_andnot_si256(_mm256_cmpeq_epi32(exponent, _mm256_setzero_si256()), scale);
+		for (int c = 0; c < 3; ++c) {
+			__m256i mantissa = _mm256_and_si256(_mm256_srli_epi32(pixels, 8 * c), _mm256_set1_epi32(0xff));
+			__m256 value = _mm256_mul_ps(_mm256_add_ps(_mm256_cvtepi32_ps(mantissa), _mm256_set1_ps(0.5f)), _mm256_set1_ps(1.f / 256.f));
+			_mm256_storeu_ps(dst[c] + j, _mm256_mul_ps(value, _mm256_castsi256_ps(scale)));
+		}
+	}
+}
+
+// Vectorized EncodeTable::operator(), NaNs become 1 after clamping and are replaced at the end
+void encodeRowAVX2(const EncodeTable &table, const float *values, uint8_t *codes, int count) {
+	const EncodeTable::Entry *entries = table.getEntries();
+	const __m256i begin = _mm256_set1_epi32((int) table.getBegin());
+	const __m128i shift = _mm_cvtsi32_si128(table.getShift());
+	const __m256i nanCode = _mm256_set1_epi32(table.getNanCode());
+
+	for (int j = 0; j < count; j += 8) {
+		__m256 x = _mm256_loadu_ps(values + j);
+		__m256 y = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(1.f)), _mm256_setzero_ps());
+		__m256i index = _mm256_sra_epi32(_mm256_sub_epi32(_mm256_castps_si256(y), begin), shift);
+		index = _mm256_add_epi32(_mm256_max_epi32(index, _mm256_set1_epi32(-1)), _mm256_set1_epi32(1));
+
+		__m256 threshold = _mm256_i32gather_ps(&entries->threshold, index, 8);
+		__m256i word = _mm256_i32gather_epi32((const int *) &entries->below, index, 8);
+		__m256i above = _mm256_castps_si256(_mm256_cmp_ps(y, threshold, _CMP_GE_OQ));
+		__m256i code = _mm256_blendv_epi8(word, _mm256_srli_epi32(word, 8), above);
+		code = _mm256_and_si256(code, _mm256_set1_epi32(0xff));
+		code = _mm256_blendv_epi8(code, nanCode, _mm256_castps_si256(_mm256_cmp_ps(x, x, _CMP_UNORD_Q)));
+
+		// Codes of lanes 0-3 and 4-7 end up in the lowest 4 bytes of the two 128 bit lanes
+		__m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(code, code), _mm256_setzero_si256());
+		int low = _mm_cvtsi128_si32(_mm256_castsi256_si128(packed));
+		int high = _mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1));
+		memcpy(codes + j, &low, 4);
+		memcpy(codes + j + 4, &high, 4);
+
+		if (!_mm256_testz_si256(_mm256_and_si256(word, above), _mm256_set1_epi32(0x10000))) {
+			encodeRowScalar(table, values + j, codes + j, 8);
+		}
+	}
+}
+
+// 8 pixels at a time, the bytes of every channel are gathered from the two loads with shuffles
+void yCbCrRowAVX2(const uint8_t *src, float *const dst[3], int count) {
+	typedef avx2::BasicFloat<EMathPrecise> Pack;
+	const __m128i front[3] = {
+		_mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+		_mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+		_mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)
+	};
+	const __m128i back[3] = {
+		_mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, -1, -1, -1, -1, -1, -1, -1, -1),
+		_mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, -1, -1, -1, -1, -1, -1, -1, -1),
+		_mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1)
+	};
+	for (int j = 0; j < count; j += 8, src += 24) {
+		__m128i first = _mm_loadu_si128((const __m128i *) src);
+		__m128i second = _mm_loadl_epi64((const __m128i *) (src + 16));
+		Pack rgb[3];
+		for (int c = 0; c < 3; ++c) {
+			__m128i bytes = _mm_or_si128(_mm_shuffle_epi8(first, front[c]), _mm_shuffle_epi8(second, back[c]));
+			rgb[c] = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+		}
+		Pack y, cb, cr;
+		rgbToYCbCr(rgb[0], rgb[1], rgb[2], y, cb, cr);
+		y.store(dst[0] + j);
+		cb.store(dst[1] + j);
+		cr.store(dst[2] + j);
+	}
+}
+
+namespace {
+
+inline void transpose8x8(__m256 r[8]) {
+	__m256 t[8], u[8];
+	for (int i = 0; i < 4; ++i) {
+		t[2 * i] = _mm256_unpacklo_ps(r[2 * i], r[2 * i + 1]);
+		t[2 * i + 1] = _mm256_unpackhi_ps(r[2 * i], r[2 * i + 1]);
+	}
+	for (int i = 0; i < 8; i += 4) {
+		u[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+		u[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+		u[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+		u[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+	}
+	for (int i = 0; i < 4; ++i) {
+		r[i] = _mm256_permute2f128_ps(u[i], u[i + 4], 0x20);
+		r[i + 4] = _mm256_permute2f128_ps(u[i], u[i + 4], 0x31);
+	}
+}
+
+}
+
+// One register per row, the DCT across the registers transforms the columns
+void dctBlockAVX2(const float *src, int stride, const float *scale, int *dst) {
+	typedef avx2::BasicFloat<EMathPrecise> Pack;
+	__m256 rows[8];
+	for (int i = 0; i < 8; ++i) {
+		rows[i] = _mm256_loadu_ps(src + i * stride);
+	}
+
+	// Rows first, as columns of the transposed block, then the columns
+	for (int pass = 0; pass < 2; ++pass) {
+		transpose8x8(rows);
+		Pack d[8];
+		for (int i = 0; i < 8; ++i) {
+			d[i] = rows[i];
+		}
+		aanDct(d);
+		for (int i = 0; i < 8; ++i) {
+			rows[i] = d[i].v;
+		}
+	}
+
+	// Rounded away from zero, by adding 0.5 with the sign of the value before the truncation
+	const __m256 half = _mm256_set1_ps(0.5f), sign = _mm256_set1_ps(-0.f);
+	for (int i = 0; i < 8; ++i) {
+		__m256 v = _mm256_mul_ps(rows[i], _mm256_loadu_ps(scale + 8 * i));
+		v = _mm256_add_ps(v, _mm256_or_ps(half, _mm256_and_ps(v, sign)));
+		_mm256_storeu_si256((__m256i *) (dst + 8 * i), _mm256_cvttps_epi32(v));
+	}
+}
+
+#define INSTANTIATE_KERNEL(Operator) \
+	template void mapRowAVX2<Operator, EMathPrecise>(const void *constants, const float *const src[4], float *const dst[3], int count); \
+	template void mapRowAVX2<Operator, EMathFast>(const void *constants, const float *const src[4], float *const dst[3], int count);
+TONEMAP_FOR_EACH_OPERATOR(INSTANTIATE_KERNEL)
+INSTANTIATE_KERNEL(BakedLuminance)
+INSTANTIATE_KERNEL(BakedColor)
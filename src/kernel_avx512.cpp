@@ -0,0 +1,99 @@
+/*
+    src/kernel_avx512.cpp -- AVX-512 versions of all operator kernels
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+/* Nothing but the kernels may be compiled for the instruction set of this
+   file: keep Eigen's code and object layout identical to the other files. */
+#define EIGEN_DONT_VECTORIZE
+#define EIGEN_MAX_ALIGN_BYTES 16
+
+#include <simd/avx512.h>
+
+#include <kernel.h>
+#include <operators/all.h>
+
+/* This file is compiled with AVX-512 enabled. Only the kernels of the
+   operators, the luminance plane and the encode stage live here, they are
+   selected at runtime. */
+template <typename Derived, int Mode>
+void mapRowAVX512(const void *constants, const float *const src[4], float *const dst[3], int count) {
+	mapRowPacked<Derived, avx512::BasicFloat<Mode> >(constants, src, dst, count);
+}
+
+template <int Mode>
+void curveRowAVX512(const EncodeCurve &curve, const float *src, float *dst, int count) {
+	curveRowPacked<avx512::BasicFloat<Mode> >(curve, src, dst, count);
+}
+
+template void curveRowAVX512<EMathPrecise>(const EncodeCurve &curve, const float *src, float *dst, int count);
+template void curveRowAVX512<EMathFast>(const EncodeCurve &curve, const float *src, float *dst, int count);
+
+void luminanceRowAVX512(const float *const src[3], float *dst, int count) {
+	luminanceRowPacked<avx512::BasicFloat<EMathPrecise> >(src, dst, count);
+}
+
+void halfToFloatRowAVX512(const uint16_t *src, float *dst, int count) {
+	for (int j = 0; j < count; j += 16) {
+		_mm512_storeu_ps(dst + j, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *) (src + j))));
+	}
+}
+
+void floatToHalfRowAVX512(const float *src, uint16_t *dst, int count) {
+	for (int j = 0; j < count; j += 16) {
+		_mm256_storeu_si256((__m256i *) (dst + j), _mm512_cvtps_ph(_mm512_loadu_ps(src + j), _MM_FROUND_TO_NEAREST_INT));
+	}
+}
+
+// 16 pixels at a time, the power of two is put together in the exponent bits of a float
+void rgbeToFloatRowAVX512(const uint8_t *src, float *const dst[3], int count) {
+	for (int j = 0; j < count; j += 16) {
+		__m512i pixels = _mm512_loadu_si512((const void *) (src + 4 * j));
+		__m512i exponent = _mm512_srli_epi32(pixels, 24);
+		__m512i scale = _mm512_slli_epi32(_mm512_sub_epi32(exponent, _mm512_set1_epi32(1)), 23);
+		scale = _mm512_maskz_mov_epi32(_mm512_test_epi32_mask(pixels, _mm512_set1_epi32((int) 0xff000000)), scale);
+		for (int c = 0; c < 3; ++c) {
+			__m512i mantissa = _mm512_and_si512(_mm512_srli_epi32(pixels, 8 * c), _mm512_set1_epi32(0xff));
+			__m512 value = _mm512_mul_ps(_mm512_add_ps(_mm512_cvtepi32_ps(mantissa), _mm512_set1_ps(0.5f)), _mm512_set1_ps(1.f / 256.f));
+			_mm512_storeu_ps(dst[c] + j, _mm512_mul_ps(value, _mm512_castsi512_ps(scale)));
+		}
+	}
+}
+
+// Vectorized EncodeTable::operator(), NaNs become 1 after clamping and are replaced at the end
+void encodeRowAVX512(const EncodeTable &table, const float *values, uint8_t *codes, int count) {
+	const EncodeTable::Entry *entries = table.getEntries();
+	const __m512i begin = _mm512_set1_epi32((int) table.getBegin());
+	const __m128i shift = _mm_cvtsi32_si128(table.getShift());
+	const __m512i nanCode = _mm512_set1_epi32(table.getNanCode());
+
+	for (int j = 0; j < count; j += 16) {
+		__m512 x = _mm512_loadu_ps(values + j);
+		__m512 y = _mm512_max_ps(_mm512_min_ps(x, _mm512_set1_ps(1.f)), _mm512_setzero_ps());
+		__m512i index = _mm512_sra_epi32(_mm512_sub_epi32(_mm512_castps_si512(y), begin), shift);
+		index = _mm512_add_epi32(_mm512_max_epi32(index, _mm512_set1_epi32(-1)), _mm512_set1_epi32(1));
+
+		__m512 threshold = _mm512_i32gather_ps(index, &entries->threshold, 8);
+		__m512i word = _mm512_i32gather_epi32(index, &entries->below, 8);
+		__mmask16 above = _mm512_cmp_ps_mask(y, threshold, _CMP_GE_OQ);
+		__m512i code = _mm512_mask_srli_epi32(word, above, word, 8);
+		code = _mm512_and_si512(code, _mm512_set1_epi32(0xff));
+		code = _mm512_mask_mov_epi32(code, _mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q), nanCode);
+		_mm_storeu_si128((__m128i *) (codes + j), _mm512_cvtepi32_epi8(code));
+
+		if (_mm512_mask_test_epi32_mask(above, word, _mm512_set1_epi32(0x10000))) {
+			encodeRowScalar(table, values + j, codes + j, 16);
+		}
+	}
+}
+
+#define INSTANTIATE_KERNEL(Operator) \
+	template void mapRowAVX512<Operator, EMathPrecise>(const void *constants, const float *const src[4], float *const dst[3], int count); \
+	template void mapRowAVX512<Operator, EMathFast>(const void *constants, const float *const src[4], float *const dst[3], int count);
+TONEMAP_FOR_EACH_OPERATOR(INSTANTIATE_KERNEL)
+INSTANTIATE_KERNEL(BakedLuminance)
+INSTANTIATE_KERNEL(BakedColor)
@@ -0,0 +1,190 @@
+/*
+    src/kernel_sse42.cpp -- SSE4.2 versions of all operator kernels
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+/* Nothing but the kernels may be compiled for the instruction set of this
+   file: keep Eigen's code and object layout identical to the other files. */
+#define EIGEN_DONT_VECTORIZE
+#define EIGEN_MAX_ALIGN_BYTES 16
+
+#include <simd/sse42.h>
+
+#include <kernel.h>
+#include <operators/all.h>
+
+/* This file is compiled with SSE4.2 enabled. Only the kernels of the
+   operators, the luminance plane and the encode stage live here, they are
+   selected at runtime. */
+template <typename Derived, int Mode>
+void mapRowSSE42(const void *constants, const float *const src[4], float *const dst[3], int count) {
+	mapRowPacked<Derived, sse42::BasicFloat<Mode> >(constants, src, dst, count);
+}
+
+template <int Mode>
+void curveRowSSE42(const EncodeCurve &curve, const float *src, float *dst, int count) {
+	curveRowPacked<sse42::BasicFloat<Mode> >(curve, src, dst, count);
+}
+
+template void curveRowSSE42<EMathPrecise>(const EncodeCurve &curve, const float *src, float *dst, int count);
+template void curveRowSSE42<EMathFast>(const EncodeCurve &curve, const float *src, float *dst, int count);
+
+void luminanceRowSSE42(const float *const src[3], float *dst, int count) {
+	luminanceRowPacked<sse42::BasicFloat<EMathPrecise> >(src, dst, count);
+}
+
+// Without F16C, halfToFloat() of half.h on four values at once
+void halfToFloatRowSSE42(const uint16_t *src, float *dst, int count) {
+	const __m128i exponentMask = _mm_set1_epi32(0x7c00 << 13);
+	const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(113 << 23));
+	for (int j = 0; j < count; j += 4) {
+		__m128i h = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) (src + j)));
+		__m128i f = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+		__m128i exponent = _mm_and_si128(f, exponentMask);
+		f = _mm_add_epi32(f, _mm_set1_epi32((127 - 15) << 23));
+
+		// Infinity and NaN get the maximum exponent, denormals are renormalized by a subtraction
+		__m128i special = _mm_cmpeq_epi32(exponent, exponentMask);
+		f = _mm_add_epi32(f, _mm_and_si128(special, _mm_set1_epi32((128 - 16) << 23)));
+		__m128i denormal = _mm_cmpeq_epi32(exponent, _mm_setzero_si128());
+		__m128 renormalized = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(f, _mm_set1_epi32(1 << 23))), magic);
+		__m128 value = _mm_blendv_ps(_mm_castsi128_ps(f), renormalized, _mm_castsi128_ps(denormal));
+
+		__m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+		_mm_storeu_ps(dst + j, _mm_or_ps(value, _mm_castsi128_ps(sign)));
+	}
+}
+
+// 4 pixels at a time, the power of two is put together in the exponent bits of a float
+void rgbeToFloatRowSSE42(const uint8_t *src, float *const dst[3], int count) {
+	for (int j = 0; j < count; j += 4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i *) (src + 4 * j));
+		__m128i exponent = _mm_srli_epi32(pixels, 24);
+		__m128i scale = _mm_slli_epi32(_mm_sub_epi32(exponent, _mm_set1_epi32(1)), 23);
+		scale = _mm_andnot_si128(_mm_cmpeq_epi32(exponent, _mm_setzero_si128()), scale);
+		for (int c = 0; c < 3; ++c) {
+			__m128i mantissa = _mm_and_si128(_mm_srli_epi32(pixels, 8 * c), _mm_set1_epi32(0xff));
+			__m128 value = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(mantissa), _mm_set1_ps(0.5f)), _mm_set1_ps(1.f / 256.f));
+			_mm_storeu_ps(dst[c] + j, _mm_mul_ps(value, _mm_castsi128_ps(scale)));
+		}
+	}
+}
+
+/* Vectorized EncodeTable::operator(), NaNs become 1 after clamping and are
+   replaced at the end. There are no gathers in SSE, the entries are loaded
+   one by one. */
+void encodeRowSSE42(const EncodeTable &table, const float *values, uint8_t *codes, int count) {
+	const EncodeTable::Entry *entries = table.getEntries();
+	const __m128i begin = _mm_set1_epi32((int) table.getBegin());
+	const __m128i shift = _mm_cvtsi32_si128(table.getShift());
+	const __m128i nanCode = _mm_set1_epi32(table.getNanCode());
+
+	for (int j = 0; j < count; j += 4) {
+		__m128 x = _mm_loadu_ps(values + j);
+		__m128 y = _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(1.f)), _mm_setzero_ps());
+		__m128i index = _mm_sra_epi32(_mm_sub_epi32(_mm_castps_si128(y), begin), shift);
+		index = _mm_add_epi32(_mm_max_epi32(index, _mm_set1_epi32(-1)), _mm_set1_epi32(1));
+
+		int i[4];
+		_mm_storeu_si128((__m128i *) i, index);
+		__m128 threshold = _mm_setr_ps(entries[i[0]].threshold, entries[i[1]].threshold, entries[i[2]].threshold, entries[i[3]].threshold);
+		int w[4];
+		for (int l = 0; l < 4; ++l) memcpy(&w[l], &entries[i[l]].below, 4);
+		__m128i word = _mm_loadu_si128((const __m128i *) w);
+
+		__m128i above = _mm_castps_si128(_mm_cmpge_ps(y, threshold));
+		__m128i code = _mm_blendv_epi8(word, _mm_srli_epi32(word, 8), above);
+		code = _mm_and_si128(code, _mm_set1_epi32(0xff));
+		code = _mm_blendv_epi8(code, nanCode, _mm_castps_si128(_mm_cmpunord_ps(x, x)));
+
+		int packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(code, code), code));
+		memcpy(codes + j, &packed, 4);
+
+		if (!_mm_testz_si128(_mm_and_si128(word, above), _mm_set1_epi32(0x10000))) {
+			encodeRowScalar(table, values + j, codes + j, 4);
+		}
+	}
+}
+
+// 4 pixels at a time, the bytes of every channel are gathered with a shuffle
+void yCbCrRowSSE42(const uint8_t *src, float *const dst[3], int count) {
+	typedef sse42::BasicFloat<EMathPrecise> Pack;
+	const __m128i red = _mm_setr_epi8(0, 3, 6, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i green = _mm_setr_epi8(1, 4, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i blue = _mm_setr_epi8(2, 5, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	for (int j = 0; j < count; j += 4, src += 12) {
+		int last;
+		memcpy(&last, src + 8, 4);
+		__m128i pixels = _mm_insert_epi32(_mm_loadl_epi64((const __m128i *) src), last, 2);
+		Pack r = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_shuffle_epi8(pixels, red)));
+		Pack g = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_shuffle_epi8(pixels, green)));
+		Pack b = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_shuffle_epi8(pixels, blue)));
+		Pack y, cb, cr;
+		rgbToYCbCr(r, g, b, y, cb, cr);
+		y.store(dst[0] + j);
+		cb.store(dst[1] + j);
+		cr.store(dst[2] + j);
+	}
+}
+
+namespace {
+
+// Transposes the 8x8 block given as the left and right halves of its rows, quarter by quarter
+inline void transpose8x8(__m128 left[8], __m128 right[8]) {
+	_MM_TRANSPOSE4_PS(left[0], left[1], left[2], left[3]);
+	_MM_TRANSPOSE4_PS(right[4], right[5], right[6], right[7]);
+	_MM_TRANSPOSE4_PS(left[4], left[5], left[6], left[7]);
+	_MM_TRANSPOSE4_PS(right[0], right[1], right[2], right[3]);
+	for (int i = 0; i < 4; ++i) {
+		std::swap(left[4 + i], right[i]);
+	}
+}
+
+}
+
+// Two halves of four columns, the DCT across the registers transforms the columns
+void dctBlockSSE42(const float *src, int stride, const float *scale, int *dst) {
+	typedef sse42::BasicFloat<EMathPrecise> Pack;
+	__m128 left[8], right[8];
+	for (int i = 0; i < 8; ++i) {
+		left[i] = _mm_loadu_ps(src + i * stride);
+		right[i] = _mm_loadu_ps(src + i * stride + 4);
+	}
+
+	// Rows first, as columns of the transposed block, then the columns
+	for (int pass = 0; pass < 2; ++pass) {
+		transpose8x8(left, right);
+		Pack l[8], r[8];
+		for (int i = 0; i < 8; ++i) {
+			l[i] = left[i];
+			r[i] = right[i];
+		}
+		aanDct(l);
+		aanDct(r);
+		for (int i = 0; i < 8; ++i) {
+			left[i] = l[i].v;
+			right[i] = r[i].v;
+		}
+	}
+
+	// Rounded away from zero, by adding 0.5 with the sign of the value before the truncation
+	const __m128 half = _mm_set1_ps(0.5f), sign = _mm_set1_ps(-0.f);
+	for (int i = 0; i < 8; ++i) {
+		__m128 v[2] = { _mm_mul_ps(left[i], _mm_loadu_ps(scale + 8 * i)), _mm_mul_ps(right[i], _mm_loadu_ps(scale + 8 * i + 4)) };
+		for (int h = 0; h < 2; ++h) {
+			v[h] = _mm_add_ps(v[h], _mm_or_ps(half, _mm_and_ps(v[h], sign)));
+			_mm_storeu_si128((__m128i *) (dst + 8 * i + 4 * h), _mm_cvttps_epi32(v[h]));
+		}
+	}
+}
+
+#define INSTANTIATE_KERNEL(Operator) \
+	template void mapRowSSE42<Operator, EMathPrecise>(const void *constants, const float *const src[4], float *const dst[3], int count); \
+	template void mapRowSSE42<Operator, EMathFast>(const void *constants, const float *const src[4], float *const dst[3], int count);
+TONEMAP_FOR_EACH_OPERATOR(INSTANTIATE_KERNEL)
+INSTANTIATE_KERNEL(BakedLuminance)
+INSTANTIATE_KERNEL(BakedColor)
@@ -0,0 +1,103 @@
+/*
+    src/luminancetable.h -- Global luminance curve baked into a lookup table
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+#include <simd.h>
+
+/* Scale factor Ld / Lw of a global luminance curve Ld = f(Lw), sampled on
+   a logarithmic grid and linearly interpolated.
+
+   The grid uses the piecewise linear approximation of log2 given by the
+   float representation: exponent + mantissa - 1. Nodes lie at 'resolution'
+   evenly spaced mantissas per power of two, the position of a value is
+   computed with a few bit operations and the interpolation is exactly
+   linear in Lw between two nodes. */
+class LuminanceTable {
+public:
+	// Nodes per power of two and largest number of nodes
+	static const int MaxResolution = 64;
+	static const int MaxSize = 4096;
+
+	/* Samples 'curve' for Lw in [minimum, maximum], usually the luminance
+	   range of the image. The range is limited to 24 powers of two below
+	   the maximum, darker values use the scale factor at the lower end. */
+	template <typename Func>
+	LuminanceTable(const Func &curve, float minimum, float maximum) {
+		if (!(maximum > 0.f) || !std::isfinite(maximum)) maximum = 1.f;
+		minimum = std::max(minimum, std::ldexp(maximum, -24));
+
+		int exponent = (int) vexponent(minimum);
+		m_offset = (float) exponent + 1.f;
+		float octaves = vexponent(maximum) + vmantissa(maximum) - m_offset;
+		m_resolution = MaxResolution;
+		while (m_resolution > 1 && octaves * m_resolution + 2.f > MaxSize) {
+			m_resolution /= 2;
+		}
+
+		int size = std::max((int) std::ceil(octaves * m_resolution) + 1, 2);
+		m_scale = (float) m_resolution;
+		m_last = (float) (size - 1);
+		m_values.resize(size);
+		for (int i = 0; i < size; ++i) {
+			m_values[i] = ratio(curve, position(exponent, (float) i));
+		}
+
+		/* Largest error of Ld within the intervals. Relative errors are not
+		   meaningful for dark values, the curves themselves lose precision
+		   there (e.g. log(1 + Lw) in float). */
+		m_maxError = 0.f;
+		for (int i = 0; i + 1 < size; ++i) {
+			for (float t = 0.25f; t < 1.f; t += 0.25f) {
+				float Lw = position(exponent, i + t);
+				float interpolated = m_values[i] + (m_values[i + 1] - m_values[i]) * t;
+				float error = std::abs(interpolated * Lw - curve(Lw));
+				if (std::isfinite(error)) m_maxError = std::max(m_maxError, error);
+			}
+		}
+	}
+
+	// Ld / Lw for T either float or a SIMD pack
+	template <typename T>
+	inline T operator()(const T &Lw) const {
+		T x = (vexponent(Lw) + vmantissa(Lw) - m_offset) * m_scale;
+		x = vclamp(x, T(0.f), T(m_last));
+		T i = vmin(vfloor(x), T(m_last - 1.f));
+		T t = x - i;
+		T a = vgather(m_values.data(), i);
+		T b = vgather(m_values.data() + 1, i);
+		return a + (b - a) * t;
+	}
+
+	int getSize() const { return (int) m_values.size(); }
+	int getResolution() const { return m_resolution; }
+
+	// Largest absolute error of the interpolated Ld (display luminance, 1 is white), measured within all intervals
+	float getMaxError() const { return m_maxError; }
+
+private:
+	// Lw at grid position x
+	float position(int exponent, float x) const {
+		float octave = std::floor(x / m_resolution);
+		return std::ldexp(1.f + (x - octave * m_resolution) / m_resolution, exponent + (int) octave);
+	}
+
+	template <typename Func>
+	static float ratio(const Func &curve, float Lw) {
+		return curve(Lw) / Lw;
+	}
+
+	std::vector<float> 	m_values;
+	float 				m_offset;
+	float 				m_scale;
+	float 				m_last;
+	int 				m_resolution;
+	float 				m_maxError;
+};
@@ -0,0 +1,78 @@
+/*
+    src/mappedfile.cpp -- Read only view of a whole file
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <mappedfile.h>
+
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define TONEMAPPER_MMAP
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &filename, bool copyOnWrite) : m_copyOnWrite(copyOnWrite) {
+#if defined(TONEMAPPER_MMAP)
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+	struct stat info;
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+		m_size = (size_t) info.st_size;
+		if (m_size == 0) {
+			m_valid = true;
+		} else {
+			void *data = mmap(nullptr, m_size, copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED) {
+				m_data = (const uint8_t *) data;
+				m_valid = m_mapped = true;
+			}
+		}
+	}
+	close(fd);
+	if (m_valid) {
+		return;
+	}
+	m_size = 0;
+#endif
+
+	// Pipes, special files and platforms without mmap
+	FILE *file = fopen(filename.c_str(), "rb");
+	if (!file) {
+		return;
+	}
+	uint8_t chunk[65536];
+	size_t count;
+	while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+		m_buffer.insert(m_buffer.end(), chunk, chunk + count);
+	}
+	m_valid = ferror(file) == 0;
+	fclose(file);
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+}
+
+MappedFile::~MappedFile() {
+#if defined(TONEMAPPER_MMAP)
+	if (m_mapped) {
+		munmap((void *) m_data, m_size);
+	}
+#endif
+}
+
+void MappedFile::adviseSequential() const {
+#if defined(TONEMAPPER_MMAP)
+	if (m_mapped) {
+		madvise((void *) m_data, m_size, MADV_SEQUENTIAL);
+	}
+#endif
+}
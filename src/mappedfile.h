@@ -0,0 +1,45 @@
+/*
+    src/mappedfile.h -- Read only view of a whole file
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+
+/* Contents of a file, memory mapped on POSIX systems and read into a heap
+   buffer elsewhere. Mapped pages belong to the page cache, so decoding
+   from them does not need a private copy of the file. With 'copyOnWrite'
+   the contents can be modified, pages are copied when they are first
+   written and the file itself never changes. */
+class MappedFile {
+public:
+	explicit MappedFile(const std::string &filename, bool copyOnWrite = false);
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	bool isValid() const { return m_valid; }
+	bool isMapped() const { return m_mapped; }
+
+	const uint8_t *getData() const { return m_data; }
+	// Modifiable contents, only with 'copyOnWrite'
+	uint8_t *getMutableData() const { return m_copyOnWrite ? (uint8_t *) m_data : nullptr; }
+	size_t getSize() const { return m_size; }
+
+	// The file will be read front to back, the kernel reads ahead and drops pages behind
+	void adviseSequential() const;
+
+private:
+	const uint8_t 			*m_data = nullptr;
+	size_t 					m_size = 0;
+	bool 					m_valid = false;
+	bool 					m_mapped = false;
+	bool 					m_copyOnWrite = false;
+	std::vector<uint8_t> 	m_buffer;
+};
@@ -0,0 +1,56 @@
+/*
+    src/operators/all.h -- Includes all tonemapping operators
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <operators/clamping.h>
+#include <operators/drago.h>
+#include <operators/exponential.h>
+#include <operators/exponentiation.h>
+#include <operators/ferwerda.h>
+#include <operators/filmic1.h>
+#include <operators/filmic2.h>
+#include <operators/insomniac.h>
+#include <operators/uncharted.h>
+#include <operators/aces.h>
+#include <operators/linear.h>
+#include <operators/logarithmic.h>
+#include <operators/maxdivision.h>
+#include <operators/meanvalue.h>
+#include <operators/reinhard.h>
+#include <operators/reinhard_devlin.h>
+#include <operators/reinhard_extended.h>
+#include <operators/schlick.h>
+#include <operators/srgb.h>
+#include <operators/tumblin_rushmeier.h>
+#include <operators/ward.h>
+
+// Calls F(Operator) for all operators, in the order they are presented to the user
+#define TONEMAP_FOR_EACH_OPERATOR(F) \
+	F(LinearOperator) \
+	F(SRGBOperator) \
+	F(ReinhardOperator) \
+	F(ExtendedReinhardOperator) \
+	F(WardOperator) \
+	F(FerwerdaOperator) \
+	F(SchlickOperator) \
+	F(TumblinRushmeierOperator) \
+	F(DragoOperator) \
+	F(ReinhardDevlinOperator) \
+	F(Filmic1Operator) \
+	F(Filmic2Operator) \
+	F(UnchartedOperator) \
+	F(ACESOperator) \
+	F(InsomniacOperator) \
+	F(MaximumDivisionOperator) \
+	F(MeanValueOperator) \
+	F(ClampingOperator) \
+	F(LogarithmicOperator) \
+	F(ExponentialOperator) \
+	F(ExponentiationOperator)
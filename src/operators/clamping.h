@@ -9,17 +9,22 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class ClampingOperator : public TonemapOperator {
+class ClampingOperator : public LuminanceKernelOperator<ClampingOperator> {
 public:
-	ClampingOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
+	struct Param {
+		enum { Gamma, p };
+	};
+
+	ClampingOperator() : LuminanceKernelOperator<ClampingOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::p, "p", Parameter(1.f, 0.f, 1.f, "p", "Minimal value that is mapped to 1."));
 
 		name = "Clamping";
 		description = "Clamping\n\nUser defined maximum value that maps to 1.\nDiscussed in \"Quantization Techniques for Visualization of High Dynamic Range Pictures\" by Schlick 1994.";
 		
-		shader->init(
+		setShader(
 			"Clamping",
 
 			"#version 330\n"
@@ -71,48 +76,31 @@ public:
 		float max = image->getMaximumLuminance();
 		float start = 0.5f * (min + max);
 
-		parameters["p"] = Parameter(start, min, max, "p", "Minimal value that is mapped to 1.");
+		parameters.setRange(Param::p, start, min, max);
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float p = parameters.at("p").value;
+	struct Constants {
+		float scale;
+	};
 
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, p);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		Constants k;
+		k.scale = exposure / (exposure * parameters[Param::p]);
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float p = parameters.at("p").value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
 
-		value = map(value, 1.f, p);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		return k.scale * Lw;
 	}
 
-protected:
-	float map(float Lw, float exposure, float p) const {
-		float L = exposure * Lw;
-		float Ld = L / (exposure * p);
-		return Ld;
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
@@ -9,21 +9,27 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class DragoOperator : public TonemapOperator {
+class DragoOperator : public LuminanceKernelOperator<DragoOperator> {
 public:
-	DragoOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
-		parameters["slope"] = Parameter(4.5f, 0.f, 10.f, "slope", "Additional Gamma correction parameter:\nElevation ratio of the line passing by the origin and tangent to the curve.");
-		parameters["start"] = Parameter(0.018f, 0.f, 2.f, "start", "Additional Gamma correction parameter:\nAbscissa at the point of tangency.");
-		parameters["Ldmax"] = Parameter(100.f, 0.f, 200.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)");
-		parameters["b"] = Parameter(0.85f, 0.f, 1.f, "b", "Bias function parameter");
+	struct Param {
+		enum { Gamma, slope, start, Ldmax, b, Lwa, Lwmax };
+	};
+
+	DragoOperator() : LuminanceKernelOperator<DragoOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::slope, "slope", Parameter(4.5f, 0.f, 10.f, "slope", "Additional Gamma correction parameter:\nElevation ratio of the line passing by the origin and tangent to the curve."));
+		parameters.declare(Param::start, "start", Parameter(0.018f, 0.f, 2.f, "start", "Additional Gamma correction parameter:\nAbscissa at the point of tangency."));
+		parameters.declare(Param::Ldmax, "Ldmax", Parameter(100.f, 0.f, 200.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)"));
+		parameters.declare(Param::b, "b", Parameter(0.85f, 0.f, 1.f, "b", "Bias function parameter"));
+		parameters.declare(Param::Lwa, "Lwa", Parameter(1.f, "Lwa"));
+		parameters.declare(Param::Lwmax, "Lwmax", Parameter(1.f, "Lwmax"));
 
 		name = "Drago";
 		description = "Drago Mapping\n\nPropsed in \"Adaptive Logarithmic Mapping For Displaying High Contrast Scenes\" by Drago et al. 2003.";
 
-		shader->init(
+		setShader(
 			"Drago",
 
 			"#version 330\n"
@@ -86,77 +92,46 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lwa"] = Parameter(image->getLogAverageLuminance(), "Lwa");
-		parameters["Lwmax"] = Parameter(image->getMaximumLuminance(), "Lwmax");
+		parameters[Param::Lwa] = image->getLogAverageLuminance();
+		parameters[Param::Lwmax] = image->getMaximumLuminance();
+	};
+
+	struct Constants {
+		float scale;
+		float invLwmax;
+		float exponent;
+		float c1;
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Ldmax = parameters.at("Ldmax").value;
-		float Lwa = parameters.at("Lwa").value;
-		float Lwmax = parameters.at("Lwmax").value;
-		float b = parameters.at("b").value;
-		float start = parameters.at("start").value;
-		float slope = parameters.at("slope").value;
-
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, Ldmax, Lwa, Lwmax, b);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = Color3f(gammaCorrect(c.r(), gamma, start, slope),
-							gammaCorrect(c.g(), gamma, start, slope),
-							gammaCorrect(c.b(), gamma, start, slope));
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		float Ldmax = parameters[Param::Ldmax];
+		float b = parameters[Param::b];
+
+		float Lwa = exposure * parameters[Param::Lwa] / std::pow(1.f + b - 0.85f, 5.f);
+		float Lwmax = exposure * parameters[Param::Lwmax] / Lwa;
+
+		Constants k;
+		k.scale = exposure / Lwa;
+		k.invLwmax = 1.f / Lwmax;
+		k.exponent = std::log(b) / std::log(0.5f);
+		k.c1 = (0.01f * Ldmax) / std::log10(1.f + Lwmax);
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Ldmax = parameters.at("Ldmax").value;
-		float Lwa = parameters.at("Lwa").value;
-		float Lwmax = parameters.at("Lwmax").value;
-		float b = parameters.at("b").value;
-		float start = parameters.at("start").value;
-		float slope = parameters.at("slope").value;
-
-		value = map(value, 1.f, Ldmax, Lwa, Lwmax, b);
-		value = clamp(value, 0.f, 1.f);
-		value = gammaCorrect(value, gamma, start, slope);
-		return value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::segmentedGamma(0.9f / parameters[Param::Gamma], parameters[Param::start], parameters[Param::slope]);
 	}
 
-protected:
-	float map(float Lw, float exposure, float Ldmax, float Lwa, float Lwmax, float b) const {
-		Lwa = exposure * Lwa / std::pow(1.f + b - 0.85f, 5.f);
-		Lwmax = exposure * Lwmax / Lwa;
-		float L = exposure * Lw / Lwa;
-		
-		float exponent = std::log(b) / std::log(0.5f);
-		float c1 = (0.01f * Ldmax) / std::log10(1.f + Lwmax);
-		float c2 = std::log(1.f + L) / std::log(2.f + 8.f * (std::pow(L / Lwmax, exponent)));
-		float Ld = c1 * c2;
-
-		return Ld;
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		T L = k.scale * Lw;
+		T c2 = vlog(1.f + L) / vlog(2.f + 8.f * vpow(L * k.invLwmax, k.exponent));
+		return k.c1 * c2;
 	}
 
-	float gammaCorrect(float Ld, float gamma, float start, float slope) const {
-		if (Ld <= start) {
-			return slope * Ld;
-		}
-		else {
-			return std::pow(1.099 * Ld, 0.9/gamma) - 0.099;
-		}
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
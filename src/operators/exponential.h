@@ -9,19 +9,24 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class ExponentialOperator : public TonemapOperator {
+class ExponentialOperator : public LuminanceKernelOperator<ExponentialOperator> {
 public:
-	ExponentialOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
-		parameters["p"] = Parameter(1.f, 0.f, 20.f, "p", "Exponent numerator scale factor");
-		parameters["q"] = Parameter(1.f, 0.f, 20.f, "q", "Exponent denominator scale factor");
+	struct Param {
+		enum { Gamma, p, q, Lavg };
+	};
+
+	ExponentialOperator() : LuminanceKernelOperator<ExponentialOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::p, "p", Parameter(1.f, 0.f, 20.f, "p", "Exponent numerator scale factor"));
+		parameters.declare(Param::q, "q", Parameter(1.f, 0.f, 20.f, "q", "Exponent denominator scale factor"));
+		parameters.declare(Param::Lavg, "Lavg", Parameter(1.f, "Lavg"));
 
 		name = "Exponential";
 		description = "Exponential Mapping\n\nProposed in \"A Comparison of techniques for the Transformation of Radiosity Values to Monitor Colors\" by Ferschin et al. 1994.";
 
-		shader->init(
+		setShader(
 			"Exponential",
 
 			"#version 330\n"
@@ -71,52 +76,35 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lavg"] = Parameter(image->getAverageLuminance(), "Lavg");
+		parameters[Param::Lavg] = image->getAverageLuminance();
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Lavg = parameters.at("Lavg").value;
-		float p = parameters.at("p").value;
-		float q = parameters.at("q").value;
-
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, Lavg, p, q);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	struct Constants {
+		float scale;
+	};
+
+	Constants prepare(float exposure) const {
+		float Lavg = parameters[Param::Lavg];
+		float p = parameters[Param::p];
+		float q = parameters[Param::q];
+
+		Constants k;
+		k.scale = -(exposure * p) / (exposure * Lavg * q);
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Lavg = parameters.at("Lavg").value;
-		float p = parameters.at("p").value;
-		float q = parameters.at("q").value;
-
-		value = map(value, 1.f, Lavg, p, q);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
+
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		return 1.f - vexp(k.scale * Lw);
 	}
 
-protected:
-	float map(float Lw, float exposure, float Lavg, float p, float q) const {
-		float L = exposure * Lw;
-		float Ld = 1.f - std::exp(-(L * p) / (exposure * Lavg * q));
-		return Ld;
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
@@ -9,18 +9,23 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class ExponentiationOperator : public TonemapOperator {
+class ExponentiationOperator : public LuminanceKernelOperator<ExponentiationOperator> {
 public:
-	ExponentiationOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
-		parameters["p"] = Parameter(0.5f, 0.f, 1.f, "p", "Curve exponent parameter");
+	struct Param {
+		enum { Gamma, p, Lmax };
+	};
+
+	ExponentiationOperator() : LuminanceKernelOperator<ExponentiationOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::p, "p", Parameter(0.5f, 0.f, 1.f, "p", "Curve exponent parameter"));
+		parameters.declare(Param::Lmax, "Lmax", Parameter(1.f, "Lmax"));
 
 		name = "Exponentiation";
 		description = "Exponentiation Mapping\n\nDiscussed in \"Quantization Techniques for Visualization of High Dynamic Range Pictures\" by Schlick 1994.";
 
-		shader->init(
+		setShader(
 			"Exponentiation",
 
 			"#version 330\n"
@@ -69,50 +74,31 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lmax"] = Parameter(image->getMaximumLuminance(), "Lmax");
+		parameters[Param::Lmax] = image->getMaximumLuminance();
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Lmax = parameters.at("Lmax").value;
-		float p = parameters.at("p").value;
+	struct Constants {
+		float scale;
+	};
 
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, Lmax);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma / p);	// Include p in gamma correction
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		Constants k;
+		k.scale = exposure / (exposure * parameters[Param::Lmax]);
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Lmax = parameters.at("Lmax").value;
-		float p = parameters.at("p").value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(parameters[Param::p] / parameters[Param::Gamma]);	// Include p in gamma correction
+	}
 
-		value = map(value, 1.f, Lmax);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, p / gamma);	// Include p in gamma correction
-		return value;
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		return k.scale * Lw;
 	}
 
-protected:
-	float map(float Lw, float exposure, float Lmax) const {
-		float L = exposure * Lw;
-		float Ld = L / (exposure * Lmax);
-		return Ld;
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
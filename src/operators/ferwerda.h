@@ -9,18 +9,23 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class FerwerdaOperator : public TonemapOperator {
+class FerwerdaOperator : public LuminanceKernelOperator<FerwerdaOperator> {
 public:
-	FerwerdaOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
-		parameters["Ldmax"] = Parameter(80.f, 0.f, 160.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)");
+	struct Param {
+		enum { Gamma, Ldmax, Lwa };
+	};
+
+	FerwerdaOperator() : LuminanceKernelOperator<FerwerdaOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::Ldmax, "Ldmax", Parameter(80.f, 0.f, 160.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)"));
+		parameters.declare(Param::Lwa, "Lwa", Parameter(1.f, "Lwa"));
 
 		name = "Ferwerda";
 		description = "Ferwerda Mapping\n\nProposed in \"A Model of Visual Adaptation for Realistic Image Synthesis\" by Ferwerda et al. 1996.";
 
-		shader->init(
+		setShader(
 			"Ferwerda",
 
 			"#version 330\n"
@@ -104,64 +109,47 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lwa"] = Parameter(image->getMaximumLuminance() / 2.f, "Lwa");
+		parameters[Param::Lwa] = image->getMaximumLuminance() / 2.f;
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Lwa = parameters.at("Lwa").value;
-		float Ldmax = parameters.at("Ldmax").value;
-
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, Lwa, Ldmax);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
-	}
-
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Lwa = parameters.at("Lwa").value;
-		float Ldmax = parameters.at("Ldmax").value;
-
-		value = map(Color3f(value), 1.f, Lwa, Ldmax);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
-	}
+	struct Constants {
+		float scale;
+	};
 
-protected:
-	float map(const Color3f &c, float exposure, float Lwa, float Ldmax) const {
+	// Photopic and scotopic scale factors only depend on the adaptation luminances
+	Constants prepare(float exposure) const {
+		float Lwa = parameters[Param::Lwa];
+		float Ldmax = parameters[Param::Ldmax];
 		float Lda = Ldmax / 2.f;
-		Color3f color = exposure * c;
-		float L = color.getLuminance();
 
 		float mP = tp(Lda) / tp(exposure * Lwa);
 		float mS = ts(Lda) / ts(exposure * Lwa);
 
-		float k = (1.f - (Lwa / 2.f - 0.01f) / (10.f - 0.01f));
-		k = clamp(k * k, 0.f, 1.f);
+		float s = (1.f - (Lwa / 2.f - 0.01f) / (10.f - 0.01f));
+		s = clamp(s * s, 0.f, 1.f);
+
+		Constants k;
+		k.scale = exposure * (mP + s * mS);
+		return k;
+	}
+
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
 
-		float Ld = mP * L + k * mS * L;
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		return k.scale * Lw;
+	}
 
-		return Ld;
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
 
-	inline float tp(float La) const {
+protected:
+	static float tp(float La) {
 		float logLa = std::log10(La);
 		float result;
 		if (logLa <= -2.6f) {
@@ -176,7 +164,7 @@ protected:
 		return std::pow(10.f, result);
 	}
 
-	inline float ts(float La) const {
+	static float ts(float La) {
 		float logLa = std::log10(La);
 		float result;
 		if (logLa <= -3.94f) {
@@ -190,4 +178,4 @@ protected:
 		}
 		return std::pow(10.f, result);
 	}
-};
\ No newline at end of file
+};
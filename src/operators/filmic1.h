@@ -9,15 +9,15 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class Filmic1Operator : public TonemapOperator {
+class Filmic1Operator : public TonemapKernelOperator<Filmic1Operator> {
 public:
-	Filmic1Operator() : TonemapOperator() {
+	Filmic1Operator() : TonemapKernelOperator<Filmic1Operator>() {
 		name = "Filmic 1";
 		description = "Filmic Mapping 1\n\nBy Jim Hejl and Richard Burgess-Dawson from the \"Filmic Tonemapping for Real-time Rendering\" Siggraph 2010 Course by Haarm-Pieter Duiker.";
 
-		shader->init(
+		setShader(
 			"Filmic 1",
 
 			"#version 330\n"
@@ -48,35 +48,33 @@ public:
 		);
 	}
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
+	struct Constants {
+		float exposure;
+	};
 
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				Color3f c = Color3f(map(color.r(), exposure),
-									map(color.g(), exposure),
-									map(color.b(), exposure));
-				c = c.clampedValue();
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		Constants k;
+		k.exposure = exposure;
+		return k;
 	}
 
-	float graph(float value) const override {
-		return map(value, 1.f);
+	// Gamma correction is part of the curve
+	template <typename T>
+	static inline T curve(const Constants &k, T v) {
+		T value = k.exposure * v;
+		value = vmax(T(0.f), value - 0.004f);
+		return (value * (6.2f * value + 0.5f)) / (value * (6.2f * value + 1.7f) + 0.06f);
 	}
 
-protected:
-	float map(float v, float exposure) const {
-		float value = exposure * v;
-		value = std::max(0.f, value - 0.004f);
-		return (value * (6.2f * value + 0.5f)) / (value * (6.2f * value + 1.7f) + 0.06f);
+	template <typename T>
+	static inline void map(const Constants &k, T &r, T &g, T &b) {
+		r = curve(k, r);
+		g = curve(k, g);
+		b = curve(k, b);
+	}
+
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		return curve(k, value);
 	}
-};
\ No newline at end of file
+};
@@ -9,17 +9,21 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class Filmic2Operator : public TonemapOperator {
+class Filmic2Operator : public TonemapKernelOperator<Filmic2Operator> {
 public:
-	Filmic2Operator() : TonemapOperator() {
-		parameters["Cutoff"] = Parameter(0.025, 0.f, 0.5f, "cutoff", "Transition into compressed blacks");
+	struct Param {
+		enum { Cutoff };
+	};
+
+	Filmic2Operator() : TonemapKernelOperator<Filmic2Operator>() {
+		parameters.declare(Param::Cutoff, "Cutoff", Parameter(0.025, 0.f, 0.5f, "cutoff", "Transition into compressed blacks"));
 
 		name = "Filmic 2";
 		description = "Filmic Mapping 2\n\nBy Graham Aldridge from \"Approximating Film with Tonemapping\".";
 
-		shader->init(
+		setShader(
 			"Filmic 2",
 
 			"#version 330\n"
@@ -51,38 +55,39 @@ public:
 		);
 	}
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
+	struct Constants {
+		float exposure;
+		float cutoff;
+		float twoCutoff;
+		float toeScale;
+	};
 
-		float cutoff = parameters.at("Cutoff").value;
+	Constants prepare(float exposure) const {
+		float cutoff = parameters[Param::Cutoff];
+		Constants k;
+		k.exposure = exposure;
+		k.cutoff = cutoff;
+		k.twoCutoff = cutoff * 2.f;
+		k.toeScale = 0.25f / cutoff;
+		return k;
+	}
 
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				Color3f c = Color3f(map(color.r(), cutoff, exposure),
-									map(color.g(), cutoff, exposure),
-									map(color.b(), cutoff, exposure));
-				c = c.clampedValue();
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	template <typename T>
+	static inline T curve(const Constants &k, T v) {
+		T value = k.exposure * v;
+		value += (k.twoCutoff - value) * vclamp(k.twoCutoff - value, T(0.f), T(1.f)) * k.toeScale - k.cutoff;
+		return (value * (6.2f * value + 0.5f)) / (value * (6.2f * value + 1.7f) + 0.06f);
 	}
 
-	float graph(float value) const override {
-		float cutoff = parameters.at("Cutoff").value;
-		return map(value, cutoff, 1.f);
+	template <typename T>
+	static inline void map(const Constants &k, T &r, T &g, T &b) {
+		r = curve(k, r);
+		g = curve(k, g);
+		b = curve(k, b);
 	}
 
-protected:
-	float map(float v, float cutoff, float exposure) const {
-		float value = exposure * v;
-		value += (cutoff * 2.0 - value) * clamp(cutoff * 2.0 - value, 0.0, 1.0) * (0.25 / cutoff) - cutoff;
-		return (value * (6.2f * value + 0.5f)) / (value * (6.2f * value + 1.7f) + 0.06f);
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		return curve(k, value);
 	}
-};
\ No newline at end of file
+};
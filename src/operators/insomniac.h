@@ -9,22 +9,27 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class InsomniacOperator : public TonemapOperator {
+class InsomniacOperator : public TonemapKernelOperator<InsomniacOperator> {
 public:
-	InsomniacOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
-		parameters["w"] = Parameter(10.f, 0.f, 20.f, "w", "White point\nMinimal value that is mapped to 1.");
-		parameters["b"] = Parameter(0.1f, 0.f, 2.f, "b", "Black point\nMaximal value that is mapped to 0.");
-		parameters["t"] = Parameter(0.7f, 0.f, 1.f, "t", "Toe strength\nAmount of blending between a straight-line curve and a purely asymptotic curve for the toe.");
-		parameters["s"] = Parameter(0.8f, 0.f, 1.f, "s", "Shoulder strength\nAmount of blending between a straight-line curve and a purely asymptotic curve for the shoulder.");
-		parameters["c"] = Parameter(2.f, 0.f, 10.f, "c", "Cross-over point\nPoint where the toe and shoulder are pieced together into a single curve.");
+	struct Param {
+		enum { Gamma, w, b, t, s, c, Lavg };
+	};
+
+	InsomniacOperator() : TonemapKernelOperator<InsomniacOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::w, "w", Parameter(10.f, 0.f, 20.f, "w", "White point\nMinimal value that is mapped to 1."));
+		parameters.declare(Param::b, "b", Parameter(0.1f, 0.f, 2.f, "b", "Black point\nMaximal value that is mapped to 0."));
+		parameters.declare(Param::t, "t", Parameter(0.7f, 0.f, 1.f, "t", "Toe strength\nAmount of blending between a straight-line curve and a purely asymptotic curve for the toe."));
+		parameters.declare(Param::s, "s", Parameter(0.8f, 0.f, 1.f, "s", "Shoulder strength\nAmount of blending between a straight-line curve and a purely asymptotic curve for the shoulder."));
+		parameters.declare(Param::c, "c", Parameter(2.f, 0.f, 10.f, "c", "Cross-over point\nPoint where the toe and shoulder are pieced together into a single curve."));
+		parameters.declare(Param::Lavg, "Lavg", Parameter(1.f, "Lavg"));
 
 		name = "Insomniac (Day)";
 		description = "Insomniac Mapping\n\nFrom \"An efficient and user-friendly tone mapping operator\" by Mike Day (Insomniac Games).";
 
-		shader->init(
+		setShader(
 			"Insomniac",
 
 			"#version 330\n"
@@ -78,64 +83,61 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lavg"] = Parameter(image->getAverageLuminance(), "Lavg");
+		parameters[Param::Lavg] = image->getAverageLuminance();
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Lavg = parameters.at("Lavg").value;
-		float w = parameters.at("w").value;
-		float b = parameters.at("b").value;
-		float t = parameters.at("t").value;
-		float s = parameters.at("s").value;
-		float c = parameters.at("c").value;
-
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				Color3f col = Color3f(	map(color.r(), exposure, gamma, Lavg, w, b, t, s, c),
-										map(color.g(), exposure, gamma, Lavg, w, b, t, s, c),
-										map(color.b(), exposure, gamma, Lavg, w, b, t, s, c));
-				col = col.clampedValue();
-				dst[0] = (uint8_t) (255.f * col.r());
-				dst[1] = (uint8_t) (255.f * col.g());
-				dst[2] = (uint8_t) (255.f * col.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
-	}
+	struct Constants {
+		float scale;
+		float b, c, s, t;
+		float toeScale;
+		float toeOffset;
+		float shoulderOffset;
+		float k;
+		float invGamma;
+	};
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Lavg = parameters.at("Lavg").value;
-		float w = parameters.at("w").value;
-		float b = parameters.at("b").value;
-		float t = parameters.at("t").value;
-		float s = parameters.at("s").value;
-		float c = parameters.at("c").value;
-
-		return map(value, 1.f, gamma, Lavg, w, b, t, s, c);
+	Constants prepare(float exposure) const {
+		float w = parameters[Param::w];
+		float b = parameters[Param::b];
+		float t = parameters[Param::t];
+		float s = parameters[Param::s];
+		float c = parameters[Param::c];
+
+		Constants k;
+		k.scale = exposure / (exposure * parameters[Param::Lavg]);
+		k.b = b;
+		k.c = c;
+		k.s = s;
+		k.t = t;
+		k.k = (1.f-t)*(c-b) / ((1.f-s)*(w-c) + (1.f-t)*(c-b));
+		k.toeScale = k.k * (1.f-t);
+		k.toeOffset = c - (1.f-t)*b;
+		k.shoulderOffset = (1.f-s)*w - c;
+		k.invGamma = 1.f / parameters[Param::Gamma];
+		return k;
 	}
 
-protected:
-	float map(float v, float exposure, float gamma, float Lavg, float w, float b, float t, float s, float c) const {
-		float value = exposure * v;
-		value = value / (exposure * Lavg);
+	// Gamma correction is applied before clamping
+	template <typename T>
+	static inline T curve(const Constants &k, T v) {
+		T value = k.scale * v;
 
-		float k = (1.f-t)*(c-b) / ((1.f-s)*(w-c) + (1.f-t)*(c-b));
+		T toe = k.toeScale * (value - k.b) / (k.toeOffset - k.t*value);
+		T shoulder = (1.f - k.k) * (value - k.c) / (k.s*value + k.shoulderOffset) + k.k;
+		value = vselect(value < k.c, toe, shoulder);
 
-		if (value < c) {
-			value = k * (1.f-t)*(value-b) / (c - (1.f-t)*b - t*value);
-		}
-		else {
-			value = (1.f-k)*(value-c) / (s*value + (1.f-s)*w - c) + k;
-		}
+		return vpow(value, k.invGamma);
+	}
+
+	template <typename T>
+	static inline void map(const Constants &k, T &r, T &g, T &b) {
+		r = curve(k, r);
+		g = curve(k, g);
+		b = curve(k, b);
+	}
 
-		return std::pow(value, 1.f / gamma);
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		return curve(k, value);
 	}
-};
\ No newline at end of file
+};
@@ -9,17 +9,21 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class LinearOperator : public TonemapOperator {
+class LinearOperator : public TonemapKernelOperator<LinearOperator> {
 public:
-	LinearOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
+	struct Param {
+		enum { Gamma };
+	};
+
+	LinearOperator() : TonemapKernelOperator<LinearOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
 
 		name = "Linear";
 		description = "Linear Mapping\n\nGamma correction only.";
 
-		shader->init(
+		setShader(
 			"Linear",
 
 			"#version 330\n"
@@ -55,32 +59,28 @@ public:
 		);
 	}
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
+	struct Constants {
+		float exposure;
+	};
+
+	Constants prepare(float exposure) const {
+		Constants k;
+		k.exposure = exposure;
+		return k;
+	}
 
-		float gamma = parameters.at("Gamma").value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
 
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				Color3f c = exposure * color;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	template <typename T>
+	static inline void map(const Constants &k, T &r, T &g, T &b) {
+		r = k.exposure * r;
+		g = k.exposure * g;
+		b = k.exposure * b;
 	}
 
 	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
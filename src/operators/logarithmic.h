@@ -9,19 +9,24 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class LogarithmicOperator : public TonemapOperator {
+class LogarithmicOperator : public LuminanceKernelOperator<LogarithmicOperator> {
 public:
-	LogarithmicOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
-		parameters["p"] = Parameter(1.f, 0.f, 20.f, "p", "Exponent numerator scale factor");
-		parameters["q"] = Parameter(1.f, 0.f, 20.f, "q", "Exponent denominator scale factor");
+	struct Param {
+		enum { Gamma, p, q, Lmax };
+	};
+
+	LogarithmicOperator() : LuminanceKernelOperator<LogarithmicOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::p, "p", Parameter(1.f, 0.f, 20.f, "p", "Exponent numerator scale factor"));
+		parameters.declare(Param::q, "q", Parameter(1.f, 0.f, 20.f, "q", "Exponent denominator scale factor"));
+		parameters.declare(Param::Lmax, "Lmax", Parameter(1.f, "Lmax"));
 
 		name = "Logarithmic";
 		description = "Logarthmic Mapping\n\nDiscussed in \"Quantization Techniques for Visualization of High Dynamic Range Pictures\" by Schlick 1994.";
 
-		shader->init(
+		setShader(
 			"Logarithmic",
 
 			"#version 330\n"
@@ -71,52 +76,37 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lmax"] = Parameter(image->getMaximumLuminance(), "Lmax");
+		parameters[Param::Lmax] = image->getMaximumLuminance();
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Lmax = parameters.at("Lmax").value;
-		float p = parameters.at("p").value;
-		float q = parameters.at("q").value;
-
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, Lmax, p, q);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	struct Constants {
+		float scale;
+		float invDenominator;
+	};
+
+	Constants prepare(float exposure) const {
+		float Lmax = parameters[Param::Lmax];
+		float p = parameters[Param::p];
+		float q = parameters[Param::q];
+
+		Constants k;
+		k.scale = p * exposure;
+		k.invDenominator = 1.f / std::log10(1.f + q * exposure * Lmax);
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Lmax = parameters.at("Lmax").value;
-		float p = parameters.at("p").value;
-		float q = parameters.at("q").value;
-
-		value = map(value, 1.f, Lmax, p, q);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
+
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		return vlog10(1.f + k.scale * Lw) * k.invDenominator;
 	}
 
-protected:
-	float map(float Lw, float exposure, float Lmax, float p, float q) const {
-		float L = exposure * Lw;
-		float Ld = std::log10(1.f + p * L) / std::log10(1.f + q * exposure * Lmax);
-		return Ld;
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
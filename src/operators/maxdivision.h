@@ -9,17 +9,22 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class MaximumDivisionOperator : public TonemapOperator {
+class MaximumDivisionOperator : public LuminanceKernelOperator<MaximumDivisionOperator> {
 public:
-	MaximumDivisionOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
+	struct Param {
+		enum { Gamma, Lmax };
+	};
+
+	MaximumDivisionOperator() : LuminanceKernelOperator<MaximumDivisionOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::Lmax, "Lmax", Parameter(1.f, "Lmax"));
 
 		name = "Division by maximum";
 		description = "Division by maximum\n\nMaximum value is mapped to 1.";
 
-		shader->init(
+		setShader(
 			"MaximumDivision",
 
 			"#version 330\n"
@@ -67,48 +72,31 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lmax"] = Parameter(image->getMaximumLuminance(), "Lmax");
+		parameters[Param::Lmax] = image->getMaximumLuminance();
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Lmax = parameters.at("Lmax").value;
+	struct Constants {
+		float scale;
+	};
 
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, Lmax);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		Constants k;
+		k.scale = exposure / (exposure * parameters[Param::Lmax]);
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Lmax = parameters.at("Lmax").value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
 
-		value = map(value, 1.f, Lmax);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		return k.scale * Lw;
 	}
 
-protected:
-	float map(float Lw, float exposure, float Lmax) const {
-		float L = exposure * Lw;
-		float Ld = L / (exposure * Lmax);
-		return Ld;
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
@@ -9,17 +9,22 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class MeanValueOperator : public TonemapOperator {
+class MeanValueOperator : public LuminanceKernelOperator<MeanValueOperator> {
 public:
-	MeanValueOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
+	struct Param {
+		enum { Gamma, Lavg };
+	};
+
+	MeanValueOperator() : LuminanceKernelOperator<MeanValueOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::Lavg, "Lavg", Parameter(1.f, "Lavg"));
 
 		name = "Mean Value Mapping";
 		description = "Mean Value Mapping\n\nMean value is mapped to 0.5.";
 
-		shader->init(
+		setShader(
 			"MeanValue",
 
 			"#version 330\n"
@@ -67,48 +72,31 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lavg"] = Parameter(image->getAverageLuminance(), "Lavg");
+		parameters[Param::Lavg] = image->getAverageLuminance();
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Lavg = parameters.at("Lavg").value;
+	struct Constants {
+		float scale;
+	};
 
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, Lavg);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		Constants k;
+		k.scale = 0.5f * exposure / (exposure * parameters[Param::Lavg]);
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Lavg = parameters.at("Lavg").value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
 
-		value = map(value, 1.f, Lavg);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		return k.scale * Lw;
 	}
 
-protected:
-	float map(float Lw, float exposure, float Lavg) const {
-		float L = exposure * Lw;
-		float Ld = 0.5f * L / (exposure * Lavg);
-		return Ld;
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
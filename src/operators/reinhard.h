@@ -9,17 +9,21 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class ReinhardOperator : public TonemapOperator {
+class ReinhardOperator : public LuminanceKernelOperator<ReinhardOperator> {
 public:
-	ReinhardOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
+	struct Param {
+		enum { Gamma };
+	};
+
+	ReinhardOperator() : LuminanceKernelOperator<ReinhardOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
 
 		name = "Reinhard";
 		description = "Reinhard Mapping\n\nProposed in \"Photographic Tone Reproduction for Digital Images\" by Reinhard et al. 2002.\n(Simple operator)";
 
-		shader->init(
+		setShader(
 			"Reinhard",
 
 			"#version 330\n"
@@ -65,43 +69,29 @@ public:
 		);
 	}
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
+	struct Constants {
+		float exposure;
+	};
 
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		Constants k;
+		k.exposure = exposure;
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
 
-		value = map(value, 1.f);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		T L = k.exposure * Lw;
+		return L / (1.f + L);
 	}
 
-protected:
-	float map(float Lw, float exposure) const {
-		float L = exposure * Lw;
-		float Ld = L / (1.f + L);
-		return Ld;
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
@@ -9,21 +9,29 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class ReinhardDevlinOperator : public TonemapOperator {
+class ReinhardDevlinOperator : public TonemapKernelOperator<ReinhardDevlinOperator> {
 public:
-	ReinhardDevlinOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
-		parameters["m"] = Parameter(0.5f, 0.f, 1.f, "m", "Compression curve adjustment parameter");
-		parameters["f"] = Parameter(1.f, 0.f, 1000.f, "f", "Intensity adjustment parameter");
-		parameters["c"] = Parameter(0.f, 0.f, 1.f, "c", "Chromatic adaptation\nBlend between color channels and luminance.");
-		parameters["a"] = Parameter(1.f, 0.f, 1.f, "a", "Light adaptation\nBlend between pixel intensity and average scene intensity.");
+	struct Param {
+		enum { Gamma, m, f, c, a, Iav_r, Iav_g, Iav_b, Lav };
+	};
+
+	ReinhardDevlinOperator() : TonemapKernelOperator<ReinhardDevlinOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::m, "m", Parameter(0.5f, 0.f, 1.f, "m", "Compression curve adjustment parameter"));
+		parameters.declare(Param::f, "f", Parameter(1.f, 0.f, 1000.f, "f", "Intensity adjustment parameter"));
+		parameters.declare(Param::c, "c", Parameter(0.f, 0.f, 1.f, "c", "Chromatic adaptation\nBlend between color channels and luminance."));
+		parameters.declare(Param::a, "a", Parameter(1.f, 0.f, 1.f, "a", "Light adaptation\nBlend between pixel intensity and average scene intensity."));
+		parameters.declare(Param::Iav_r, "Iav_r", Parameter(1.f, "Iav_r"));
+		parameters.declare(Param::Iav_g, "Iav_g", Parameter(1.f, "Iav_g"));
+		parameters.declare(Param::Iav_b, "Iav_b", Parameter(1.f, "Iav_b"));
+		parameters.declare(Param::Lav, "Lav", Parameter(1.f, "Lav"));
 
 		name = "Reinhard-Devlin";
 		description = "Reinhard-Devlin Mapping\n\nPropsed in \"Dynamic Range Reduction Inspired by Photoreceptor Physiology\" by Reinhard and Devlin 2005.";
 
-		shader->init(
+		setShader(
 			"ReinhardDevlin",
 
 			"#version 330\n"
@@ -91,82 +99,67 @@ public:
 		float Lmin = image->getMinimumLuminance();
 		float k = (std::log(Lmax) - std::log(Llav)) / (std::log(Lmax) - std::log(Lmin));
 		float m = 0.3f + 0.7f * std::pow(k, 1.4f);
-		parameters.at("m").defaultValue = m;
-		parameters.at("m").value = m;
+		parameters.info(Param::m).defaultValue = m;
+		parameters[Param::m] = m;
 
-		parameters["Iav_r"] = Parameter(image->getAverageIntensity().r(), "Iav_r");
-		parameters["Iav_g"] = Parameter(image->getAverageIntensity().r(), "Iav_g");
-		parameters["Iav_b"] = Parameter(image->getAverageIntensity().r(), "Iav_b");
+		parameters[Param::Iav_r] = image->getAverageIntensity().r();
+		parameters[Param::Iav_g] = image->getAverageIntensity().r();
+		parameters[Param::Iav_b] = image->getAverageIntensity().r();
 
-		parameters["Lav"] = Parameter(Lav, "Lav");
+		parameters[Param::Lav] = Lav;
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float m = parameters.at("m").value;
-		float f = parameters.at("f").value;
-		float c = parameters.at("c").value;
-		float a = parameters.at("a").value;
-		float Iav_r = parameters.at("Iav_r").value;
-		float Iav_g = parameters.at("Iav_g").value;
-		float Iav_b = parameters.at("Iav_b").value;
-		float Lav = parameters.at("Lav").value;
-
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				Color3f col = map(color, exposure, m, f, c, a, Iav_r, Iav_g, Iav_b, Lav);
-				col = col.clampedValue();
-				col = col.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * col.r());
-				dst[1] = (uint8_t) (255.f * col.g());
-				dst[2] = (uint8_t) (255.f * col.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
-	}
+	/* sigma(Ia) = (f * (a * (c * Ia + (1 - c) * L) + (1 - a) * (c * Iav_a + (1 - c) * Lav)))^m
+				 = (ac * Ia + al * L + global_a)^m with the factor f folded into all terms.
+	   al also contains the exposure, it is applied to the luminance of the input. */
+	struct Constants {
+		float exposure;
+		float ac;
+		float al;
+		float globalR, globalG, globalB;
+		float m;
+	};
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float m = parameters.at("m").value;
-		float f = parameters.at("f").value;
-		float c = parameters.at("c").value;
-		float a = parameters.at("a").value;
-		float Iav_r = parameters.at("Iav_r").value;
-		float Iav_g = parameters.at("Iav_g").value;
-		float Iav_b = parameters.at("Iav_b").value;
-		float Lav = parameters.at("Lav").value;
-
-		value = map(Color3f(value), 1.f, m, f, c, a, Iav_r, Iav_g, Iav_b, Lav).getLuminance();
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+	Constants prepare(float exposure) const {
+		float m = parameters[Param::m];
+		float f = parameters[Param::f];
+		float c = parameters[Param::c];
+		float a = parameters[Param::a];
+		float Lav = parameters[Param::Lav];
+
+		Constants k;
+		k.exposure = exposure;
+		k.ac = f * a * c;
+		k.al = f * a * (1.f - c) * exposure;
+		k.globalR = f * (1.f - a) * (c * exposure * parameters[Param::Iav_r] + (1.f - c) * exposure * Lav);
+		k.globalG = f * (1.f - a) * (c * exposure * parameters[Param::Iav_g] + (1.f - c) * exposure * Lav);
+		k.globalB = f * (1.f - a) * (c * exposure * parameters[Param::Iav_b] + (1.f - c) * exposure * Lav);
+		k.m = m;
+		return k;
 	}
 
-protected:
-	Color3f map(const Color3f &col, float exposure, float m, float f, float c, float a, float Iav_r, float Iav_g, float Iav_b, float Lav) const {
-		Color3f color = exposure * col;
-		float L = color.getLuminance();
-		float sigmaIr = sigmaIa(color.r(), exposure * Iav_r, L, exposure * Lav, c, a, m, f);
-		float sigmaIg = sigmaIa(color.g(), exposure * Iav_g, L, exposure * Lav, c, a, m, f);
-		float sigmaIb = sigmaIa(color.b(), exposure * Iav_b, L, exposure * Lav, c, a, m, f);
-
-		color.r() = color.r() / (color.r() + sigmaIr);
-		color.g() = color.g() / (color.g() + sigmaIg);
-		color.b() = color.b() / (color.b() + sigmaIb);
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
 
-		return color;
+	static const bool LuminanceInput = true;
+
+	template <typename T>
+	static inline void map(const Constants &k, T &r, T &g, T &b, const T &Lw) {
+		r = k.exposure * r;
+		g = k.exposure * g;
+		b = k.exposure * b;
+		T L = k.al * Lw;
+		r = r / (r + vpow(k.ac * r + L + k.globalR, k.m));
+		g = g / (g + vpow(k.ac * g + L + k.globalG, k.m));
+		b = b / (b + vpow(k.ac * b + L + k.globalB, k.m));
 	}
 
-	float sigmaIa(float Ia, float Iav_a, float L, float Lav, float c, float a, float m, float f) const {
-		float Ia_local = c * Ia + (1.f - c) * L;
-		float Ia_global = c * Iav_a + (1.f - c) * Lav;
-		float result = a * Ia_local + (1.f - a) * Ia_global;
-		return std::pow(f * result, m);
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		float r = value, g = value, b = value;
+		map(k, r, g, b, luminance(r, g, b));
+		value = luminance(r, g, b);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
@@ -9,17 +9,22 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class ExtendedReinhardOperator : public TonemapOperator {
+class ExtendedReinhardOperator : public LuminanceKernelOperator<ExtendedReinhardOperator> {
 public:
-	ExtendedReinhardOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
+	struct Param {
+		enum { Gamma, Lwhite };
+	};
+
+	ExtendedReinhardOperator() : LuminanceKernelOperator<ExtendedReinhardOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::Lwhite, "Lwhite", Parameter(1.f, 0.f, 1.f, "Lwhite", "Smallest luminance that will be mapped to pure white."));
 
 		name = "Reinhard (Extended)";
 		description = "Extended Reinhard Mapping\n\nProposed in \"Photographic Tone Reproduction for Digital Images\" by Reinhard et al. 2002.\n(Extension that allows high luminances to burn out.)";
 
-		shader->init(
+		setShader(
 			"ExtendedReinhard",
 
 			"#version 330\n"
@@ -70,48 +75,35 @@ public:
 		float Lmin = image->getMinimumLuminance();
 		float Lmax = image->getMaximumLuminance();
 
-		parameters["Lwhite"] = Parameter(Lmax, Lmin, Lmax, "Lwhite", "Smallest luminance that will be mapped to pure white.");
+		parameters.setRange(Param::Lwhite, Lmax, Lmin, Lmax);
+	};
+
+	struct Constants {
+		float exposure;
+		float invLwhite2;
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Lwhite = parameters.at("Lwhite").value;
-
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, Lwhite);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		float Lwhite = parameters[Param::Lwhite];
+		Constants k;
+		k.exposure = exposure;
+		k.invLwhite2 = 1.f / (Lwhite * Lwhite);
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Lwhite = parameters.at("Lwhite").value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
 
-		value = map(value, 1.f, Lwhite);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		T L = k.exposure * Lw;
+		return (L * (1.f + L * k.invLwhite2)) / (1.f + L);
 	}
 
-protected:
-	float map(float Lw, float exposure, float Lwhite) const {
-		float L = exposure * Lw;
-		float Ld = (L * (1.f + L / (Lwhite * Lwhite))) / (1.f + L);
-		return Ld;
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
@@ -9,17 +9,22 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class SchlickOperator : public TonemapOperator {
+class SchlickOperator : public TonemapKernelOperator<SchlickOperator> {
 public:
-	SchlickOperator() : TonemapOperator() {
-		parameters["p"] = Parameter(200.f, 1.f, 1000.f, "p", "Rational mapping curve parameter");
+	struct Param {
+		enum { p, Lmax };
+	};
+
+	SchlickOperator() : TonemapKernelOperator<SchlickOperator>() {
+		parameters.declare(Param::p, "p", Parameter(200.f, 1.f, 1000.f, "p", "Rational mapping curve parameter"));
+		parameters.declare(Param::Lmax, "Lmax", Parameter(1.f, "Lmax"));
 
 		name = "Schlick";
 		description = "Schlick Mapping\n\nProposed in \"Quantization Techniques for Visualization of High Dynamic Range Pictures\" by Schlick 1994.";
 
-		shader->init(
+		setShader(
 			"Schlick",
 
 			"#version 330\n"
@@ -52,46 +57,43 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lmax"] = Parameter(image->getMaximumLuminance(), "Lmax");
+		parameters[Param::Lmax] = image->getMaximumLuminance();
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float Lmax = parameters.at("Lmax").value;
-		float p = parameters.at("p").value;
+	struct Constants {
+		float exposure;
+		float p;
+		float pMinusOne;
+		float scaledLmax;
+	};
 
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				Color3f c = Color3f(map(color.r(), exposure, Lmax, p),
-									map(color.g(), exposure, Lmax, p),
-									map(color.b(), exposure, Lmax, p));
-				c = c.clampedValue();
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		float p = parameters[Param::p];
+		Constants k;
+		k.exposure = exposure;
+		k.p = p;
+		k.pMinusOne = p - 1.f;
+		k.scaledLmax = exposure * parameters[Param::Lmax];
+		return k;
 	}
 
-	float graph(float value) const override {
-		float Lmax = parameters.at("Lmax").value;
-		float p = parameters.at("p").value;
+	template <typename T>
+	static inline T curve(const Constants &k, T v) {
+		T value = k.exposure * v;
+		return k.p * value / (k.pMinusOne * value + k.scaledLmax);
+	}
 
-		value = map(value, 1.f, Lmax, p);
-		value = clamp(value, 0.f, 1.f);
-		return value;
+	template <typename T>
+	static inline void map(const Constants &k, T &r, T &g, T &b) {
+		r = curve(k, r);
+		g = curve(k, g);
+		b = curve(k, b);
 	}
 
-protected:
-	float map(float v, float exposure, float Lmax, float p) const {
-		float value = exposure * v;
-		value = p * value / (p * value - value + exposure * Lmax);
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = curve(k, value);
+		value = clamp(value, 0.f, 1.f);
 		return value;
 	}
-};
\ No newline at end of file
+};
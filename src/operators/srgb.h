@@ -9,15 +9,15 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class SRGBOperator : public TonemapOperator {
+class SRGBOperator : public TonemapKernelOperator<SRGBOperator> {
 public:
-	SRGBOperator() : TonemapOperator() {
+	SRGBOperator() : TonemapKernelOperator<SRGBOperator>() {
 		name = "sRGB";
 		description = "sRGB\n\nConversion to the sRGB color space.";
 
-		shader->init(
+		setShader(
 			"sRGB",
 
 			"#version 330\n"
@@ -53,39 +53,33 @@ public:
 		);
 	}
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
+	struct Constants {
+		float exposure;
+	};
 
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				Color3f c = Color3f(map(color.r(), exposure),
-									map(color.g(), exposure),
-									map(color.b(), exposure));
-				c = c.clampedValue();
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		Constants k;
+		k.exposure = exposure;
+		return k;
+	}
+
+	template <typename T>
+	static inline T curve(const Constants &k, T v) {
+		T value = k.exposure * v;
+		return vselect(value < 0.0031308f, 12.92f * value, 1.055f * vpow(value, 0.41666f) - 0.055f);
+	}
+
+	template <typename T>
+	static inline void map(const Constants &k, T &r, T &g, T &b) {
+		r = curve(k, r);
+		g = curve(k, g);
+		b = curve(k, b);
 	}
 
 	float graph(float value) const override {
-		value = map(value, 1.f);
+		const Constants k = prepare(1.f);
+		value = curve(k, value);
 		value = clamp(value, 0.f, 1.f);
 		return value;
 	}
-
-protected:
-	float map(float v, float exposure) const {
-		float value = exposure * v;
-		if (value < 0.0031308f) {
-			return 12.92f * value;
-		}
-		return 1.055f * std::pow(value, 0.41666f) - 0.055f;
-	}
-};
\ No newline at end of file
+};
@@ -9,20 +9,25 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class TumblinRushmeierOperator : public TonemapOperator {
+class TumblinRushmeierOperator : public LuminanceKernelOperator<TumblinRushmeierOperator> {
 public:
-	TumblinRushmeierOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
+	struct Param {
+		enum { Gamma, Ldmax, Cmax, Lavg };
+	};
+
+	TumblinRushmeierOperator() : LuminanceKernelOperator<TumblinRushmeierOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
 
-		parameters["Ldmax"] = Parameter(86.f, 1.f, 200.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)");
-		parameters["Cmax"] = Parameter(50.f, 1.f, 500.f, "Cmax", "Maximum contrast ratio between on-screen luminances");
+		parameters.declare(Param::Ldmax, "Ldmax", Parameter(86.f, 1.f, 200.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)"));
+		parameters.declare(Param::Cmax, "Cmax", Parameter(50.f, 1.f, 500.f, "Cmax", "Maximum contrast ratio between on-screen luminances"));
+		parameters.declare(Param::Lavg, "Lavg", Parameter(1.f, "Lavg"));
 
 		name = "Tumblin-Rushmeier";
 		description = "Tumblin-Rushmeier Mapping\n\nProposed in\"Tone Reproduction for Realistic Images\" by Tumblin and Rushmeier 1993.";
 
-		shader->init(
+		setShader(
 			"TumblinRushmeier",
 
 			"#version 330\n"
@@ -79,50 +84,21 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lavg"] = Parameter(image->getAverageLuminance(), "Lavg");
+		parameters[Param::Lavg] = image->getAverageLuminance();
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Lavg = parameters.at("Lavg").value;
-		float Ldmax = parameters.at("Ldmax").value;
-		float Cmax = parameters.at("Cmax").value;
-
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, Lavg, Ldmax, Cmax);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
-	}
+	struct Constants {
+		float scale;
+		float exponent;
+		float offset;
+	};
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Lavg = parameters.at("Lavg").value;
-		float Ldmax = parameters.at("Ldmax").value;
-		float Cmax = parameters.at("Cmax").value;
-
-		value = map(value, 1.f, Lavg, Ldmax, Cmax);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
-	}
+	// Ld = (exposure * Lw)^(alpha_rw/alpha_d) / Ldmax * 10^((beta_rw - beta_d)/alpha_d) - 1/Cmax
+	Constants prepare(float exposure) const {
+		float Lavg = parameters[Param::Lavg];
+		float Ldmax = parameters[Param::Ldmax];
+		float Cmax = parameters[Param::Cmax];
 
-protected:
-	float map(float Lw, float exposure, float Lavg, float Ldmax, float Cmax) const {
 		float log10Lrw = std::log10(exposure * Lavg);
 		float alpha_rw = 0.4f * log10Lrw + 2.92f;
 		float beta_rw = -0.4f * log10Lrw*log10Lrw - 2.584f * log10Lrw + 2.0208f;
@@ -130,8 +106,25 @@ protected:
 		float alpha_d = 0.4f * log10Ld + 2.92f;
 		float beta_d = -0.4f * log10Ld*log10Ld - 2.584f * log10Ld + 2.0208f;
 
-		float L = exposure * Lw;
-		float Ld = std::pow(L, alpha_rw/alpha_d) / Ldmax * std::pow(10.f, (beta_rw - beta_d) / alpha_d) - (1.f / Cmax);
-		return Ld;
+		Constants k;
+		k.exponent = alpha_rw / alpha_d;
+		k.scale = std::pow(exposure, k.exponent) / Ldmax * std::pow(10.f, (beta_rw - beta_d) / alpha_d);
+		k.offset = 1.f / Cmax;
+		return k;
+	}
+
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
+	}
+
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		return k.scale * vpow(Lw, k.exponent) - k.offset;
+	}
+
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
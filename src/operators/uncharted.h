@@ -9,24 +9,28 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class UnchartedOperator : public TonemapOperator {
+class UnchartedOperator : public TonemapKernelOperator<UnchartedOperator> {
 public:
-	UnchartedOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
-		parameters["A"] = Parameter(0.22f, 0.f, 1.f, "A", "Shoulder strength curve parameter");
-		parameters["B"] = Parameter(0.3f, 0.f, 1.f, "B", "Linear strength curve parameter");
-		parameters["C"] = Parameter(0.1f, 0.f, 1.f, "C", "Linear angle curve parameter");
-		parameters["D"] = Parameter(0.2f, 0.f, 1.f, "D", "Toe strength curve parameter");
-		parameters["E"] = Parameter(0.01f, 0.f, 1.f, "E", "Toe numerator curve parameter");
-		parameters["F"] = Parameter(0.3f, 0.f, 1.f, "F", "Toe denominator curve parameter");
-		parameters["W"] = Parameter(11.2f, 0.f, 20.f, "W", "White point\nMinimal value that is mapped to 1.");
+	struct Param {
+		enum { Gamma, A, B, C, D, E, F, W };
+	};
+
+	UnchartedOperator() : TonemapKernelOperator<UnchartedOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::A, "A", Parameter(0.22f, 0.f, 1.f, "A", "Shoulder strength curve parameter"));
+		parameters.declare(Param::B, "B", Parameter(0.3f, 0.f, 1.f, "B", "Linear strength curve parameter"));
+		parameters.declare(Param::C, "C", Parameter(0.1f, 0.f, 1.f, "C", "Linear angle curve parameter"));
+		parameters.declare(Param::D, "D", Parameter(0.2f, 0.f, 1.f, "D", "Toe strength curve parameter"));
+		parameters.declare(Param::E, "E", Parameter(0.01f, 0.f, 1.f, "E", "Toe numerator curve parameter"));
+		parameters.declare(Param::F, "F", Parameter(0.3f, 0.f, 1.f, "F", "Toe denominator curve parameter"));
+		parameters.declare(Param::W, "W", Parameter(11.2f, 0.f, 20.f, "W", "White point\nMinimal value that is mapped to 1."));
 
 		name = "Uncharted (Hable)";
 		description = "Uncharted Mapping\n\nBy John Hable from the \"Filmic Tonemapping for Real-time Rendering\" Siggraph 2010 Course by Haarm-Pieter Duiker.";
 
-		shader->init(
+		setShader(
 			"Uncharted",
 
 			"#version 330\n"
@@ -76,65 +80,61 @@ public:
 		);
 	}
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float A = parameters.at("A").value;
-		float B = parameters.at("B").value;
-		float C = parameters.at("C").value;
-		float D = parameters.at("D").value;
-		float E = parameters.at("E").value;
-		float F = parameters.at("F").value;
-		float W = parameters.at("W").value;
-
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				Color3f c = Color3f(map(color.r(), exposure, A, B, C, D, E, F, W),
-									map(color.g(), exposure, A, B, C, D, E, F, W),
-									map(color.b(), exposure, A, B, C, D, E, F, W));
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	/* Hable's curve ((x * (A*x + C*B) + D*E) / (x * (A*x + B) + D*F)) - E/F,
+	   scaled so that the linear white point W maps to 1 */
+	struct Constants {
+		float scale;
+		float A, B, CB, DE, DF, EF;
+		float whiteScale;
+	};
+
+	Constants prepare(float exposure) const {
+		const float exposureBias = 2.f;
+		float A = parameters[Param::A];
+		float B = parameters[Param::B];
+		float C = parameters[Param::C];
+		float D = parameters[Param::D];
+		float E = parameters[Param::E];
+		float F = parameters[Param::F];
+		float W = parameters[Param::W];
+
+		Constants k;
+		k.scale = exposureBias * exposure;
+		k.A = A;
+		k.B = B;
+		k.CB = C * B;
+		k.DE = D * E;
+		k.DF = D * F;
+		k.EF = E / F;
+		k.whiteScale = 1.f / mapAux(k, W);
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float A = parameters.at("A").value;
-		float B = parameters.at("B").value;
-		float C = parameters.at("C").value;
-		float D = parameters.at("D").value;
-		float E = parameters.at("E").value;
-		float F = parameters.at("F").value;
-		float W = parameters.at("W").value;
-
-		value = map(value, 1.f, A, B, C, D, E, F, W);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
 	}
 
-protected:
-	float map(float v, float exposure, float A, float B, float C, float D, float E, float F, float W) const {
-		float value = exposure * v;
-		float exposureBias = 2.f;
-		value = mapAux(exposureBias * value, A, B, C, D, E, F);
-		float whiteScale = 1.f / mapAux(W, A, B, C, D, E, F);
-		value = value * whiteScale;
-		return value;
+	template <typename T>
+	static inline T curve(const Constants &k, T v) {
+		return mapAux(k, k.scale * v) * k.whiteScale;
+	}
+
+	template <typename T>
+	static inline void map(const Constants &k, T &r, T &g, T &b) {
+		r = curve(k, r);
+		g = curve(k, g);
+		b = curve(k, b);
+	}
+
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = curve(k, value);
+		return encodeCurve()(value);
 	}
 
 protected:
-	float mapAux(float x, float A, float B, float C, float D, float E, float F) const {
-		return ((x * (A*x + C*B) + D*E) / (x * (A*x+B) + D*F)) - E/F;
+	template <typename T>
+	static inline T mapAux(const Constants &k, T x) {
+		return ((x * (k.A*x + k.CB) + k.DE) / (x * (k.A*x + k.B) + k.DF)) - k.EF;
 	}
-};
\ No newline at end of file
+};
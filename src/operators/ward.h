@@ -9,18 +9,23 @@
 
 #pragma once
 
-#include <tonemap.h>
+#include <kernel.h>
 
-class WardOperator : public TonemapOperator {
+class WardOperator : public LuminanceKernelOperator<WardOperator> {
 public:
-	WardOperator() : TonemapOperator() {
-		parameters["Gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value");
-		parameters["Ldmax"] = Parameter(100.f, 0.f, 200.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)");
+	struct Param {
+		enum { Gamma, Ldmax, Lwa };
+	};
+
+	WardOperator() : LuminanceKernelOperator<WardOperator>() {
+		parameters.declare(Param::Gamma, "Gamma", Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value"));
+		parameters.declare(Param::Ldmax, "Ldmax", Parameter(100.f, 0.f, 200.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)"));
+		parameters.declare(Param::Lwa, "Lwa", Parameter(1.f, "Lwa"));
 
 		name = "Ward";
 		description = "Ward Mapping\n\nProposed in \"A contrast-based scalefactor for luminance display\" by Ward 1994.";
 
-		shader->init(
+		setShader(
 			"Ward",
 
 			"#version 330\n"
@@ -71,53 +76,36 @@ public:
 	}
 
 	virtual void setParameters(const Image *image) override {
-		parameters["Lwa"] = Parameter(image->getLogAverageLuminance(), "Lwa");
+		parameters[Param::Lwa] = image->getLogAverageLuminance();
+	};
+
+	struct Constants {
+		float scale;
 	};
 
-	void process(const Image *image, uint8_t *dst, float exposure, float *progress) const override {
-		const nanogui::Vector2i &size = image->getSize();
-		*progress = 0.f;
-		float delta = 1.f / (size.x() * size.y());
-
-		float gamma = parameters.at("Gamma").value;
-		float Lwa = parameters.at("Lwa").value;
-		float Ldmax = parameters.at("Ldmax").value;
-
-		for (int i = 0; i < size.y(); ++i) {
-			for (int j = 0; j < size.x(); ++j) {
-				const Color3f &color = image->ref(i, j);
-				float Lw = color.getLuminance();
-				float Ld = map(Lw, exposure, Lwa, Ldmax);
-				Color3f c = Ld * color / Lw;
-				c = c.clampedValue();
-				c = c.gammaCorrect(gamma);
-				dst[0] = (uint8_t) (255.f * c.r());
-				dst[1] = (uint8_t) (255.f * c.g());
-				dst[2] = (uint8_t) (255.f * c.b());
-				dst += 3;
-				*progress += delta;
-			}
-		}
+	Constants prepare(float exposure) const {
+		float Lwa = parameters[Param::Lwa];
+		float Ldmax = parameters[Param::Ldmax];
+		float Lda = Ldmax / 2.f;
+		float m = std::pow((1.219f + std::pow(Lda, 0.4f)) / (1.219f + std::pow(Lwa * exposure, 0.4f)), 2.5f);
+
+		Constants k;
+		k.scale = m * exposure / Ldmax;
+		return k;
 	}
 
-	float graph(float value) const override {
-		float gamma = parameters.at("Gamma").value;
-		float Lwa = parameters.at("Lwa").value;
-		float Ldmax = parameters.at("Ldmax").value;
-
-		value = map(value, 1.f, Lwa, Ldmax);
-		value = clamp(value, 0.f, 1.f);
-		value = std::pow(value, 1.f / gamma);
-		return value;
+	EncodeCurve encodeCurve() const {
+		return EncodeCurve::gamma(1.f / parameters[Param::Gamma]);
 	}
 
-protected:
-	float map(float Lw, float exposure, float Lwa, float Ldmax) const {
-		float Lda = Ldmax / 2.f;
-		float m = std::pow((1.219f + std::pow(Lda, 0.4f)) / (1.219f + std::pow(Lwa * exposure, 0.4f)), 2.5f);
+	template <typename T>
+	static inline T mapLuminance(const Constants &k, T Lw) {
+		return k.scale * Lw;
+	}
 
-		float L = exposure * Lw;
-		float Ld = m * L / Ldmax;
-		return Ld;
+	float graph(float value) const override {
+		const Constants k = prepare(1.f);
+		value = mapLuminance(k, value);
+		return encodeCurve()(value);
 	}
-};
\ No newline at end of file
+};
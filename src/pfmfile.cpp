@@ -0,0 +1,87 @@
+/*
+    src/pfmfile.cpp -- Portable float maps used in place
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <pfmfile.h>
+
+#include <cctype>
+
+PfmFile::PfmFile(const std::string &filename) : m_file(filename, true) {
+	if (!m_file.isValid()) {
+		m_error = "Could not read \"" + filename + "\"";
+		return;
+	}
+	m_valid = parseHeader();
+}
+
+bool PfmFile::parseHeader() {
+	const char *data = (const char *) m_file.getData();
+	const size_t size = m_file.getSize();
+	size_t pos = 0;
+	// Whitespace separated tokens, the last one is followed by a single whitespace character
+	auto readToken = [&]() {
+		while (pos < size && isspace((unsigned char) data[pos])) ++pos;
+		const size_t begin = pos;
+		while (pos < size && !isspace((unsigned char) data[pos])) ++pos;
+		return std::string(data + begin, pos - begin);
+	};
+
+	const std::string magic = readToken();
+	if (magic != "PF" && magic != "Pf") {
+		m_error = "Not a portable float map";
+		return false;
+	}
+	m_channels = magic == "PF" ? 3 : 1;
+
+	char *end;
+	const std::string width = readToken(), height = readToken(), scale = readToken();
+	const long w = strtol(width.c_str(), &end, 10);
+	const bool widthValid = *end == '\0';
+	const long h = strtol(height.c_str(), &end, 10);
+	const bool heightValid = *end == '\0';
+	m_scale = strtof(scale.c_str(), &end);
+	if (!widthValid || !heightValid || *end != '\0' || scale.empty() || pos == size || m_scale == 0.f ||
+		w <= 0 || h <= 0 || (int64_t) w * h > std::numeric_limits<int>::max()) {
+		m_error = "Invalid portable float map header";
+		return false;
+	}
+	m_width = (int) w;
+	m_height = (int) h;
+	m_offset = pos + 1;
+	m_rowBytes = (size_t) m_width * m_channels * sizeof(float);
+	if (size - m_offset < m_rowBytes * m_height) {
+		m_error = "Truncated portable float map";
+		return false;
+	}
+
+	// A negative scale means little endian samples
+	const uint16_t one = 1;
+	uint8_t first;
+	memcpy(&first, &one, 1);
+	m_swap = (m_scale < 0.f) != (first == 1);
+	m_scale = std::abs(m_scale);
+	m_inPlace = m_channels == 3 && !m_swap && m_scale == 1.f && m_offset % sizeof(float) == 0;
+	return true;
+}
+
+void PfmFile::readChannel(int y, int c, float *dst) const {
+	const uint8_t *src = (const uint8_t *) getRow(y) + (m_channels == 3 ? c * sizeof(float) : 0);
+	for (int j = 0; j < m_width; ++j, src += m_channels * sizeof(float)) {
+		uint32_t bits;
+		memcpy(&bits, src, sizeof(uint32_t));
+		if (m_swap) {
+			bits = (bits >> 24) | ((bits >> 8) & 0xff00) | ((bits << 8) & 0xff0000) | (bits << 24);
+		}
+		memcpy(&dst[j], &bits, sizeof(float));
+	}
+	if (m_scale != 1.f) {
+		for (int j = 0; j < m_width; ++j) {
+			dst[j] *= m_scale;
+		}
+	}
+}
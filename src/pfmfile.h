@@ -0,0 +1,53 @@
+/*
+    src/pfmfile.h -- Portable float maps used in place
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+#include <mappedfile.h>
+
+/* Portable float map (.pfm) read from a copy on write MappedFile. Rows are
+   stored bottom up, as RGB triplets ("PF") or single samples ("Pf"), in
+   the byte order given by the sign of the scale. */
+class PfmFile {
+public:
+	explicit PfmFile(const std::string &filename);
+
+	// The header could be parsed, otherwise getError() tells why
+	bool isValid() const { return m_valid; }
+	const std::string &getError() const { return m_error; }
+
+	int getWidth() const { return m_width; }
+	int getHeight() const { return m_height; }
+
+	/* The samples are RGB triplets in native byte order with a scale of 1,
+	   aligned for floats, so getRow() can be used as they are */
+	bool isInPlace() const { return m_inPlace; }
+	// Samples of row 'y' (from the top) in the file, writes only change a private copy of the page
+	float *getRow(int y) const { return (float *) (m_file.getMutableData() + m_offset + (size_t) (m_height - 1 - y) * m_rowBytes); }
+
+	// Channel 'c' of row 'y' as floats, byte swapped and scaled, gray maps have the same samples in all channels
+	void readChannel(int y, int c, float *dst) const;
+
+private:
+	bool parseHeader();
+
+	MappedFile 				m_file;
+	bool 					m_valid = false;
+	std::string 			m_error;
+
+	int 					m_width = 0;
+	int 					m_height = 0;
+	int 					m_channels = 3;
+	float 					m_scale = 1.f;
+	bool 					m_swap = false;
+	bool 					m_inPlace = false;
+	size_t 					m_offset = 0;
+	size_t 					m_rowBytes = 0;
+};
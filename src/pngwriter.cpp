@@ -0,0 +1,292 @@
+/*
+    src/pngwriter.cpp -- PNG files written band by band
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <pngwriter.h>
+
+#include <threadpool.h>
+
+#include <atomic>
+#include <zlib.h>
+
+namespace {
+
+// Filtered bytes per segment that is deflated on its own
+const size_t SegmentSize = 1 << 17;
+// Deflate window, the dictionary of a segment
+const size_t WindowSize = 1 << 15;
+// Compressed bytes per IDAT chunk
+const size_t IdatSize = 1 << 18;
+
+inline uint8_t paeth(int a, int b, int c) {
+	const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc) return (uint8_t) a;
+	if (pb <= pc) return (uint8_t) b;
+	return (uint8_t) c;
+}
+
+// Filter byte and residuals of 'size' bytes with 'bpp' bytes per pixel
+void filterLine(PngFilter filter, const uint8_t *row, const uint8_t *above, uint8_t *dst, int size, int bpp) {
+	dst[0] = (uint8_t) filter;
+	++dst;
+	switch (filter) {
+		case EPngFilterSub:
+			for (int i = 0; i < size; ++i) {
+				dst[i] = (uint8_t) (row[i] - (i >= bpp ? row[i - bpp] : 0));
+			}
+			break;
+		case EPngFilterUp:
+			for (int i = 0; i < size; ++i) {
+				dst[i] = (uint8_t) (row[i] - above[i]);
+			}
+			break;
+		case EPngFilterAverage:
+			for (int i = 0; i < size; ++i) {
+				dst[i] = (uint8_t) (row[i] - (((i >= bpp ? row[i - bpp] : 0) + above[i]) >> 1));
+			}
+			break;
+		case EPngFilterPaeth:
+			for (int i = 0; i < size; ++i) {
+				dst[i] = (uint8_t) (row[i] - (i >= bpp ? paeth(row[i - bpp], above[i], above[i - bpp]) : above[i]));
+			}
+			break;
+		default:
+			memcpy(dst, row, size);
+			break;
+	}
+}
+
+void putBigEndian(uint8_t *dst, uint32_t value) {
+	dst[0] = (uint8_t) (value >> 24);
+	dst[1] = (uint8_t) (value >> 16);
+	dst[2] = (uint8_t) (value >> 8);
+	dst[3] = (uint8_t) value;
+}
+
+}
+
+const char *getPngFilterName(PngFilter filter) {
+	switch (filter) {
+		case EPngFilterNone: return "none";
+		case EPngFilterSub: return "sub";
+		case EPngFilterUp: return "up";
+		case EPngFilterAverage: return "average";
+		case EPngFilterPaeth: return "paeth";
+		default: return "adaptive";
+	}
+}
+
+bool parsePngFilter(const std::string &name, PngFilter &filter) {
+	for (int f = EPngFilterNone; f <= EPngFilterAdaptive; ++f) {
+		if (name == getPngFilterName((PngFilter) f)) {
+			filter = (PngFilter) f;
+			return true;
+		}
+	}
+	return false;
+}
+
+PngWriter::PngWriter(const std::string &filename, int width, int height, const PngOptions &options)
+	: ImageWriter(filename, width, height), m_options(options) {
+	m_options.level = std::min(std::max(m_options.level, 0), 9);
+	m_options.depth = m_options.depth == 16 ? 16 : 8;
+	m_pixelSize = 3 * m_options.depth / 8;
+	m_above.assign(m_pixelSize * (size_t) width, 0);
+	m_adler = (uint32_t) adler32(0, Z_NULL, 0);
+
+	static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	uint8_t header[13];
+	putBigEndian(header, (uint32_t) width);
+	putBigEndian(header + 4, (uint32_t) height);
+	header[8] = (uint8_t) m_options.depth;
+	header[9] = 2;		// RGB
+	header[10] = 0;		// Deflate
+	header[11] = 0;		// Adaptive filtering
+	header[12] = 0;		// No interlacing
+	write(signature, sizeof(signature));
+	writeChunk("IHDR", header, sizeof(header));
+
+	// zlib header with a 32 KiB window and the level hint, a multiple of 31
+	const int level = m_options.level;
+	int zlibHeader = (0x78 << 8) | ((level >= 7 ? 3 : level == 6 ? 2 : level >= 2 ? 1 : 0) << 6);
+	zlibHeader += 31 - zlibHeader % 31;
+	const uint8_t zlibHeaderBytes[2] = { (uint8_t) (zlibHeader >> 8), (uint8_t) zlibHeader };
+	writeData(zlibHeaderBytes, 2);
+}
+
+void PngWriter::filterRow(const uint8_t *row, const uint8_t *above, uint8_t *dst, uint8_t *lines) const {
+	const int size = m_pixelSize * m_width;
+	if (m_options.filter != EPngFilterAdaptive) {
+		filterLine(m_options.filter, row, above, dst, size, m_pixelSize);
+		return;
+	}
+
+	// Residuals as signed bytes, the first filter wins ties
+	int best = 0, bestSum = std::numeric_limits<int>::max();
+	for (int f = EPngFilterNone; f <= EPngFilterPaeth; ++f) {
+		uint8_t *line = lines + f * (size_t) (size + 1);
+		filterLine((PngFilter) f, row, above, line, size, m_pixelSize);
+		int sum = 0;
+		for (int i = 1; i <= size; ++i) {
+			sum += std::abs((int) (int8_t) line[i]);
+		}
+		if (sum < bestSum) {
+			bestSum = sum;
+			best = f;
+		}
+	}
+	memcpy(dst, lines + best * (size_t) (size + 1), size + 1);
+}
+
+bool PngWriter::writeRows(const uint8_t *rgb, int count) {
+	if (!isValid() || count <= 0 || m_rows + count > m_height) {
+		return false;
+	}
+	const size_t rowSize = m_pixelSize * (size_t) m_width, lineSize = rowSize + 1;
+	const int segmentRows = std::max(1, (int) (SegmentSize / lineSize));
+	const int segments = (count + segmentRows - 1) / segmentRows;
+	const bool last = m_rows + count == m_height;
+	std::vector<uint8_t> filtered(count * lineSize);
+
+	// 16 bit samples are stored big endian
+	std::vector<uint8_t> swapped;
+	if (m_options.depth == 16) {
+		swapped.resize(count * rowSize);
+		ThreadPool::global().parallelFor(segments, [&](int segment) {
+			const size_t end = std::min(count, (segment + 1) * segmentRows) * rowSize;
+			for (size_t i = segment * segmentRows * rowSize; i < end; i += 2) {
+				uint16_t sample;
+				memcpy(&sample, rgb + i, 2);
+				swapped[i] = (uint8_t) (sample >> 8);
+				swapped[i + 1] = (uint8_t) sample;
+			}
+		});
+		rgb = swapped.data();
+	}
+
+	// All rows are filtered first, segments are primed with the data in front of them
+	ThreadPool::global().parallelFor(segments, [&](int segment) {
+		std::vector<uint8_t> lines(m_options.filter == EPngFilterAdaptive ? 5 * lineSize : 0);
+		const int rowEnd = std::min(count, (segment + 1) * segmentRows);
+		for (int i = segment * segmentRows; i < rowEnd; ++i) {
+			const uint8_t *row = rgb + i * rowSize;
+			filterRow(row, i == 0 ? m_above.data() : row - rowSize, &filtered[i * lineSize], lines.data());
+		}
+	});
+
+	std::vector<std::vector<uint8_t>> compressed(segments);
+	std::vector<uint32_t> checksums(segments);
+	std::atomic<bool> failed(false);
+	ThreadPool::global().parallelFor(segments, [&](int segment) {
+		const size_t begin = segment * segmentRows * lineSize;
+		const size_t end = std::min(count, (segment + 1) * segmentRows) * lineSize;
+		checksums[segment] = (uint32_t) adler32(adler32(0, Z_NULL, 0), &filtered[begin], (uInt) (end - begin));
+
+		// The window in front of the segment, the start of it may come from the previous call
+		std::vector<uint8_t> dictionary;
+		if (begin < WindowSize) {
+			const size_t history = std::min(m_history.size(), WindowSize - begin);
+			dictionary.insert(dictionary.end(), m_history.end() - history, m_history.end());
+		}
+		dictionary.insert(dictionary.end(), filtered.begin() + (begin - std::min(begin, WindowSize)), filtered.begin() + begin);
+
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if (deflateInit2(&stream, m_options.level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			failed = true;
+			return;
+		}
+		if (!dictionary.empty()) {
+			deflateSetDictionary(&stream, dictionary.data(), (uInt) dictionary.size());
+		}
+
+		// Only the very last segment ends the stream
+		const int flush = last && segment == segments - 1 ? Z_FINISH : Z_SYNC_FLUSH;
+		std::vector<uint8_t> &out = compressed[segment];
+		out.resize(deflateBound(&stream, (uLong) (end - begin)) + 16);
+		stream.next_in = &filtered[begin];
+		stream.avail_in = (uInt) (end - begin);
+		stream.next_out = out.data();
+		stream.avail_out = (uInt) out.size();
+		while (true) {
+			const int ret = deflate(&stream, flush);
+			if (ret == Z_STREAM_ERROR || (ret == Z_BUF_ERROR && stream.avail_out > 0)) {
+				failed = true;
+				break;
+			}
+			if (flush == Z_FINISH ? ret == Z_STREAM_END : stream.avail_in == 0 && stream.avail_out > 0) {
+				break;
+			}
+			const size_t used = out.size() - stream.avail_out;
+			out.resize(2 * out.size());
+			stream.next_out = out.data() + used;
+			stream.avail_out = (uInt) (out.size() - used);
+		}
+		out.resize(out.size() - stream.avail_out);
+		deflateEnd(&stream);
+	});
+	if (failed) {
+		return false;
+	}
+
+	for (int segment = 0; segment < segments; ++segment) {
+		const size_t size = (std::min(count, (segment + 1) * segmentRows) - segment * segmentRows) * lineSize;
+		m_adler = (uint32_t) adler32_combine(m_adler, checksums[segment], (z_off_t) size);
+		writeData(compressed[segment].data(), compressed[segment].size());
+	}
+	if (last) {
+		uint8_t checksum[4];
+		putBigEndian(checksum, m_adler);
+		writeData(checksum, 4);
+	}
+
+	// State for the next call
+	m_history.insert(m_history.end(), filtered.end() - std::min(filtered.size(), WindowSize), filtered.end());
+	if (m_history.size() > WindowSize) {
+		m_history.erase(m_history.begin(), m_history.end() - WindowSize);
+	}
+	memcpy(m_above.data(), rgb + (count - 1) * rowSize, rowSize);
+	m_rows += count;
+	return !hasFailed();
+}
+
+void PngWriter::writeData(const uint8_t *data, size_t size) {
+	m_idat.insert(m_idat.end(), data, data + size);
+	if (m_idat.size() >= IdatSize) {
+		writeChunk("IDAT", m_idat.data(), m_idat.size());
+		m_idat.clear();
+	}
+}
+
+bool PngWriter::writeChunk(const char *type, const uint8_t *data, size_t size) {
+	uint8_t length[4], crc[4];
+	putBigEndian(length, (uint32_t) size);
+	uLong checksum = crc32(0, (const Bytef *) type, 4);
+	if (size > 0) {
+		checksum = crc32(checksum, data, (uInt) size);
+	}
+	putBigEndian(crc, (uint32_t) checksum);
+	write(length, 4);
+	write(type, 4);
+	if (size > 0) {
+		write(data, size);
+	}
+	return write(crc, 4);
+}
+
+bool PngWriter::finish() {
+	if (!isValid() || m_rows != m_height) {
+		ImageWriter::finish();
+		return false;
+	}
+	if (!m_idat.empty()) {
+		writeChunk("IDAT", m_idat.data(), m_idat.size());
+	}
+	writeChunk("IEND", nullptr, 0);
+	return ImageWriter::finish();
+}
@@ -0,0 +1,69 @@
+/*
+    src/pngwriter.h -- PNG files written band by band
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <imagewriter.h>
+
+// Row filter of PNG files
+enum PngFilter {
+	EPngFilterNone = 0,
+	EPngFilterSub,
+	EPngFilterUp,
+	EPngFilterAverage,
+	EPngFilterPaeth,
+	EPngFilterAdaptive		// Per row, the filter with the smallest sum of residuals (as in stb_image_write)
+};
+
+const char *getPngFilterName(PngFilter filter);
+bool parsePngFilter(const std::string &name, PngFilter &filter);
+
+struct PngOptions {
+	PngFilter filter;
+	// zlib compression level, from 0 (stored) to 9
+	int level;
+	// Bits per sample, 8 or 16
+	int depth;
+
+	PngOptions() : filter(EPngFilterAdaptive), level(6), depth(8) {}
+};
+
+/* 8 or 16 bit RGB PNG. The rows of every call are split into segments of about
+   128 KiB that are filtered and deflated in parallel on
+   ThreadPool::global(), like pigz does: every segment is a raw deflate
+   stream primed with the 32 KiB of data in front of it and ends on a byte
+   boundary with a sync flush, so the segments form one zlib stream. Their
+   Adler-32 checksums are combined. The compressed data is written in IDAT
+   chunks as it is complete. */
+class PngWriter : public ImageWriter {
+public:
+	PngWriter(const std::string &filename, int width, int height, const PngOptions &options = PngOptions());
+
+	OutputFormat getFormat() const override { return m_options.depth == 16 ? EOutputUInt16 : EOutputUInt8; }
+	bool writeRows(const uint8_t *rgb, int count) override;
+	bool finish() override;
+
+private:
+	// Filter byte and residuals of 'row' into 'dst', 'lines' has room for five rows for the adaptive filter
+	void filterRow(const uint8_t *row, const uint8_t *above, uint8_t *dst, uint8_t *lines) const;
+	// Appends compressed data to the IDAT chunks, full ones are written
+	void writeData(const uint8_t *data, size_t size);
+	bool writeChunk(const char *type, const uint8_t *data, size_t size);
+
+	PngOptions 				m_options;
+	int 					m_pixelSize;
+	int 					m_rows = 0;
+	std::vector<uint8_t> 	m_idat;
+
+	// Last row of the previous call, zeros above the first row
+	std::vector<uint8_t> 	m_above;
+	// Up to 32 KiB of filtered data in front of the next call, the dictionary of its first segment
+	std::vector<uint8_t> 	m_history;
+	uint32_t 				m_adler;
+};
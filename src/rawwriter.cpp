@@ -0,0 +1,183 @@
+/*
+    src/rawwriter.cpp -- Uncompressed frames streamed to video encoders
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <rawwriter.h>
+
+#include <kernel.h>
+#include <threadpool.h>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/uio.h>
+#endif
+
+namespace {
+
+// Rows converted to YCbCr by one task
+const int RowsPerTask = 16;
+
+bool isLittleEndian() {
+	const uint16_t one = 1;
+	uint8_t first;
+	memcpy(&first, &one, 1);
+	return first == 1;
+}
+
+}
+
+const char *getRawFormatName(RawFormat format) {
+	switch (format) {
+		case ERawRGB24: return "rgb24";
+		case ERawRGB48: return "rgb48le";
+		case ERawY4M: return "y4m";
+		default: return "unknown";
+	}
+}
+
+bool parseRawFormat(const std::string &name, RawFormat &format) {
+	for (RawFormat f : { ERawRGB24, ERawRGB48, ERawY4M }) {
+		if (name == getRawFormatName(f)) {
+			format = f;
+			return true;
+		}
+	}
+	return false;
+}
+
+RawWriter::RawWriter(const std::string &filename, int width, int height, const RawOptions &options)
+	: ImageWriter(filename, width, height), m_options(options) {
+	if (m_options.format == ERawY4M) {
+		m_planes.reset(new uint8_t[3 * (size_t) width * height]);
+		// The stream header goes out with the first frame
+		m_header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) +
+				   " F" + std::to_string(m_options.rateNumerator) + ":" + std::to_string(m_options.rateDenominator) +
+				   " Ip A1:1 C444 XCOLORRANGE=FULL\n";
+	}
+}
+
+bool RawWriter::writeRows(const uint8_t *rgb, int count) {
+	if (m_error || m_rows + count > m_height) {
+		m_error = true;
+		return false;
+	}
+	const size_t rowSize = 3 * (size_t) m_width;
+
+	if (m_options.format == ERawY4M) {
+		// Same conversion as in JPEG files, rounded to bytes in the planes of the frame
+		const YCbCrKernel yCbCrRow = yCbCrKernel(getSimdLevel());
+		const int paddedWidth = (m_width + MaxPackWidth - 1) / MaxPackWidth * MaxPackWidth;
+		const size_t planeSize = (size_t) m_width * m_height;
+		const int tasks = (count + RowsPerTask - 1) / RowsPerTask;
+		ThreadPool::global().parallelFor(tasks, [&](int task) {
+			std::vector<uint8_t> line(3 * paddedWidth);
+			std::vector<float> values(3 * paddedWidth);
+			float *const dst[3] = { values.data(), values.data() + paddedWidth, values.data() + 2 * paddedWidth };
+			for (int i = task * RowsPerTask; i < std::min(count, (task + 1) * RowsPerTask); ++i) {
+				memcpy(line.data(), rgb + i * rowSize, rowSize);
+				yCbCrRow(line.data(), dst, paddedWidth);
+				for (int c = 0; c < 3; ++c) {
+					uint8_t *plane = m_planes.get() + c * planeSize + (size_t) (m_rows + i) * m_width;
+					for (int j = 0; j < m_width; ++j) {
+						plane[j] = (uint8_t) std::min(std::max(dst[c][j] + 128.5f, 0.f), 255.f);
+					}
+				}
+			}
+		});
+		m_rows += count;
+		return true;
+	}
+
+	const void *data = rgb;
+	size_t size = rowSize * count * getOutputSampleSize(getFormat());
+	if (m_options.format == ERawRGB48 && !isLittleEndian()) {
+		m_swapped.resize(size);
+		for (size_t k = 0; k < size; k += 2) {
+			m_swapped[k] = rgb[k + 1];
+			m_swapped[k + 1] = rgb[k];
+		}
+		data = m_swapped.data();
+	}
+	m_rows += count;
+	return writeBuffers(&data, &size, 1);
+}
+
+bool RawWriter::finish() {
+	if (m_error || m_rows != m_height) {
+		m_error = true;
+		return false;
+	}
+	if (m_options.format == ERawY4M) {
+		// Stream header (once), frame header and the three planes in one call
+		const size_t planeSize = (size_t) m_width * m_height;
+		const void *data[5];
+		size_t sizes[5];
+		int count = 0;
+		if (m_frames == 0) {
+			data[count] = m_header.data();
+			sizes[count++] = m_header.size();
+		}
+		data[count] = "FRAME\n";
+		sizes[count++] = 6;
+		for (int c = 0; c < 3; ++c) {
+			data[count] = m_planes.get() + c * planeSize;
+			sizes[count++] = planeSize;
+		}
+		if (!writeBuffers(data, sizes, count)) {
+			return false;
+		}
+	}
+	m_rows = 0;
+	++m_frames;
+	return true;
+}
+
+bool RawWriter::close() {
+	const bool ok = ImageWriter::finish();
+	return ok && !m_error;
+}
+
+bool RawWriter::writeBuffers(const void *const *data, const size_t *sizes, int count) {
+	if (m_error || !getFile()) {
+		m_error = true;
+		return false;
+	}
+#if defined(_WIN32)
+	for (int k = 0; k < count && !m_error; ++k) {
+		m_error = fwrite(data[k], 1, sizes[k], getFile()) != sizes[k];
+	}
+#else
+	std::vector<iovec> buffers(count);
+	for (int k = 0; k < count; ++k) {
+		buffers[k].iov_base = (void *) data[k];
+		buffers[k].iov_len = sizes[k];
+	}
+	const int fd = fileno(getFile());
+	iovec *next = buffers.data();
+	while (count > 0) {
+		const ssize_t written = writev(fd, next, count);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			m_error = true;
+			break;
+		}
+		// Pipes may take only part of the data, continue after it
+		size_t remaining = (size_t) written;
+		while (count > 0 && remaining >= next->iov_len) {
+			remaining -= next->iov_len;
+			++next;
+			--count;
+		}
+		if (count > 0) {
+			next->iov_base = (uint8_t *) next->iov_base + remaining;
+			next->iov_len -= remaining;
+		}
+	}
+#endif
+	return !m_error;
+}
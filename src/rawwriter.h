@@ -0,0 +1,68 @@
+/*
+    src/rawwriter.h -- Uncompressed frames streamed to video encoders
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <imagewriter.h>
+
+// Pixel format of raw streams
+enum RawFormat {
+	ERawRGB24 = 0,		// 8 bit RGB, ffmpeg's "rgb24"
+	ERawRGB48,			// 16 bit little endian RGB, ffmpeg's "rgb48le"
+	ERawY4M				// YUV4MPEG2 stream of 8 bit full range YCbCr 4:4:4 (BT.601, as in JPEG files)
+};
+
+const char *getRawFormatName(RawFormat format);
+// Parses "rgb24", "rgb48le" or "y4m"
+bool parseRawFormat(const std::string &name, RawFormat &format);
+
+struct RawOptions {
+	RawFormat format;
+	// Frame rate in the header of y4m streams, as a fraction
+	int rateNumerator;
+	int rateDenominator;
+
+	RawOptions() : format(ERawRGB24), rateNumerator(25), rateDenominator(1) {}
+};
+
+/* Frames without compression or headers (but the ones of y4m), to be piped
+   into a video encoder, e.g. "ffmpeg -f rawvideo -pix_fmt rgb24 -s WxH -i -"
+   or "ffmpeg -i -" for y4m. Written with writev() to standard output ("-"),
+   a named pipe or a file: RGB rows straight from the buffers they arrive
+   in, y4m planes from one frame buffer that is allocated once. finish()
+   completes a frame and the stream stays open for the next one of the
+   same size, until close() or the writer is destroyed. */
+class RawWriter : public ImageWriter {
+public:
+	RawWriter(const std::string &filename, int width, int height, const RawOptions &options = RawOptions());
+
+	OutputFormat getFormat() const override { return m_options.format == ERawRGB48 ? EOutputUInt16 : EOutputUInt8; }
+	bool writeRows(const uint8_t *rgb, int count) override;
+	// Ends the frame, false if it was incomplete or writing failed
+	bool finish() override;
+
+	// Closes the stream after the last frame
+	bool close();
+	int getFrameCount() const { return m_frames; }
+
+private:
+	// Writes all 'count' buffers, with as few system calls as possible
+	bool writeBuffers(const void *const *data, const size_t *sizes, int count);
+
+	RawOptions 				m_options;
+	int 					m_rows = 0;
+	int 					m_frames = 0;
+	bool 					m_error = false;
+	std::string 			m_header;
+
+	// Y, Cb and Cr planes of a y4m frame
+	std::unique_ptr<uint8_t[]> m_planes;
+	// Byte swapped rows on big endian machines
+	std::vector<uint8_t> 	m_swapped;
+};
@@ -0,0 +1,300 @@
+/*
+    src/sequence.cpp -- Image sequences tonemapped in a pipeline
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <sequence.h>
+
+#include <image.h>
+#include <imagewriter.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <dirent.h>
+#elif defined(_WIN32)
+	#include <io.h>
+#endif
+
+namespace {
+
+// Loaded images waiting to be tonemapped, every one of them holds a whole image
+const int QueuedImages = 1;
+// Tonemapped bands waiting to be encoded, also the number of band buffers
+const int QueuedBands = 8;
+
+/* Queue between two threads with room for 'capacity' items. push() blocks
+   while it is full, pop() while it is empty and returns false once the
+   queue is closed and empty. */
+template <typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : m_capacity(capacity) {}
+
+	void push(T item) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [&]() { return m_items.size() < m_capacity; });
+		m_items.push_back(std::move(item));
+		m_notEmpty.notify_one();
+	}
+
+	bool pop(T &item) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [&]() { return !m_items.empty() || m_closed; });
+		if (m_items.empty()) {
+			return false;
+		}
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	// Nothing is pushed anymore
+	void close() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+		m_notEmpty.notify_all();
+	}
+
+private:
+	size_t 					m_capacity;
+	std::deque<T> 			m_items;
+	bool 					m_closed = false;
+	std::mutex 				m_mutex;
+	std::condition_variable m_notFull;
+	std::condition_variable m_notEmpty;
+};
+
+struct LoadedFrame {
+	int number;
+	std::unique_ptr<Image> image;
+};
+
+struct FrameState {
+	SequenceFrame frame;
+	// Set by the encoding stage once a writer failed
+	bool failed = false;
+};
+
+// Tonemapped rows of a frame in the buffers of band 'buffers'
+struct Band {
+	std::shared_ptr<FrameState> state;
+	int buffers;
+	int rows;
+	bool last;
+};
+
+// One buffer per writer, kept across frames and grown when needed
+struct BandBuffers {
+	std::vector<std::unique_ptr<uint8_t[]>> data;
+	std::vector<size_t> sizes;
+};
+
+double secondsSince(const std::chrono::steady_clock::time_point &start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+FramePattern::FramePattern(const std::string &pattern) {
+	const size_t end = pattern.find_last_of('#');
+	if (end == std::string::npos) {
+		m_prefix = pattern;
+		return;
+	}
+	size_t begin = end;
+	while (begin > 0 && pattern[begin - 1] == '#') {
+		--begin;
+	}
+	m_prefix = pattern.substr(0, begin);
+	m_suffix = pattern.substr(end + 1);
+	m_digits = (int) (end + 1 - begin);
+}
+
+std::string FramePattern::getFilename(int frame) const {
+	std::string number = std::to_string(frame);
+	if ((int) number.size() < m_digits) {
+		number.insert(0, m_digits - number.size(), '0');
+	}
+	return m_prefix + number + m_suffix;
+}
+
+std::vector<int> FramePattern::findFrames() const {
+	const size_t slash = m_prefix.find_last_of("/\\");
+	const std::string directory = slash == std::string::npos ? "" : m_prefix.substr(0, slash + 1);
+	const std::string prefix = m_prefix.substr(directory.size());
+
+	std::vector<std::string> names;
+#if defined(__unix__) || defined(__APPLE__)
+	if (DIR *dir = opendir(directory.empty() ? "." : directory.c_str())) {
+		while (dirent *entry = readdir(dir)) {
+			names.push_back(entry->d_name);
+		}
+		closedir(dir);
+	}
+#elif defined(_WIN32)
+	_finddata_t data;
+	intptr_t handle = _findfirst((directory + "*").c_str(), &data);
+	if (handle != -1) {
+		do {
+			names.push_back(data.name);
+		} while (_findnext(handle, &data) == 0);
+		_findclose(handle);
+	}
+#endif
+
+	// The digits between prefix and suffix, only numbers that give the same name back
+	std::vector<int> frames;
+	for (const std::string &name : names) {
+		if (name.size() <= prefix.size() + m_suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+			name.compare(name.size() - m_suffix.size(), m_suffix.size(), m_suffix) != 0) {
+			continue;
+		}
+		const std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - m_suffix.size());
+		if (digits.size() > 9 || digits.find_first_not_of("0123456789") != std::string::npos) {
+			continue;
+		}
+		const int frame = std::atoi(digits.c_str());
+		if (getFilename(frame) == directory + name) {
+			frames.push_back(frame);
+		}
+	}
+	std::sort(frames.begin(), frames.end());
+	return frames;
+}
+
+bool exportSequence(const std::vector<int> &numbers, const FrameLoader &load, const FrameSetup &setup,
+					const TonemapOperator *tonemap, const TonemapOptions &options, SequenceStatistics *statistics) {
+	const auto start = std::chrono::steady_clock::now();
+	BoundedQueue<LoadedFrame> images(QueuedImages);
+	BoundedQueue<Band> bands(QueuedBands);
+	BoundedQueue<int> freeBuffers(QueuedBands);
+	std::vector<BandBuffers> buffers(QueuedBands);
+	for (int i = 0; i < QueuedBands; ++i) {
+		freeBuffers.push(i);
+	}
+	double loadSeconds = 0.0, tonemapSeconds = 0.0, encodeSeconds = 0.0;
+	int written = 0, skipped = 0, encodeFailures = 0, withoutWriters = 0;
+
+	std::thread loader([&]() {
+		for (int number : numbers) {
+			const auto begin = std::chrono::steady_clock::now();
+			LoadedFrame item = { number, load(number) };
+			loadSeconds += secondsSince(begin);
+			images.push(std::move(item));
+		}
+		images.close();
+	});
+
+	std::thread encoder([&]() {
+		Band band;
+		while (bands.pop(band)) {
+			const auto begin = std::chrono::steady_clock::now();
+			FrameState &state = *band.state;
+			const std::vector<ImageWriter *> &writers = state.frame.writers;
+			for (size_t k = 0; k < writers.size() && !state.failed; ++k) {
+				state.failed = !writers[k]->writeRows(buffers[band.buffers].data[k].get(), band.rows);
+			}
+			freeBuffers.push(band.buffers);
+			if (band.last) {
+				for (ImageWriter *writer : writers) {
+					state.failed |= !writer->finish();
+				}
+				if (state.failed) {
+					cerr << "Error: Could not save frame " << state.frame.number << endl;
+					++encodeFailures;
+				} else {
+					++written;
+				}
+			}
+			band = Band();
+			encodeSeconds += secondsSince(begin);
+		}
+	});
+
+	// Tonemapping stage, bands of all writers of a frame are mapped in one pass as in Image::save()
+	LoadedFrame item;
+	TonemapOptions bandOptions = options;
+	std::vector<OutputBuffer> outputs;
+	while (images.pop(item)) {
+		auto begin = std::chrono::steady_clock::now();
+		const Image *image = item.image.get();
+		if (!image || image->getWidth() <= 0 || image->getHeight() <= 0) {
+			cerr << "Error: Could not load frame " << item.number << endl;
+			++skipped;
+			continue;
+		}
+		std::shared_ptr<FrameState> state = std::make_shared<FrameState>();
+		SequenceFrame &frame = state->frame;
+		frame.number = item.number;
+		bool valid = setup(*image, frame);
+		for (ImageWriter *writer : frame.writers) {
+			valid &= writer->isValid() && writer->getWidth() == image->getWidth() && writer->getHeight() == image->getHeight();
+		}
+		if (!valid) {
+			cerr << "Error: Could not create the outputs of frame " << item.number << endl;
+			++skipped;
+			continue;
+		}
+		if (frame.writers.empty()) {
+			// Everything was written by the setup, e.g. portable float maps
+			++withoutWriters;
+			continue;
+		}
+
+		const int width = image->getWidth(), height = image->getHeight();
+		const int bandHeight = Image::getBandHeight(frame.writers);
+		const size_t count = frame.writers.size();
+		for (int row = 0; row < height; row += bandHeight) {
+			tonemapSeconds += secondsSince(begin);
+			int index = 0;
+			freeBuffers.pop(index);
+			begin = std::chrono::steady_clock::now();
+
+			BandBuffers &band = buffers[index];
+			band.data.resize(count);
+			band.sizes.resize(count, 0);
+			outputs.clear();
+			for (size_t k = 0; k < count; ++k) {
+				const OutputFormat format = frame.writers[k]->getFormat();
+				const size_t size = 3 * (size_t) width * bandHeight * getOutputSampleSize(format);
+				if (band.sizes[k] < size) {
+					band.data[k].reset(new uint8_t[size]);
+					band.sizes[k] = size;
+				}
+				outputs.push_back(OutputBuffer(format, band.data[k].get()));
+			}
+			bandOptions.rowBegin = row;
+			bandOptions.rowEnd = std::min(row + bandHeight, height);
+			tonemap->process(image, outputs.data(), (int) count, frame.exposure, nullptr, bandOptions);
+			const Band mapped = { state, index, bandOptions.rowEnd - row, bandOptions.rowEnd == height };
+			bands.push(mapped);
+		}
+		// The image is not needed anymore, the encoder finishes the writers
+		state.reset();
+		item.image.reset();
+		tonemapSeconds += secondsSince(begin);
+	}
+	bands.close();
+	loader.join();
+	encoder.join();
+
+	if (statistics) {
+		statistics->frames = written + withoutWriters;
+		statistics->failed = skipped + encodeFailures;
+		statistics->seconds = secondsSince(start);
+		statistics->loadSeconds = loadSeconds;
+		statistics->tonemapSeconds = tonemapSeconds;
+		statistics->encodeSeconds = encodeSeconds;
+	}
+	return skipped + encodeFailures == 0;
+}
@@ -0,0 +1,78 @@
+/*
+    src/sequence.h -- Image sequences tonemapped in a pipeline
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+#include <tonemap.h>
+
+#include <functional>
+
+class Image;
+class ImageWriter;
+
+/* File names with a frame number: the last run of '#' is replaced by the
+   number, padded with zeros to the length of the run ("beauty.####.exr"
+   gives "beauty.0042.exr"). Longer numbers are used as they are. */
+class FramePattern {
+public:
+	explicit FramePattern(const std::string &pattern);
+
+	// There is a run of '#'
+	bool isValid() const { return m_digits > 0; }
+	static bool isPattern(const std::string &name) { return name.find('#') != std::string::npos; }
+
+	std::string getFilename(int frame) const;
+	// Numbers of the files in the directory that match, in ascending order
+	std::vector<int> findFrames() const;
+
+private:
+	std::string 			m_prefix;
+	std::string 			m_suffix;
+	int 					m_digits = 0;
+};
+
+// Writers and exposure of one frame, set up by the tonemapping stage
+struct SequenceFrame {
+	int number = 0;
+	float exposure = 1.f;
+	// Receive the bands of the frame and are finished after the last one
+	std::vector<ImageWriter *> writers;
+	// Writers of this frame only, destroyed once they are finished (streams outlive the frames)
+	std::vector<std::unique_ptr<ImageWriter>> owned;
+};
+
+// Busy time of the stages, waiting on the queues is not counted
+struct SequenceStatistics {
+	int frames = 0;
+	int failed = 0;
+	double seconds = 0.0;
+	double loadSeconds = 0.0;
+	double tonemapSeconds = 0.0;
+	double encodeSeconds = 0.0;
+};
+
+// Image of frame 'number', null (or an empty image) if it could not be loaded
+typedef std::function<std::unique_ptr<Image>(int number)> FrameLoader;
+/* Sets the operator up for the image of 'frame' (parameters, exposure) and
+   creates its writers, false skips the frame. Called on the tonemapping
+   stage, before the bands of the frame are mapped. */
+typedef std::function<bool(const Image &image, SequenceFrame &frame)> FrameSetup;
+
+/* Tonemaps the images of 'numbers' in three stages that run concurrently
+   on threads of their own: loading (decoding and the statistics of the
+   image), tonemapping and encoding. A bounded queue of loaded images
+   connects the first two, a bounded queue of tonemapped bands the last
+   two, so the stages overlap across frames as well and the throughput
+   approaches the one of the slowest stage. Their parallel loops share
+   ThreadPool::global(). Frames that fail are reported and skipped, false
+   if there were any. */
+bool exportSequence(const std::vector<int> &numbers, const FrameLoader &load, const FrameSetup &setup,
+					const TonemapOperator *tonemap, const TonemapOptions &options = TonemapOptions(),
+					SequenceStatistics *statistics = nullptr);
@@ -0,0 +1,90 @@
+/*
+    src/simd.cpp -- Runtime selection of the SIMD instruction set
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <simd.h>
+
+#include <atomic>
+
+#if defined(TONEMAPPER_SIMD_X86) && defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+static SimdLevel detectSimdLevel() {
+#if defined(TONEMAPPER_SIMD_X86)
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool sse42 = (info[2] & (1 << 20)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool f16c = (info[2] & (1 << 29)) != 0;
+
+	// The OS has to save the AVX (bits 1-2) and AVX-512 (bits 5-7) register state
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool avxState = (xcr0 & 0x6) == 0x6;
+	bool avx512State = (xcr0 & 0xe6) == 0xe6;
+
+	bool avx2 = false, avx512 = false;
+	if (maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+		avx512 = (info[1] & (1 << 16)) != 0;
+	}
+
+	if (avx512 && avx512State) return ESimdAVX512;
+	if (avx2 && avx && f16c && avxState) return ESimdAVX2;
+	if (sse42) return ESimdSSE42;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return ESimdAVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) return ESimdAVX2;
+	if (__builtin_cpu_supports("sse4.2")) return ESimdSSE42;
+#endif
+#endif
+	return ESimdScalar;
+}
+
+SimdLevel getSupportedSimdLevel() {
+	static const SimdLevel level = detectSimdLevel();
+	return level;
+}
+
+static std::atomic<int> s_simdLevel(-1);
+
+SimdLevel getSimdLevel() {
+	int level = s_simdLevel;
+	return level < 0 ? getSupportedSimdLevel() : (SimdLevel) level;
+}
+
+void setSimdLevel(SimdLevel level) {
+	s_simdLevel = (int) std::min(level, getSupportedSimdLevel());
+}
+
+const char *getSimdLevelName(SimdLevel level) {
+	switch (level) {
+		case ESimdSSE42: return "sse4.2";
+		case ESimdAVX2: return "avx2";
+		case ESimdAVX512: return "avx512";
+		default: return "scalar";
+	}
+}
+
+bool parseSimdLevel(const std::string &name, SimdLevel &level) {
+	const SimdLevel levels[] = { ESimdScalar, ESimdSSE42, ESimdAVX2, ESimdAVX512 };
+	for (SimdLevel l : levels) {
+		if (name == getSimdLevelName(l)) {
+			level = l;
+			return true;
+		}
+	}
+	return false;
+}
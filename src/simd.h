@@ -0,0 +1,89 @@
+/*
+    src/simd.h -- Runtime selection of the SIMD instruction set and scalar
+                  versions of the math functions used by the operator kernels
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+
+enum SimdLevel {
+	ESimdScalar = 0,
+	ESimdSSE42,
+	ESimdAVX2,		// Includes F16C
+	ESimdAVX512
+};
+
+/* Accuracy of pow, exp and log in the SIMD kernels. EMathPrecise calls the
+   C library for every lane, the result is identical for all instruction
+   sets. EMathFast uses the approximations of src/simd/fastmath.h, which stay
+   within one 8 bit code. The scalar kernels always use the C library. */
+enum MathMode {
+	EMathPrecise = 0,
+	EMathFast
+};
+
+// Best instruction set that is both compiled in and supported by the CPU
+SimdLevel getSupportedSimdLevel();
+
+// Instruction set used by the CPU kernels, defaults to getSupportedSimdLevel()
+SimdLevel getSimdLevel();
+
+// Selects the instruction set for the CPU kernels, clamped to getSupportedSimdLevel()
+void setSimdLevel(SimdLevel level);
+
+const char *getSimdLevelName(SimdLevel level);
+
+// Parses "scalar", "sse4.2", "avx2" or "avx512", returns false for unknown names
+bool parseSimdLevel(const std::string &name, SimdLevel &level);
+
+/* The kernels in src/operators/ are templates over the numeric type and are
+   instantiated both for float and for the SIMD packs in src/simd/. These
+   overloads provide the scalar versions of all operations besides plain
+   arithmetic, the packs overload them with the same semantics (found via
+   argument dependent lookup). vmin() and vmax() behave like std::min() and
+   std::max(), including the treatment of NaNs. */
+inline float vmin(float a, float b) { return std::min(a, b); }
+inline float vmax(float a, float b) { return std::max(a, b); }
+inline float vclamp(float v, float min, float max) { return vmin(max, vmax(min, v)); }
+inline float vselect(bool mask, float a, float b) { return mask ? a : b; }
+
+inline float vpow(float x, float y) { return std::pow(x, y); }
+inline float vexp(float x) { return std::exp(x); }
+inline float vlog(float x) { return std::log(x); }
+inline float vlog10(float x) { return std::log10(x); }
+
+// table[index] for integral index, the packs load one element per lane
+inline float vgather(const float *table, float index) { return table[(int) index]; }
+
+// Scalar versions of the bit level helpers
+inline float vfloor(float x) { return std::floor(x); }
+
+// Unbiased exponent of a positive normal number
+inline float vexponent(float x) {
+	uint32_t i;
+	memcpy(&i, &x, sizeof(float));
+	return (float) (int) ((i >> 23) & 0xff) - 127.f;
+}
+
+// Mantissa of a positive normal number, in [1, 2)
+inline float vmantissa(float x) {
+	uint32_t i;
+	memcpy(&i, &x, sizeof(float));
+	i = (i & 0x007fffff) | 0x3f800000;
+	memcpy(&x, &i, sizeof(float));
+	return x;
+}
+
+// 2^n for integral n in [-127, 128], -127 yields zero and 128 infinity
+inline float vexp2i(float n) {
+	uint32_t i = (uint32_t) ((int) n + 127) << 23;
+	float x;
+	memcpy(&x, &i, sizeof(float));
+	return x;
+}
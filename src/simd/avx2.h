@@ -0,0 +1,102 @@
+/*
+    src/simd/avx2.h -- 8-wide float pack for AVX2
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <simd/fastmath.h>
+
+#include <immintrin.h>
+#include <math.h>
+
+/* Only include this header from translation units that are compiled for
+   AVX2 (see CMakeLists.txt), all functions are inline. */
+namespace avx2 {
+
+struct Mask {
+	__m256 v;
+
+	Mask(__m256 v) : v(v) {}
+};
+
+/* All operations are friends defined in the class, they are found via
+   argument dependent lookup and accept floats for either argument. 'Mode'
+   selects the implementation of the transcendental functions. */
+template <int Mode>
+struct BasicFloat {
+	static const int Width = 8;
+
+	__m256 v;
+
+	BasicFloat() {}
+	BasicFloat(float f) : v(_mm256_set1_ps(f)) {}
+	BasicFloat(__m256 v) : v(v) {}
+
+	static BasicFloat load(const float *p) { return _mm256_loadu_ps(p); }
+	void store(float *p) const { _mm256_storeu_ps(p, v); }
+
+	friend BasicFloat operator+(BasicFloat a, BasicFloat b) { return _mm256_add_ps(a.v, b.v); }
+	friend BasicFloat operator-(BasicFloat a, BasicFloat b) { return _mm256_sub_ps(a.v, b.v); }
+	friend BasicFloat operator*(BasicFloat a, BasicFloat b) { return _mm256_mul_ps(a.v, b.v); }
+	friend BasicFloat operator/(BasicFloat a, BasicFloat b) { return _mm256_div_ps(a.v, b.v); }
+	friend BasicFloat &operator+=(BasicFloat &a, BasicFloat b) { return a = a + b; }
+
+	friend Mask operator<(BasicFloat a, BasicFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+	friend Mask operator<=(BasicFloat a, BasicFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+
+	// Operands are swapped to get the NaN behavior of std::min() and std::max()
+	friend BasicFloat vmin(BasicFloat a, BasicFloat b) { return _mm256_min_ps(b.v, a.v); }
+	friend BasicFloat vmax(BasicFloat a, BasicFloat b) { return _mm256_max_ps(b.v, a.v); }
+	friend BasicFloat vclamp(BasicFloat v, BasicFloat min, BasicFloat max) { return vmin(max, vmax(min, v)); }
+	friend BasicFloat vselect(Mask mask, BasicFloat a, BasicFloat b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+
+	friend BasicFloat vfloor(BasicFloat x) { return _mm256_floor_ps(x.v); }
+	friend BasicFloat vgather(const float *table, BasicFloat index) { return _mm256_i32gather_ps(table, _mm256_cvttps_epi32(index.v), 4); }
+
+	friend BasicFloat vexponent(BasicFloat x) {
+		__m256i e = _mm256_and_si256(_mm256_srli_epi32(_mm256_castps_si256(x.v), 23), _mm256_set1_epi32(0xff));
+		return _mm256_cvtepi32_ps(_mm256_sub_epi32(e, _mm256_set1_epi32(127)));
+	}
+
+	friend BasicFloat vmantissa(BasicFloat x) {
+		__m256i m = _mm256_and_si256(_mm256_castps_si256(x.v), _mm256_set1_epi32(0x007fffff));
+		return _mm256_castsi256_ps(_mm256_or_si256(m, _mm256_set1_epi32(0x3f800000)));
+	}
+
+	friend BasicFloat vexp2i(BasicFloat n) {
+		__m256i e = _mm256_add_epi32(_mm256_cvttps_epi32(n.v), _mm256_set1_epi32(127));
+		return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+	}
+
+	friend BasicFloat vpow(BasicFloat x, BasicFloat y) {
+		if (Mode == EMathFast) return fastPow(x, y);
+		float a[Width], b[Width];
+		x.store(a);
+		y.store(b);
+		for (int i = 0; i < Width; ++i) a[i] = powf(a[i], b[i]);
+		return load(a);
+	}
+
+	friend BasicFloat vexp(BasicFloat x) { return Mode == EMathFast ? fastExp(x) : perLane(x, expf); }
+	friend BasicFloat vlog(BasicFloat x) { return Mode == EMathFast ? fastLog(x) : perLane(x, logf); }
+	friend BasicFloat vlog10(BasicFloat x) { return Mode == EMathFast ? fastLog10(x) : perLane(x, log10f); }
+
+private:
+	template <typename Func>
+	static BasicFloat perLane(BasicFloat x, Func func) {
+		float a[Width];
+		x.store(a);
+		for (int i = 0; i < Width; ++i) a[i] = func(a[i]);
+		return load(a);
+	}
+};
+
+typedef BasicFloat<EMathPrecise> Float;
+typedef BasicFloat<EMathFast> FastFloat;
+
+}
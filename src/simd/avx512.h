@@ -0,0 +1,102 @@
+/*
+    src/simd/avx512.h -- 16-wide float pack for AVX-512
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <simd/fastmath.h>
+
+#include <immintrin.h>
+#include <math.h>
+
+/* Only include this header from translation units that are compiled for
+   AVX-512 (see CMakeLists.txt), all functions are inline. */
+namespace avx512 {
+
+struct Mask {
+	__mmask16 v;
+
+	Mask(__mmask16 v) : v(v) {}
+};
+
+/* All operations are friends defined in the class, they are found via
+   argument dependent lookup and accept floats for either argument. 'Mode'
+   selects the implementation of the transcendental functions. */
+template <int Mode>
+struct BasicFloat {
+	static const int Width = 16;
+
+	__m512 v;
+
+	BasicFloat() {}
+	BasicFloat(float f) : v(_mm512_set1_ps(f)) {}
+	BasicFloat(__m512 v) : v(v) {}
+
+	static BasicFloat load(const float *p) { return _mm512_loadu_ps(p); }
+	void store(float *p) const { _mm512_storeu_ps(p, v); }
+
+	friend BasicFloat operator+(BasicFloat a, BasicFloat b) { return _mm512_add_ps(a.v, b.v); }
+	friend BasicFloat operator-(BasicFloat a, BasicFloat b) { return _mm512_sub_ps(a.v, b.v); }
+	friend BasicFloat operator*(BasicFloat a, BasicFloat b) { return _mm512_mul_ps(a.v, b.v); }
+	friend BasicFloat operator/(BasicFloat a, BasicFloat b) { return _mm512_div_ps(a.v, b.v); }
+	friend BasicFloat &operator+=(BasicFloat &a, BasicFloat b) { return a = a + b; }
+
+	friend Mask operator<(BasicFloat a, BasicFloat b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+	friend Mask operator<=(BasicFloat a, BasicFloat b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ); }
+
+	// Operands are swapped to get the NaN behavior of std::min() and std::max()
+	friend BasicFloat vmin(BasicFloat a, BasicFloat b) { return _mm512_min_ps(b.v, a.v); }
+	friend BasicFloat vmax(BasicFloat a, BasicFloat b) { return _mm512_max_ps(b.v, a.v); }
+	friend BasicFloat vclamp(BasicFloat v, BasicFloat min, BasicFloat max) { return vmin(max, vmax(min, v)); }
+	friend BasicFloat vselect(Mask mask, BasicFloat a, BasicFloat b) { return _mm512_mask_blend_ps(mask.v, b.v, a.v); }
+
+	friend BasicFloat vfloor(BasicFloat x) { return _mm512_roundscale_ps(x.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+	friend BasicFloat vgather(const float *table, BasicFloat index) { return _mm512_i32gather_ps(_mm512_cvttps_epi32(index.v), table, 4); }
+
+	friend BasicFloat vexponent(BasicFloat x) {
+		__m512i e = _mm512_and_si512(_mm512_srli_epi32(_mm512_castps_si512(x.v), 23), _mm512_set1_epi32(0xff));
+		return _mm512_cvtepi32_ps(_mm512_sub_epi32(e, _mm512_set1_epi32(127)));
+	}
+
+	friend BasicFloat vmantissa(BasicFloat x) {
+		__m512i m = _mm512_and_si512(_mm512_castps_si512(x.v), _mm512_set1_epi32(0x007fffff));
+		return _mm512_castsi512_ps(_mm512_or_si512(m, _mm512_set1_epi32(0x3f800000)));
+	}
+
+	friend BasicFloat vexp2i(BasicFloat n) {
+		__m512i e = _mm512_add_epi32(_mm512_cvttps_epi32(n.v), _mm512_set1_epi32(127));
+		return _mm512_castsi512_ps(_mm512_slli_epi32(e, 23));
+	}
+
+	friend BasicFloat vpow(BasicFloat x, BasicFloat y) {
+		if (Mode == EMathFast) return fastPow(x, y);
+		float a[Width], b[Width];
+		x.store(a);
+		y.store(b);
+		for (int i = 0; i < Width; ++i) a[i] = powf(a[i], b[i]);
+		return load(a);
+	}
+
+	friend BasicFloat vexp(BasicFloat x) { return Mode == EMathFast ? fastExp(x) : perLane(x, expf); }
+	friend BasicFloat vlog(BasicFloat x) { return Mode == EMathFast ? fastLog(x) : perLane(x, logf); }
+	friend BasicFloat vlog10(BasicFloat x) { return Mode == EMathFast ? fastLog10(x) : perLane(x, log10f); }
+
+private:
+	template <typename Func>
+	static BasicFloat perLane(BasicFloat x, Func func) {
+		float a[Width];
+		x.store(a);
+		for (int i = 0; i < Width; ++i) a[i] = func(a[i]);
+		return load(a);
+	}
+};
+
+typedef BasicFloat<EMathPrecise> Float;
+typedef BasicFloat<EMathFast> FastFloat;
+
+}
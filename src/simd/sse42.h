@@ -0,0 +1,108 @@
+/*
+    src/simd/sse42.h -- 4-wide float pack for SSE4.2
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <simd/fastmath.h>
+
+#include <nmmintrin.h>
+#include <math.h>
+
+/* Only include this header from translation units that are compiled for
+   SSE4.2 (see CMakeLists.txt), all functions are inline. */
+namespace sse42 {
+
+struct Mask {
+	__m128 v;
+
+	Mask(__m128 v) : v(v) {}
+};
+
+/* All operations are friends defined in the class, they are found via
+   argument dependent lookup and accept floats for either argument. 'Mode'
+   selects the implementation of the transcendental functions. */
+template <int Mode>
+struct BasicFloat {
+	static const int Width = 4;
+
+	__m128 v;
+
+	BasicFloat() {}
+	BasicFloat(float f) : v(_mm_set1_ps(f)) {}
+	BasicFloat(__m128 v) : v(v) {}
+
+	static BasicFloat load(const float *p) { return _mm_loadu_ps(p); }
+	void store(float *p) const { _mm_storeu_ps(p, v); }
+
+	friend BasicFloat operator+(BasicFloat a, BasicFloat b) { return _mm_add_ps(a.v, b.v); }
+	friend BasicFloat operator-(BasicFloat a, BasicFloat b) { return _mm_sub_ps(a.v, b.v); }
+	friend BasicFloat operator*(BasicFloat a, BasicFloat b) { return _mm_mul_ps(a.v, b.v); }
+	friend BasicFloat operator/(BasicFloat a, BasicFloat b) { return _mm_div_ps(a.v, b.v); }
+	friend BasicFloat &operator+=(BasicFloat &a, BasicFloat b) { return a = a + b; }
+
+	friend Mask operator<(BasicFloat a, BasicFloat b) { return _mm_cmplt_ps(a.v, b.v); }
+	friend Mask operator<=(BasicFloat a, BasicFloat b) { return _mm_cmple_ps(a.v, b.v); }
+
+	// Operands are swapped to get the NaN behavior of std::min() and std::max()
+	friend BasicFloat vmin(BasicFloat a, BasicFloat b) { return _mm_min_ps(b.v, a.v); }
+	friend BasicFloat vmax(BasicFloat a, BasicFloat b) { return _mm_max_ps(b.v, a.v); }
+	friend BasicFloat vclamp(BasicFloat v, BasicFloat min, BasicFloat max) { return vmin(max, vmax(min, v)); }
+	friend BasicFloat vselect(Mask mask, BasicFloat a, BasicFloat b) { return _mm_blendv_ps(b.v, a.v, mask.v); }
+
+	friend BasicFloat vfloor(BasicFloat x) { return _mm_floor_ps(x.v); }
+
+	// No gathers in SSE, the elements are loaded one by one
+	friend BasicFloat vgather(const float *table, BasicFloat index) {
+		int i[Width];
+		_mm_storeu_si128((__m128i *) i, _mm_cvttps_epi32(index.v));
+		return _mm_setr_ps(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+	}
+
+	friend BasicFloat vexponent(BasicFloat x) {
+		__m128i e = _mm_and_si128(_mm_srli_epi32(_mm_castps_si128(x.v), 23), _mm_set1_epi32(0xff));
+		return _mm_cvtepi32_ps(_mm_sub_epi32(e, _mm_set1_epi32(127)));
+	}
+
+	friend BasicFloat vmantissa(BasicFloat x) {
+		__m128i m = _mm_and_si128(_mm_castps_si128(x.v), _mm_set1_epi32(0x007fffff));
+		return _mm_castsi128_ps(_mm_or_si128(m, _mm_set1_epi32(0x3f800000)));
+	}
+
+	friend BasicFloat vexp2i(BasicFloat n) {
+		__m128i e = _mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127));
+		return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+	}
+
+	friend BasicFloat vpow(BasicFloat x, BasicFloat y) {
+		if (Mode == EMathFast) return fastPow(x, y);
+		float a[Width], b[Width];
+		x.store(a);
+		y.store(b);
+		for (int i = 0; i < Width; ++i) a[i] = powf(a[i], b[i]);
+		return load(a);
+	}
+
+	friend BasicFloat vexp(BasicFloat x) { return Mode == EMathFast ? fastExp(x) : perLane(x, expf); }
+	friend BasicFloat vlog(BasicFloat x) { return Mode == EMathFast ? fastLog(x) : perLane(x, logf); }
+	friend BasicFloat vlog10(BasicFloat x) { return Mode == EMathFast ? fastLog10(x) : perLane(x, log10f); }
+
+private:
+	template <typename Func>
+	static BasicFloat perLane(BasicFloat x, Func func) {
+		float a[Width];
+		x.store(a);
+		for (int i = 0; i < Width; ++i) a[i] = func(a[i]);
+		return load(a);
+	}
+};
+
+typedef BasicFloat<EMathPrecise> Float;
+typedef BasicFloat<EMathFast> FastFloat;
+
+}
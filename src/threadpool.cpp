@@ -0,0 +1,119 @@
+/*
+    src/threadpool.cpp -- Reusable pool of worker threads
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <threadpool.h>
+
+// Set while a thread executes work items, used to run nested parallelFor() calls serially
+static thread_local bool t_insideJob = false;
+
+ThreadPool::ThreadPool(int threadCount) : m_next(0) {
+	startWorkers(threadCount);
+}
+
+ThreadPool::~ThreadPool() {
+	stopWorkers();
+}
+
+ThreadPool &ThreadPool::global() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::setThreadCount(int threadCount) {
+	std::lock_guard<std::mutex> lock(m_submitMutex);
+	stopWorkers();
+	startWorkers(threadCount);
+}
+
+void ThreadPool::startWorkers(int threadCount) {
+	if (threadCount <= 0) {
+		threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+	}
+	// New workers wait for the next job, not for the ones submitted before they were started
+	uint64_t generation;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = false;
+		generation = m_generation;
+	}
+	for (int i = 0; i < threadCount - 1; ++i) {
+		m_workers.push_back(std::thread(&ThreadPool::workerLoop, this, generation));
+	}
+}
+
+void ThreadPool::stopWorkers() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+	}
+	m_wakeCondition.notify_all();
+	for (auto &worker : m_workers) {
+		worker.join();
+	}
+	m_workers.clear();
+}
+
+void ThreadPool::runJob() {
+	bool wasInside = t_insideJob;
+	t_insideJob = true;
+	int i;
+	while ((i = m_next.fetch_add(1)) < m_count) {
+		(*m_func)(i);
+	}
+	t_insideJob = wasInside;
+}
+
+void ThreadPool::workerLoop(uint64_t generation) {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeCondition.wait(lock, [&] { return m_shutdown || m_generation != generation; });
+			if (m_shutdown) {
+				return;
+			}
+			generation = m_generation;
+		}
+
+		runJob();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_busyWorkers == 0) {
+			m_doneCondition.notify_one();
+		}
+	}
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &func) {
+	if (count <= 0) {
+		return;
+	}
+	if (t_insideJob || m_workers.empty() || count == 1) {
+		for (int i = 0; i < count; ++i) {
+			func(i);
+		}
+		return;
+	}
+
+	std::lock_guard<std::mutex> submitLock(m_submitMutex);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_func = &func;
+		m_count = count;
+		m_next = 0;
+		m_busyWorkers = (int) m_workers.size();
+		m_generation++;
+	}
+	m_wakeCondition.notify_all();
+
+	runJob();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [&] { return m_busyWorkers == 0; });
+	m_func = nullptr;
+}
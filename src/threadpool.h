@@ -0,0 +1,58 @@
+/*
+    src/threadpool.h -- Reusable pool of worker threads
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <global.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class ThreadPool {
+public:
+	/* Creates a pool that executes work on 'threadCount' threads in total,
+	   including the calling thread. 0 picks the number of hardware threads. */
+	explicit ThreadPool(int threadCount = 0);
+	~ThreadPool();
+
+	// Pool shared by image loading, tonemapping and export
+	static ThreadPool &global();
+
+	int getThreadCount() const { return (int) m_workers.size() + 1; }
+	void setThreadCount(int threadCount);
+
+	/* Calls func(i) for all i in [0, count). Indices are handed out
+	   dynamically, so idle threads keep picking up the remaining work items.
+	   Blocks until all items are done. Nested calls run serially. */
+	void parallelFor(int count, const std::function<void(int)> &func);
+
+private:
+	void startWorkers(int threadCount);
+	void stopWorkers();
+	// 'generation' is the last job the worker has seen
+	void workerLoop(uint64_t generation);
+	void runJob();
+
+	std::vector<std::thread> 	m_workers;
+
+	std::mutex 					m_submitMutex;
+	std::mutex 					m_mutex;
+	std::condition_variable 	m_wakeCondition;
+	std::condition_variable 	m_doneCondition;
+
+	const std::function<void(int)> *m_func = nullptr;
+	int 						m_count = 0;
+	std::atomic<int> 			m_next;
+	uint64_t 					m_generation = 0;
+	int 						m_busyWorkers = 0;
+	bool 						m_shutdown = false;
+};
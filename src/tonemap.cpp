@@ -0,0 +1,43 @@
+/*
+    src/tonemap.cpp -- Registry of all tonemapping operators
+
+    Copyright (c) 2016 Tizian Zeltner
+
+    Tone Mapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <tonemap.h>
+
+#include <image.h>
+#include <threadpool.h>
+
+#include <operators/all.h>
+
+void TonemapOperator::forEachBand(int height, float *progress, const std::function<void(int, int)> &func) {
+	const int bands = (height + BandHeight - 1) / BandHeight;
+
+	std::mutex progressMutex;
+	int rowsDone = 0;
+	if (progress) *progress = 0.f;
+
+	ThreadPool::global().parallelFor(bands, [&](int band) {
+		int rowBegin = band * BandHeight;
+		int rowEnd = std::min(rowBegin + BandHeight, height);
+		func(rowBegin, rowEnd);
+
+		if (progress) {
+			std::lock_guard<std::mutex> lock(progressMutex);
+			rowsDone += rowEnd - rowBegin;
+			*progress = (float) rowsDone / height;
+		}
+	});
+}
+
+std::vector<std::unique_ptr<TonemapOperator>> createTonemapOperators() {
+	std::vector<std::unique_ptr<TonemapOperator>> operators;
+#define CREATE_OPERATOR(Operator) operators.push_back(std::unique_ptr<TonemapOperator>(new Operator()));
+	TONEMAP_FOR_EACH_OPERATOR(CREATE_OPERATOR)
+#undef CREATE_OPERATOR
+	return operators;
+}
@@ -10,10 +10,16 @@
 #pragma once
 
 #include <global.h>
-#include <nanogui/glutil.h>
+#include <encode.h>
+#include <simd.h>
 
+#include <Eigen/Core>
+
+#include <functional>
+
+// Description of a parameter, only used by the GUI and the command line
 struct Parameter {
-	float value;
+	std::string name;
 	float defaultValue;
 	float minValue;
 	float maxValue;
@@ -24,43 +30,153 @@ struct Parameter {
 	Parameter() {}
 	
 	Parameter(float defaultValue, float minValue, float maxValue, const std::string &uniform, const std::string &description)
-		: value(defaultValue), defaultValue(defaultValue), minValue(minValue), maxValue(maxValue),
+		: defaultValue(defaultValue), minValue(minValue), maxValue(maxValue),
 		uniform(uniform), description(description), constant(false) {}
 	Parameter(float value, const std::string &uniform, const std::string &description)
-		: value(value), uniform(uniform), description(description), constant(true) {}
+		: defaultValue(value), minValue(value), maxValue(value), uniform(uniform), description(description), constant(true) {}
 
-		Parameter(float defaultValue, float minValue, float maxValue, const std::string &uniform)
-		: value(defaultValue), defaultValue(defaultValue), minValue(minValue), maxValue(maxValue),
+	Parameter(float defaultValue, float minValue, float maxValue, const std::string &uniform)
+		: defaultValue(defaultValue), minValue(minValue), maxValue(maxValue),
 		uniform(uniform), description(""), constant(false) {}
 	Parameter(float value, const std::string &uniform)
-		: value(value), uniform(uniform), description(""), constant(true) {}
+		: defaultValue(value), minValue(value), maxValue(value), uniform(uniform), description(""), constant(true) {}
 };
 
-typedef std::map<std::string, Parameter> ParameterMap;
+/* Parameter values of an operator, stored contiguously and addressed by the
+   index they were declared with (usually an enum of the operator). Kernels
+   and the GUI uniform upload only read the flat value array, names are kept
+   separately for lookups from the user interface. */
+class ParameterBlock {
+public:
+	// Parameters have to be declared in index order: 0, 1, 2, ...
+	void declare(int index, const std::string &name, const Parameter &parameter) {
+		assert(index == size());
+		(void) index;
+		m_values.push_back(parameter.defaultValue);
+		m_parameters.push_back(parameter);
+		m_parameters.back().name = name;
+	}
+
+	inline float operator[](int index) const { return m_values[index]; }
+	inline float &operator[](int index) { return m_values[index]; }
+
+	inline const Parameter &info(int index) const { return m_parameters[index]; }
+	inline Parameter &info(int index) { return m_parameters[index]; }
+
+	inline const float *values() const { return m_values.data(); }
+	inline int size() const { return (int) m_values.size(); }
+
+	// Changes default value and range, the current value is reset to the new default
+	void setRange(int index, float defaultValue, float minValue, float maxValue) {
+		m_parameters[index].defaultValue = defaultValue;
+		m_parameters[index].minValue = minValue;
+		m_parameters[index].maxValue = maxValue;
+		m_values[index] = defaultValue;
+	}
 
+	// Returns the index of the parameter called 'name', or -1
+	int find(const std::string &name) const {
+		for (int i = 0; i < size(); ++i) {
+			if (m_parameters[i].name == name) return i;
+		}
+		return -1;
+	}
+
+private:
+	std::vector<float> 		m_values;
+	std::vector<Parameter> 	m_parameters;
+};
+
+class ColorTable;
 class Image;
 
+// Destination of process(), tightly packed RGB rows of 'format' samples
+struct OutputBuffer {
+	OutputFormat format;
+	void *data;
+
+	OutputBuffer(OutputFormat format, void *data) : format(format), data(data) {}
+};
+
+// Settings of a single process() call
+struct TonemapOptions {
+	MathMode math;
+	Quantization quantization;
+
+	// Global luminance operators sample their curve into a table, see LuminanceKernelOperator
+	bool bakeLuminance;
+	// Receives the largest error of the baked curve (in display luminance, 1 is white), if not null
+	float *bakeError;
+
+	// Grid size of a ColorTable the operator is baked into for this call, 0 maps every pixel directly
+	int colorTableSize;
+
+	/* Only the rows [rowBegin, rowEnd) are tonemapped and 'dst' just holds
+	   these, a negative rowEnd stands for the height of the image */
+	int rowBegin;
+	int rowEnd;
+
+	TonemapOptions() : math(EMathPrecise), quantization(ETruncate), bakeLuminance(false), bakeError(nullptr),
+					   colorTableSize(0), rowBegin(0), rowEnd(-1) {}
+};
+
 class TonemapOperator {
 public:
 	std::string 		name;
 	std::string 		description;
-	ParameterMap 		parameters;
-	nanogui::GLShader  *shader = nullptr;
+	ParameterBlock 		parameters;
+
+	/* GLSL sources of the interactive preview. They are only compiled by the
+	   GUI, the CPU path in process() never touches OpenGL. */
+	std::string 		shaderName;
+	std::string 		vertexShader;
+	std::string 		fragmentShader;
 	
 	TonemapOperator() {
-		parameters = ParameterMap();
-		shader = new nanogui::GLShader();
 		description = "<no description>";
 		name = "<no name>";
 	}
 
-	virtual ~TonemapOperator() {
-		delete shader;
-	}
+	virtual ~TonemapOperator() {}
 
 	std::string getString() const { return name; }
 
 	virtual void setParameters(const Image *image) {}
-	virtual void process(const Image *image, uint8_t *dst, float exposure, float *progress) const {}
 	virtual float graph(float value) const { return 0.f; }
-};
\ No newline at end of file
+
+	/* Tonemaps the image (or the rows given in 'options') into all 'count'
+	   outputs in one pass, each gets the display values in its own format.
+	   See TonemapKernelOperator in kernel.h for the implementation shared by
+	   all operators. */
+	virtual void process(const Image *image, const OutputBuffer *outputs, int count, float exposure, float *progress,
+						 const TonemapOptions &options = TonemapOptions()) const = 0;
+
+	// Same with 8 bit RGB in 'dst' as the only output
+	void process(const Image *image, uint8_t *dst, float exposure, float *progress,
+				 const TonemapOptions &options = TonemapOptions()) const {
+		const OutputBuffer output(EOutputUInt8, dst);
+		process(image, &output, 1, exposure, progress, options);
+	}
+
+	/* Samples the operator and its display encoding into a 3D table of
+	   size^3 entries, which covers the value range of 'image' */
+	virtual std::shared_ptr<const ColorTable> bakeColorTable(const Image *image, float exposure, int size) const = 0;
+
+	// Number of rows per work item of process()
+	static const int BandHeight = 16;
+
+protected:
+	/* Calls func(rowBegin, rowEnd) for all bands of BandHeight rows in parallel
+	   on ThreadPool::global() and keeps 'progress' up to date. Every row is
+	   computed independently, the result is identical to a serial run. */
+	static void forEachBand(int height, float *progress, const std::function<void(int, int)> &func);
+
+	void setShader(const std::string &name, const std::string &vertex, const std::string &fragment) {
+		shaderName = name;
+		vertexShader = vertex;
+		fragmentShader = fragment;
+	}
+};
+
+// Creates one instance of every available operator, in the order shown in the GUI
+std::vector<std::unique_ptr<TonemapOperator>> createTonemapOperators();
\ No newline at end of file